@@ -23,6 +23,9 @@
  * openocd -c "adapter driver remote_bitbang; remote_bitbang host raspberrypi; remote_bitbang port 7777" \
  *  -f target/stm32f1x.cfg
  *
+ * Add "remote_bitbang protocol auto" to use the bulk shift requests of
+ * protocol version 2.
+ *
  * Or if you want to test UNIX sockets, run both on Raspberry Pi:
  * socat UNIX-LISTEN:/tmp/remotebitbang-socket,fork EXEC:"sudo ./remote_bitbang_sysfsgpio tck 11 tms 25 tdo 9 tdi 10"
  * openocd -c "adapter driver remote_bitbang; remote_bitbang host /tmp/remotebitbang-socket" -f target/stm32f1x.cfg
@@ -47,6 +50,12 @@
 #define ERROR_FAIL	(-2)
 #define ERROR_JTAG_INIT_FAILED	ERROR_FAIL
 
+/* Flags of the bulk shift request of protocol version 2 */
+#define SHIFT_TDI		0x01
+#define SHIFT_TMS		0x02
+#define SHIFT_TMS_LAST	0x04
+#define SHIFT_TDO		0x08
+
 /*
  * Helper func to determine if gpio number valid
  *
@@ -390,6 +399,58 @@ static void cleanup_all_fds(void)
 	cleanup_fd(srst_fd, srst_gpio);
 }
 
+/*
+ * Bulk shift request of protocol version 2: u32 number of bits, u8 flags,
+ * then the TMS and TDI bits if present. The TDO bits are sent back if
+ * requested.
+ */
+static void process_shift(void)
+{
+	unsigned char header[5];
+
+	if (fread(header, 1, sizeof(header), stdin) != sizeof(header)) {
+		LOG_ERROR("reading shift request failed");
+		return;
+	}
+
+	unsigned int bits = header[0] | header[1] << 8 | header[2] << 16 |
+		(unsigned int)header[3] << 24;
+	int flags = header[4];
+	size_t bytes = (bits + 7) / 8;
+	unsigned char *tms = calloc(bytes + 1, 1);
+	unsigned char *tdi = calloc(bytes + 1, 1);
+	unsigned char *tdo = calloc(bytes + 1, 1);
+
+	if (!tms || !tdi || !tdo) {
+		LOG_ERROR("out of memory");
+		exit(1);
+	}
+
+	if ((flags & SHIFT_TMS) && fread(tms, 1, bytes, stdin) != bytes)
+		LOG_ERROR("reading tms failed");
+	if ((flags & SHIFT_TDI) && fread(tdi, 1, bytes, stdin) != bytes)
+		LOG_ERROR("reading tdi failed");
+	if ((flags & SHIFT_TMS_LAST) && bits)
+		tms[(bits - 1) / 8] |= 1 << ((bits - 1) % 8);
+
+	for (unsigned int i = 0; i < bits; i++) {
+		int tms_bit = (tms[i / 8] >> (i % 8)) & 1;
+		int tdi_bit = (tdi[i / 8] >> (i % 8)) & 1;
+
+		sysfsgpio_write(0, tms_bit, tdi_bit);
+		if ((flags & SHIFT_TDO) && sysfsgpio_read() == '1')
+			tdo[i / 8] |= 1 << (i % 8);
+		sysfsgpio_write(1, tms_bit, tdi_bit);
+	}
+
+	if ((flags & SHIFT_TDO) && fwrite(tdo, 1, bytes, stdout) != bytes)
+		LOG_ERROR("writing tdo failed");
+
+	free(tms);
+	free(tdi);
+	free(tdo);
+}
+
 static void process_remote_protocol(void)
 {
 	int c;
@@ -410,6 +471,10 @@ static void process_remote_protocol(void)
 					(d & 1));
 		} else if (c == 'R')
 			putchar(sysfsgpio_read());
+		else if (c == 'V') /* Protocol version */
+			putchar('2');
+		else if (c == 'X') /* Bulk shift */
+			process_shift();
 		else if (c == 'c') /* SWDIO read */
 			putchar(sysfsgpio_swdio_read());
 		else if (c == 'o' || c == 'O') /* SWDIO drive */
@@ -16,6 +16,7 @@
 #include <flash/nor/core.h>
 #include <flash/nor/imp.h>
 #include <target/image.h>
+#include <helper/time_support.h>
 
 /**
  * @file
@@ -727,8 +728,132 @@ static bool flash_write_check_gap(struct flash_bank *bank,
 }
 
 
-int flash_write_unlock_verify(struct target *target, struct image *image,
-	uint32_t *written, bool erase, bool unlock, bool write, bool verify)
+/* Unlock, erase, write and verify one run of a flash bank, as requested */
+static int flash_write_run(struct flash_bank *c, const uint8_t *buffer,
+	target_addr_t run_address, uint32_t run_size,
+	bool erase, bool unlock, bool write, bool verify)
+{
+	struct target *target = c->target;
+	int retval = ERROR_OK;
+
+	if (unlock)
+		retval = flash_unlock_address_range(target, run_address, run_size);
+	if (retval == ERROR_OK) {
+		if (erase) {
+			/* calculate and erase sectors */
+			retval = flash_erase_address_range(target,
+					true, run_address, run_size);
+		}
+	}
+
+	if (retval == ERROR_OK) {
+		if (write) {
+			/* write flash sectors */
+			retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
+		}
+	}
+
+	if (retval == ERROR_OK) {
+		if (verify) {
+			/* verify flash sectors */
+			retval = flash_driver_verify(c, buffer, run_address - c->base, run_size);
+		}
+	}
+
+	return retval;
+}
+
+/* Check if the part of the run in the given sector already holds the data */
+static bool flash_sector_unchanged(struct flash_bank *c, const uint8_t *buffer,
+	target_addr_t run_address, uint32_t run_size, unsigned int sector)
+{
+	target_addr_t start = MAX(run_address, c->base + c->sectors[sector].offset);
+	target_addr_t end = MIN(run_address + run_size,
+		c->base + c->sectors[sector].offset + c->sectors[sector].size);
+	uint32_t target_crc, image_crc;
+
+	if (start >= end)
+		return false;
+
+	if (target_checksum_memory(c->target, start, end - start, &target_crc) != ERROR_OK)
+		return false;
+
+	if (image_calculate_checksum(buffer + (start - run_address), end - start,
+			&image_crc) != ERROR_OK)
+		return false;
+
+	return target_crc == image_crc;
+}
+
+/*
+ * Write only the sectors of the run whose content differs from the buffer.
+ * Unchanged sectors are neither erased nor written.
+ */
+static int flash_write_run_smart(struct flash_bank *c, const uint8_t *buffer,
+	target_addr_t run_address, uint32_t run_size,
+	bool erase, bool unlock, bool verify, uint32_t *run_written)
+{
+	uint32_t offset = run_address - c->base;
+	unsigned int skipped = 0, total = 0;
+	target_addr_t span_start = 0;
+	bool in_span = false;
+	int retval = ERROR_OK;
+
+	*run_written = 0;
+
+	for (unsigned int sector = 0; sector < c->num_sectors; sector++) {
+		struct flash_sector *sect = &c->sectors[sector];
+
+		if (sect->offset + sect->size <= offset || sect->offset >= offset + run_size)
+			continue;
+
+		target_addr_t sector_start = MAX(run_address, c->base + sect->offset);
+		bool changed = !flash_sector_unchanged(c, buffer, run_address, run_size, sector);
+
+		total++;
+		if (changed) {
+			if (!in_span) {
+				span_start = sector_start;
+				in_span = true;
+			}
+			continue;
+		}
+
+		skipped++;
+		if (in_span) {
+			/* write the changed sectors seen so far */
+			retval = flash_write_run(c, buffer + (span_start - run_address),
+				span_start, sector_start - span_start, erase, unlock, true, verify);
+			if (retval != ERROR_OK)
+				return retval;
+			*run_written += sector_start - span_start;
+			in_span = false;
+		}
+	}
+
+	if (in_span) {
+		retval = flash_write_run(c, buffer + (span_start - run_address),
+			span_start, run_address + run_size - span_start, erase, unlock, true, verify);
+		if (retval != ERROR_OK)
+			return retval;
+		*run_written += run_address + run_size - span_start;
+	}
+
+	LOG_INFO("%u of %u sectors of flash bank %s unchanged, skipped",
+		skipped, total, c->name);
+
+	return retval;
+}
+
+void flash_free_runs(struct flash_run *runs, unsigned int num_runs)
+{
+	for (unsigned int i = 0; i < num_runs; i++)
+		free(runs[i].buffer);
+	free(runs);
+}
+
+int flash_image_runs(struct target *target, struct image *image, bool pad_sectors,
+	struct flash_run **runs, unsigned int *num_runs)
 {
 	int retval = ERROR_OK;
 
@@ -740,15 +865,8 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 	section = 0;
 	section_offset = 0;
 
-	if (written)
-		*written = 0;
-
-	if (erase) {
-		/* assume all sectors need erasing - stops any problems
-		 * when flash_write is called multiple times */
-
-		flash_set_dirty();
-	}
+	*runs = NULL;
+	*num_runs = 0;
 
 	/* allocate padding array */
 	padding = calloc(image->num_sections, sizeof(*padding));
@@ -874,7 +992,7 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 				run_size += pad_bytes;
 			}
 
-		} else if (unlock || erase) {
+		} else if (pad_sectors) {
 			/* If we're applying any sector automagic, then pad this
 			 * (maybe-combined) segment to the end of its last sector.
 			 */
@@ -949,46 +1067,252 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 			}
 		}
 
-		retval = ERROR_OK;
+		struct flash_run *new_runs = realloc(*runs, (*num_runs + 1) * sizeof(**runs));
+		if (!new_runs) {
+			LOG_ERROR("Out of memory for flash bank buffer");
+			free(buffer);
+			retval = ERROR_FAIL;
+			goto done;
+		}
+		*runs = new_runs;
+		(*runs)[*num_runs].bank = c;
+		(*runs)[*num_runs].address = run_address;
+		(*runs)[*num_runs].size = run_size;
+		(*runs)[*num_runs].buffer = buffer;
+		(*num_runs)++;
+	}
 
-		if (unlock)
-			retval = flash_unlock_address_range(target, run_address, run_size);
-		if (retval == ERROR_OK) {
-			if (erase) {
-				/* calculate and erase sectors */
-				retval = flash_erase_address_range(target,
-						true, run_address, run_size);
-			}
+done:
+	free(sections);
+	free(padding);
+
+	if (retval != ERROR_OK) {
+		flash_free_runs(*runs, *num_runs);
+		*runs = NULL;
+		*num_runs = 0;
+	}
+
+	return retval;
+}
+
+int flash_write_unlock_verify(struct target *target, struct image *image,
+	uint32_t *written, bool erase, bool unlock, bool write, bool verify,
+	bool smart)
+{
+	struct flash_run *runs;
+	unsigned int num_runs;
+	int retval;
+
+	if (written)
+		*written = 0;
+
+	if (erase) {
+		/* assume all sectors need erasing - stops any problems
+		 * when flash_write is called multiple times */
+
+		flash_set_dirty();
+	}
+
+	retval = flash_image_runs(target, image, unlock || erase, &runs, &num_runs);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (unsigned int i = 0; i < num_runs; i++) {
+		struct flash_run *run = &runs[i];
+		uint32_t run_written = run->size;
+
+		if (smart && write && run->bank->num_sectors > 0)
+			retval = flash_write_run_smart(run->bank, run->buffer, run->address, run->size,
+					erase, unlock, verify, &run_written);
+		else
+			retval = flash_write_run(run->bank, run->buffer, run->address, run->size,
+					erase, unlock, write, verify);
+
+		if (retval != ERROR_OK) {
+			/* abort operation */
+			break;
 		}
 
-		if (retval == ERROR_OK) {
-			if (write) {
-				/* write flash sectors */
-				retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
+		if (written)
+			*written += run_written;	/* add run size to total written counter */
+	}
+
+	flash_free_runs(runs, num_runs);
+
+	return retval;
+}
+
+enum flash_job_phase {
+	FLASH_JOB_START,
+	FLASH_JOB_ERASING,
+	FLASH_JOB_WRITE,
+	FLASH_JOB_DONE,
+};
+
+/* Progress of one job in flash_write_jobs() */
+struct flash_job_state {
+	struct flash_run *runs;
+	unsigned int num_runs;
+	unsigned int run;
+	enum flash_job_phase phase;
+	struct duration bench;
+};
+
+/* Erase callback starting the erase in the background where supported */
+static int flash_driver_erase_start(struct flash_bank *bank, unsigned int first,
+		unsigned int last)
+{
+	int retval;
+
+	if (!bank->driver->erase_start || !bank->driver->erase_poll)
+		return flash_driver_erase(bank, first, last);
+
+	retval = bank->driver->erase_start(bank, first, last);
+	if (retval != ERROR_OK)
+		LOG_ERROR("failed erasing sectors %u to %u", first, last);
+
+	return retval;
+}
+
+/* Advance a job by one step. Returns ERROR_FLASH_BUSY while waiting for an erase. */
+static int flash_job_step(struct flash_job *job, struct flash_job_state *state,
+	bool erase, bool unlock, bool verify)
+{
+	struct flash_run *run = &state->runs[state->run];
+	struct flash_bank *bank = run->bank;
+	int retval;
+
+	switch (state->phase) {
+	case FLASH_JOB_START:
+		if (unlock) {
+			retval = flash_unlock_address_range(job->target, run->address, run->size);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+		if (erase) {
+			retval = flash_iterate_address_range(job->target, "erase",
+					run->address, run->size, false, &flash_driver_erase_start);
+			if (retval != ERROR_OK)
+				return retval;
+			if (bank->driver->erase_start && bank->driver->erase_poll) {
+				state->phase = FLASH_JOB_ERASING;
+				return ERROR_OK;
 			}
 		}
+		state->phase = FLASH_JOB_WRITE;
+		return ERROR_OK;
 
-		if (retval == ERROR_OK) {
-			if (verify) {
-				/* verify flash sectors */
-				retval = flash_driver_verify(c, buffer, run_address - c->base, run_size);
+	case FLASH_JOB_ERASING:
+		retval = bank->driver->erase_poll(bank);
+		if (retval == ERROR_FLASH_BUSY)
+			return retval;
+		if (retval != ERROR_OK) {
+			LOG_ERROR("failed erasing flash at address " TARGET_ADDR_FMT, run->address);
+			return retval;
+		}
+		state->phase = FLASH_JOB_WRITE;
+		/* fallthrough */
+
+	case FLASH_JOB_WRITE:
+		retval = flash_driver_write(bank, run->buffer, run->address - bank->base, run->size);
+		if (retval == ERROR_OK && verify)
+			retval = flash_driver_verify(bank, run->buffer, run->address - bank->base, run->size);
+		if (retval != ERROR_OK)
+			return retval;
+
+		job->written += run->size;
+		state->run++;
+		state->phase = state->run < state->num_runs ? FLASH_JOB_START : FLASH_JOB_DONE;
+		return ERROR_OK;
+
+	case FLASH_JOB_DONE:
+		break;
+	}
+
+	return ERROR_OK;
+}
+
+int flash_write_jobs(struct flash_job *jobs, unsigned int num_jobs,
+	bool erase, bool unlock, bool verify)
+{
+	struct flash_job_state *states = calloc(num_jobs, sizeof(*states));
+	unsigned int active = 0;
+	int retval = ERROR_OK;
+
+	if (!states)
+		return ERROR_FAIL;
+
+	for (unsigned int i = 0; i < num_jobs; i++) {
+		for (unsigned int j = 0; j < i; j++) {
+			if (jobs[j].target == jobs[i].target) {
+				LOG_ERROR("more than one flash job for target %s",
+					target_name(jobs[i].target));
+				free(states);
+				return ERROR_FAIL;
 			}
 		}
+	}
 
-		free(buffer);
+	if (erase) {
+		/* assume all sectors need erasing, as flash_write_unlock_verify() */
+		flash_set_dirty();
+	}
 
-		if (retval != ERROR_OK) {
-			/* abort operation */
-			goto done;
+	/* Read all images up front, nothing has to wait for the host later */
+	for (unsigned int i = 0; i < num_jobs; i++) {
+		duration_start(&states[i].bench);
+		jobs[i].written = 0;
+		jobs[i].elapsed = 0;
+		jobs[i].retval = flash_image_runs(jobs[i].target, jobs[i].image,
+				erase || unlock, &states[i].runs, &states[i].num_runs);
+		if (jobs[i].retval == ERROR_OK && states[i].num_runs > 0)
+			active++;
+		else
+			states[i].phase = FLASH_JOB_DONE;
+	}
+
+	/*
+	 * Round robin over the jobs. Erases are started in the background where
+	 * the driver supports it, so the data of one target is streamed while
+	 * the others erase.
+	 */
+	while (active) {
+		bool progress = false;
+
+		for (unsigned int i = 0; i < num_jobs; i++) {
+			struct flash_job_state *state = &states[i];
+
+			if (state->phase == FLASH_JOB_DONE)
+				continue;
+
+			int step = flash_job_step(&jobs[i], state, erase, unlock, verify);
+			if (step == ERROR_FLASH_BUSY)
+				continue;
+
+			progress = true;
+			if (step != ERROR_OK) {
+				LOG_ERROR("flash programming of target %s failed", target_name(jobs[i].target));
+				jobs[i].retval = step;
+				state->phase = FLASH_JOB_DONE;
+			}
+
+			if (state->phase == FLASH_JOB_DONE) {
+				duration_measure(&state->bench);
+				jobs[i].elapsed = duration_elapsed(&state->bench);
+				active--;
+			}
 		}
 
-		if (written)
-			*written += run_size;	/* add run size to total written counter */
+		if (!progress)
+			alive_sleep(1);
 	}
 
-done:
-	free(sections);
-	free(padding);
+	for (unsigned int i = 0; i < num_jobs; i++) {
+		flash_free_runs(states[i].runs, states[i].num_runs);
+		if (retval == ERROR_OK)
+			retval = jobs[i].retval;
+	}
+	free(states);
 
 	return retval;
 }
@@ -996,7 +1320,7 @@ done:
 int flash_write(struct target *target, struct image *image,
 	uint32_t *written, bool erase)
 {
-	return flash_write_unlock_verify(target, image, written, erase, false, true, false);
+	return flash_write_unlock_verify(target, image, written, erase, false, true, false, false);
 }
 
 struct flash_sector *alloc_block_array(uint32_t offset, uint32_t size,
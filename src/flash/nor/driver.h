@@ -96,6 +96,30 @@ struct flash_driver {
 	int (*erase)(struct flash_bank *bank, unsigned int first,
 		unsigned int last);
 
+	/**
+	 * Start erasing sectors without waiting for completion, optional.
+	 * Used by the flash job scheduler to program other targets while
+	 * this one is erasing. The erase is completed by calls to
+	 * erase_poll(); no other operation is started on the bank before.
+	 *
+	 * @param bank The bank of flash to be erased.
+	 * @param first The number of the first sector to erase.
+	 * @param last The number of the last sector to erase.
+	 * @returns ERROR_OK if the erase was started; otherwise, an error code.
+	 */
+	int (*erase_start)(struct flash_bank *bank, unsigned int first,
+		unsigned int last);
+
+	/**
+	 * Continue an erase begun by erase_start(). Required if erase_start
+	 * is implemented.
+	 *
+	 * @param bank The bank of flash being erased.
+	 * @returns ERROR_FLASH_BUSY while the erase is in progress, ERROR_OK
+	 * once all sectors are erased; otherwise, an error code.
+	 */
+	int (*erase_poll)(struct flash_bank *bank);
+
 	/**
 	 * Bank/sector protection routine (target-specific).
 	 *
@@ -37,8 +37,39 @@ int flash_driver_read(struct flash_bank *bank,
 int flash_driver_verify(struct flash_bank *bank,
 		const uint8_t *buffer, uint32_t offset, uint32_t count);
 
-/* write (optional verify) an image to flash memory of the given target */
+/* One contiguous piece of an image within a single flash bank */
+struct flash_run {
+	struct flash_bank *bank;
+	target_addr_t address;
+	uint32_t size;
+	uint8_t *buffer;
+};
+
+/* Split an image into runs per flash bank, padded to whole sectors
+ * with pad_sectors set */
+int flash_image_runs(struct target *target, struct image *image, bool pad_sectors,
+		struct flash_run **runs, unsigned int *num_runs);
+void flash_free_runs(struct flash_run *runs, unsigned int num_runs);
+
+/* write (optional verify) an image to flash memory of the given target,
+ * with smart set skip sectors already holding the image data */
 int flash_write_unlock_verify(struct target *target, struct image *image,
-		uint32_t *written, bool erase, bool unlock, bool write, bool verify);
+		uint32_t *written, bool erase, bool unlock, bool write, bool verify,
+		bool smart);
+
+/* One image to be programmed into the flash of a target by flash_write_jobs() */
+struct flash_job {
+	struct target *target;
+	struct image *image;
+	/* results */
+	uint32_t written;
+	float elapsed;
+	int retval;
+};
+
+/* Program the images of several targets, interleaving erase and write of
+ * the different targets. Each target may have only one job. */
+int flash_write_jobs(struct flash_job *jobs, unsigned int num_jobs,
+		bool erase, bool unlock, bool verify);
 
 #endif /* OPENOCD_FLASH_NOR_IMP_H */
@@ -458,30 +458,25 @@ static int stm32x_write_block_async(struct flash_bank *bank, const uint8_t *buff
 	};
 
 	/* flash write code */
-	if (target_alloc_working_area(target, sizeof(stm32x_flash_write_code),
-			&write_algorithm) != ERROR_OK) {
+	retval = target_alloc_working_area_loader(target, stm32x_flash_write_code,
+			sizeof(stm32x_flash_write_code), &write_algorithm);
+	if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) {
 		LOG_WARNING("no working area available, can't do block memory writes");
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	retval = target_write_buffer(target, write_algorithm->address,
-			sizeof(stm32x_flash_write_code), stm32x_flash_write_code);
-	if (retval != ERROR_OK) {
-		target_free_working_area(target, write_algorithm);
+	} else if (retval != ERROR_OK) {
 		return retval;
 	}
 
 	/* memory buffer */
-	buffer_size = target_get_working_area_avail(target);
-	buffer_size = MIN(hwords_count * 2 + 8, MAX(buffer_size, 256));
+	buffer_size = hwords_count * 2 + 8;
 	/* Normally we allocate all available working area.
-	 * MIN shrinks buffer_size if the size of the written block is smaller.
-	 * MAX prevents using async algo if the available working area is smaller
-	 * than 256, the following allocation fails with
-	 * ERROR_TARGET_RESOURCE_NOT_AVAILABLE and slow flashing takes place.
+	 * The buffer is shrunk if the size of the written block is smaller.
+	 * If the available working area is smaller than 256, the allocation
+	 * fails with ERROR_TARGET_RESOURCE_NOT_AVAILABLE and slow flashing
+	 * takes place.
 	 */
 
-	retval = target_alloc_working_area(target, buffer_size, &source);
+	retval = target_alloc_working_area_largest(target, MIN(buffer_size, 256), buffer_size, &source);
 	/* Allocated size is always 32-bit word aligned */
 	if (retval != ERROR_OK) {
 		target_free_working_area(target, write_algorithm);
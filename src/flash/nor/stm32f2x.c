@@ -17,6 +17,7 @@
 
 #include "imp.h"
 #include <helper/binarybuffer.h>
+#include <helper/time_support.h>
 #include <target/algorithm.h>
 #include <target/cortex_m.h>
 
@@ -195,6 +196,10 @@ struct stm32x_flash_bank {
 	bool has_optcr2_pcrop;	/* F72x/73x */
 	unsigned int protection_bits; /* F413/423 */
 	uint32_t user_bank_size;
+	/* background erase, see stm32x_erase_start() */
+	unsigned int erase_next;
+	unsigned int erase_last;
+	int64_t erase_deadline;
 };
 
 static bool stm32x_is_otp(struct flash_bank *bank)
@@ -589,10 +594,24 @@ static int stm32x_protect_check(struct flash_bank *bank)
 	return ERROR_OK;
 }
 
+/* Start erasing a single sector, the caller waits for BSY to clear */
+static int stm32x_erase_sector_start(struct flash_bank *bank, unsigned int sector)
+{
+	struct stm32x_flash_bank *stm32x_info = bank->driver_priv;
+	unsigned int snb;
+
+	if (stm32x_info->has_large_mem && sector >= (bank->num_sectors / 2))
+		snb = (sector - (bank->num_sectors / 2)) | 0x10;
+	else
+		snb = sector;
+
+	return target_write_u32(bank->target,
+			stm32x_get_flash_reg(bank, STM32_FLASH_CR), FLASH_SER | FLASH_SNB(snb) | FLASH_STRT);
+}
+
 static int stm32x_erase(struct flash_bank *bank, unsigned int first,
 		unsigned int last)
 {
-	struct stm32x_flash_bank *stm32x_info = bank->driver_priv;
 	struct target *target = bank->target;
 
 	if (stm32x_is_otp(bank)) {
@@ -624,14 +643,7 @@ static int stm32x_erase(struct flash_bank *bank, unsigned int first,
 	 */
 
 	for (unsigned int i = first; i <= last; i++) {
-		unsigned int snb;
-		if (stm32x_info->has_large_mem && i >= (bank->num_sectors / 2))
-			snb = (i - (bank->num_sectors / 2)) | 0x10;
-		else
-			snb = i;
-
-		retval = target_write_u32(target,
-				stm32x_get_flash_reg(bank, STM32_FLASH_CR), FLASH_SER | FLASH_SNB(snb) | FLASH_STRT);
+		retval = stm32x_erase_sector_start(bank, i);
 		if (retval != ERROR_OK)
 			return retval;
 
@@ -647,6 +659,68 @@ static int stm32x_erase(struct flash_bank *bank, unsigned int first,
 	return ERROR_OK;
 }
 
+/* Same as stm32x_erase(), but leave waiting for BSY to stm32x_erase_poll() */
+static int stm32x_erase_start(struct flash_bank *bank, unsigned int first,
+		unsigned int last)
+{
+	struct stm32x_flash_bank *stm32x_info = bank->driver_priv;
+
+	if (stm32x_is_otp(bank)) {
+		LOG_ERROR("Cannot erase OTP memory");
+		return ERROR_FAIL;
+	}
+
+	assert((first <= last) && (last < bank->num_sectors));
+
+	if (bank->target->state != TARGET_HALTED) {
+		LOG_ERROR("Target not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	int retval = stm32x_unlock_reg(bank->target);
+	if (retval != ERROR_OK)
+		return retval;
+
+	stm32x_info->erase_next = first + 1;
+	stm32x_info->erase_last = last;
+	stm32x_info->erase_deadline = timeval_ms() + FLASH_ERASE_TIMEOUT;
+
+	return stm32x_erase_sector_start(bank, first);
+}
+
+static int stm32x_erase_poll(struct flash_bank *bank)
+{
+	struct stm32x_flash_bank *stm32x_info = bank->driver_priv;
+	uint32_t status;
+
+	int retval = stm32x_get_flash_status(bank, &status);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (status & FLASH_BSY) {
+		if (timeval_ms() > stm32x_info->erase_deadline) {
+			LOG_ERROR("timed out waiting for flash");
+			return ERROR_FAIL;
+		}
+		return ERROR_FLASH_BUSY;
+	}
+
+	/* not busy any more, only check and clear errors */
+	retval = stm32x_wait_status_busy(bank, 0);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (stm32x_info->erase_next <= stm32x_info->erase_last) {
+		stm32x_info->erase_deadline = timeval_ms() + FLASH_ERASE_TIMEOUT;
+		retval = stm32x_erase_sector_start(bank, stm32x_info->erase_next++);
+		if (retval != ERROR_OK)
+			return retval;
+		return ERROR_FLASH_BUSY;
+	}
+
+	return target_write_u32(bank->target, stm32x_get_flash_reg(bank, STM32_FLASH_CR), FLASH_LOCK);
+}
+
 static int stm32x_protect(struct flash_bank *bank, int set, unsigned int first,
 		unsigned int last)
 {
@@ -709,31 +783,23 @@ static int stm32x_write_block(struct flash_bank *bank, const uint8_t *buffer,
 		return ERROR_FAIL;
 	}
 
-	if (target_alloc_working_area(target, sizeof(stm32x_flash_write_code),
-			&write_algorithm) != ERROR_OK) {
+	retval = target_alloc_working_area_loader(target, stm32x_flash_write_code,
+			sizeof(stm32x_flash_write_code), &write_algorithm);
+	if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) {
 		LOG_WARNING("no working area available, can't do block memory writes");
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	retval = target_write_buffer(target, write_algorithm->address,
-			sizeof(stm32x_flash_write_code),
-			stm32x_flash_write_code);
-	if (retval != ERROR_OK) {
-		target_free_working_area(target, write_algorithm);
+	} else if (retval != ERROR_OK) {
 		return retval;
 	}
 
 	/* memory buffer */
-	while (target_alloc_working_area_try(target, buffer_size, &source) != ERROR_OK) {
-		buffer_size /= 2;
-		if (buffer_size <= 256) {
-			/* we already allocated the writing code, but failed to get a
-			 * buffer, free the algorithm */
-			target_free_working_area(target, write_algorithm);
-
-			LOG_WARNING("no large enough working area available, can't do block memory writes");
-			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-		}
+	if (target_alloc_working_area_largest(target, 256 + 4, buffer_size, &source) != ERROR_OK) {
+		/* we already allocated the writing code, but failed to get a
+		 * buffer, free the algorithm */
+		target_free_working_area(target, write_algorithm);
+
+		LOG_WARNING("no large enough working area available, can't do block memory writes");
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	}
 
 	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
@@ -1794,6 +1860,8 @@ const struct flash_driver stm32f2x_flash = {
 	.commands = stm32f2x_command_handlers,
 	.flash_bank_command = stm32x_flash_bank_command,
 	.erase = stm32x_erase,
+	.erase_start = stm32x_erase_start,
+	.erase_poll = stm32x_erase_poll,
 	.protect = stm32x_protect,
 	.write = stm32x_write,
 	.read = default_flash_read,
@@ -1500,40 +1500,31 @@ static int stm32l4_write_block(struct flash_bank *bank, const uint8_t *buffer,
 #include "../../../contrib/loaders/flash/stm32/stm32l4x.inc"
 	};
 
-	if (target_alloc_working_area(target, sizeof(stm32l4_flash_write_code),
-			&write_algorithm) != ERROR_OK) {
+	retval = target_alloc_working_area_loader(target, stm32l4_flash_write_code,
+			sizeof(stm32l4_flash_write_code), &write_algorithm);
+	if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) {
 		LOG_WARNING("no working area available, can't do block memory writes");
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	retval = target_write_buffer(target, write_algorithm->address,
-			sizeof(stm32l4_flash_write_code),
-			stm32l4_flash_write_code);
-	if (retval != ERROR_OK) {
-		target_free_working_area(target, write_algorithm);
+	} else if (retval != ERROR_OK) {
 		return retval;
 	}
 
 	/* data_width should be multiple of double-word */
 	assert(stm32l4_info->data_width % 8 == 0);
 	const size_t extra_size = sizeof(struct stm32l4_work_area);
-	uint32_t buffer_size = target_get_working_area_avail(target) - extra_size;
-	/* buffer_size should be multiple of stm32l4_info->data_width */
-	buffer_size &= ~(stm32l4_info->data_width - 1);
 
-	if (buffer_size < 256) {
+	/* probably won't benefit from more than 16k ... */
+	if (target_alloc_working_area_largest(target, 256 + extra_size, 16384 + extra_size,
+			&source) != ERROR_OK) {
 		LOG_WARNING("large enough working area not available, can't do block memory writes");
 		target_free_working_area(target, write_algorithm);
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	} else if (buffer_size > 16384) {
-		/* probably won't benefit from more than 16k ... */
-		buffer_size = 16384;
 	}
 
-	if (target_alloc_working_area_try(target, buffer_size + extra_size, &source) != ERROR_OK) {
-		LOG_ERROR("allocating working area failed");
-		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
+	/* buffer_size should be multiple of stm32l4_info->data_width */
+	const uint32_t buffer_size = ALIGN_DOWN(source->size - extra_size, stm32l4_info->data_width);
+	const uint32_t fifo_size = extra_size - offsetof(struct stm32l4_work_area, fifo) + buffer_size;
+	const target_addr_t fifo_end = source->address + extra_size + buffer_size;
 
 	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
 	armv7m_info.core_mode = ARM_MODE_THREAD;
@@ -1545,7 +1536,7 @@ static int stm32l4_write_block(struct flash_bank *bank, const uint8_t *buffer,
 	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);	/* count (of stm32l4_info->data_width) */
 
 	buf_set_u32(reg_params[0].value, 0, 32, source->address);
-	buf_set_u32(reg_params[1].value, 0, 32, source->address + source->size);
+	buf_set_u32(reg_params[1].value, 0, 32, fifo_end);
 	buf_set_u32(reg_params[2].value, 0, 32, address);
 	buf_set_u32(reg_params[3].value, 0, 32, count);
 
@@ -1574,7 +1565,7 @@ static int stm32l4_write_block(struct flash_bank *bank, const uint8_t *buffer,
 			0, NULL,
 			ARRAY_SIZE(reg_params), reg_params,
 			source->address + offsetof(struct stm32l4_work_area, fifo),
-			source->size - offsetof(struct stm32l4_work_area, fifo),
+			fifo_size,
 			write_algorithm->address, 0,
 			&armv7m_info);
 
@@ -401,6 +401,7 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	/* flash auto-erase is disabled by default*/
 	int auto_erase = 0;
 	bool auto_unlock = false;
+	bool smart = false;
 
 	while (CMD_ARGC) {
 		if (strcmp(CMD_ARGV[0], "erase") == 0) {
@@ -413,6 +414,11 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 			CMD_ARGV++;
 			CMD_ARGC--;
 			command_print(CMD, "auto unlock enabled");
+		} else if (strcmp(CMD_ARGV[0], "smart") == 0) {
+			smart = true;
+			CMD_ARGV++;
+			CMD_ARGC--;
+			command_print(CMD, "skipping unchanged sectors");
 		} else
 			break;
 	}
@@ -443,7 +449,7 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 		return retval;
 
 	retval = flash_write_unlock_verify(target, &image, &written, auto_erase,
-		auto_unlock, true, false);
+		auto_unlock, true, false, smart);
 	if (retval != ERROR_OK) {
 		image_close(&image);
 		return retval;
@@ -460,6 +466,141 @@ COMMAND_HANDLER(handle_flash_write_image_command)
 	return retval;
 }
 
+/* Images queued by "flash queue_image" for "flash write_queued" */
+static struct flash_job *flash_queued_jobs;
+static unsigned int flash_num_queued_jobs;
+
+static void flash_clear_queued_jobs(void)
+{
+	for (unsigned int i = 0; i < flash_num_queued_jobs; i++) {
+		image_close(flash_queued_jobs[i].image);
+		free(flash_queued_jobs[i].image);
+	}
+	free(flash_queued_jobs);
+	flash_queued_jobs = NULL;
+	flash_num_queued_jobs = 0;
+}
+
+COMMAND_HANDLER(handle_flash_queue_image_command)
+{
+	if (CMD_ARGC < 2 || CMD_ARGC > 4)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target *target = get_target(CMD_ARGV[0]);
+	if (!target) {
+		command_print(CMD, "Target: %s is unknown", CMD_ARGV[0]);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	for (unsigned int i = 0; i < flash_num_queued_jobs; i++) {
+		if (flash_queued_jobs[i].target == target) {
+			command_print(CMD, "an image is already queued for target %s",
+				target_name(target));
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+	}
+
+	struct image *image = calloc(1, sizeof(*image));
+	if (!image)
+		return ERROR_FAIL;
+
+	if (CMD_ARGC >= 3) {
+		image->base_address_set = true;
+		COMMAND_PARSE_NUMBER(llong, CMD_ARGV[2], image->base_address);
+	}
+
+	int retval = image_open(image, CMD_ARGV[1], (CMD_ARGC == 4) ? CMD_ARGV[3] : NULL);
+	if (retval != ERROR_OK) {
+		free(image);
+		return retval;
+	}
+
+	struct flash_job *jobs = realloc(flash_queued_jobs,
+			(flash_num_queued_jobs + 1) * sizeof(*jobs));
+	if (!jobs) {
+		image_close(image);
+		free(image);
+		return ERROR_FAIL;
+	}
+
+	flash_queued_jobs = jobs;
+	jobs[flash_num_queued_jobs] = (struct flash_job) {
+		.target = target,
+		.image = image,
+	};
+	flash_num_queued_jobs++;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_flash_write_queued_command)
+{
+	bool erase = false;
+	bool unlock = false;
+	bool verify = false;
+
+	for (unsigned int i = 0; i < CMD_ARGC; i++) {
+		if (strcmp(CMD_ARGV[i], "erase") == 0)
+			erase = true;
+		else if (strcmp(CMD_ARGV[i], "unlock") == 0)
+			unlock = true;
+		else if (strcmp(CMD_ARGV[i], "verify") == 0)
+			verify = true;
+		else
+			return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	if (!flash_num_queued_jobs) {
+		command_print(CMD, "no images queued");
+		return ERROR_FAIL;
+	}
+
+	struct duration bench;
+	duration_start(&bench);
+
+	int retval = flash_write_jobs(flash_queued_jobs, flash_num_queued_jobs,
+			erase, unlock, verify);
+
+	duration_measure(&bench);
+
+	uint32_t total = 0;
+	float serial = 0;
+	for (unsigned int i = 0; i < flash_num_queued_jobs; i++) {
+		struct flash_job *job = &flash_queued_jobs[i];
+
+		if (job->retval != ERROR_OK) {
+			command_print(CMD, "%s: failed after %" PRIu32 " bytes",
+				target_name(job->target), job->written);
+			continue;
+		}
+
+		command_print(CMD, "%s: wrote %" PRIu32 " bytes in %fs (%0.3f KiB/s)",
+			target_name(job->target), job->written, job->elapsed,
+			job->elapsed > 0 ? job->written / 1024.0 / job->elapsed : 0);
+		total += job->written;
+		serial += job->elapsed;
+	}
+
+	command_print(CMD, "wrote %" PRIu32 " bytes to %u targets in %fs "
+		"(%0.3f KiB/s), sum of per target times %fs",
+		total, flash_num_queued_jobs, duration_elapsed(&bench),
+		duration_kbps(&bench, total), serial);
+
+	flash_clear_queued_jobs();
+
+	return retval;
+}
+
+COMMAND_HANDLER(handle_flash_clear_queue_command)
+{
+	if (CMD_ARGC)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	flash_clear_queued_jobs();
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_flash_verify_image_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -495,7 +636,7 @@ COMMAND_HANDLER(handle_flash_verify_image_command)
 		return retval;
 
 	retval = flash_write_unlock_verify(target, &image, &verified, false,
-		false, false, true);
+		false, false, true, false);
 	if (retval != ERROR_OK) {
 		image_close(&image);
 		return retval;
@@ -1178,13 +1319,36 @@ static const struct command_registration flash_exec_command_handlers[] = {
 		.help = "Write binary data from file to flash bank. Allow optional "
 			"offset from beginning of the bank (defaults to zero).",
 	},
+	{
+		.name = "queue_image",
+		.handler = handle_flash_queue_image_command,
+		.mode = COMMAND_EXEC,
+		.usage = "target_name filename [offset [file_type]]",
+		.help = "Queue an image to be written to the flash of a target "
+			"by 'flash write_queued'.",
+	},
+	{
+		.name = "write_queued",
+		.handler = handle_flash_write_queued_command,
+		.mode = COMMAND_EXEC,
+		.usage = "[erase] [unlock] [verify]",
+		.help = "Write all queued images, interleaving the targets.",
+	},
+	{
+		.name = "clear_queue",
+		.handler = handle_flash_clear_queue_command,
+		.mode = COMMAND_EXEC,
+		.usage = "",
+		.help = "Discard all queued images.",
+	},
 	{
 		.name = "write_image",
 		.handler = handle_flash_write_image_command,
 		.mode = COMMAND_EXEC,
-		.usage = "[erase] [unlock] filename [offset [file_type]]",
+		.usage = "[erase] [unlock] [smart] filename [offset [file_type]]",
 		.help = "Write an image to flash.  Optionally first unprotect "
-			"and/or erase the region to be used. Allow optional "
+			"and/or erase the region to be used, or skip sectors "
+			"already holding the data. Allow optional "
 			"offset from beginning of bank (defaults to zero)",
 	},
 	{
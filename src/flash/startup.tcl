@@ -5,7 +5,7 @@
 #
 # program utility proc
 # usage: program filename
-# optional args: preverify, verify, reset, exit and address
+# optional args: preverify, smart, verify, reset, exit and address
 #
 
 lappend _telnet_autocomplete_skip program_error
@@ -21,10 +21,13 @@ proc program_error {description exit} {
 proc program {filename args} {
 	set exit 0
 	set needsflash 1
+	set smart ""
 
 	foreach arg $args {
 		if {[string equal $arg "preverify"]} {
 			set preverify 1
+		} elseif {[string equal $arg "smart"]} {
+			set smart "smart"
 		} elseif {[string equal $arg "verify"]} {
 			set verify 1
 		} elseif {[string equal $arg "reset"]} {
@@ -68,7 +71,7 @@ proc program {filename args} {
 	if {$needsflash == 1} {
 		echo "** Programming Started **"
 
-		if {[catch {eval flash write_image erase $flash_args}] == 0} {
+		if {[catch {eval flash write_image erase $smart $flash_args}] == 0} {
 			echo "** Programming Finished **"
 			if {[info exists verify]} {
 				# verify phase
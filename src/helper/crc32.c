@@ -13,9 +13,20 @@
 #endif
 
 #include "crc32.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define CRC32_HAVE_PCLMUL
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32_HAVE_ARMV8
+#endif
+
 static uint32_t crc_le_step(uint32_t poly, uint32_t crc, uint32_t data_in,
 		unsigned int data_bits)
 {
@@ -30,21 +41,240 @@ static uint32_t crc_le_step(uint32_t poly, uint32_t crc, uint32_t data_in,
 	return crc;
 }
 
+/* Slice-by-8 tables, entry [k][i] is the CRC of byte i followed by k zero bytes */
+static uint32_t crc32_le_table[8][256];
+static uint32_t crc32_be_table[8][256];
+
+static void crc32_init_tables(void)
+{
+	static bool done;
+
+	if (done)
+		return;
+
+	for (unsigned int i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for (unsigned int j = 0; j < 8; j++)
+			c = (c & 1) ? (c >> 1) ^ CRC32_POLY_LE : (c >> 1);
+		crc32_le_table[0][i] = c;
+
+		c = i << 24;
+		for (unsigned int j = 0; j < 8; j++)
+			c = (c & 0x80000000) ? (c << 1) ^ CRC32_POLY_BE : (c << 1);
+		crc32_be_table[0][i] = c;
+	}
+
+	for (unsigned int k = 1; k < 8; k++) {
+		for (unsigned int i = 0; i < 256; i++) {
+			uint32_t c = crc32_le_table[k - 1][i];
+			crc32_le_table[k][i] = (c >> 8) ^ crc32_le_table[0][c & 0xff];
+			c = crc32_be_table[k - 1][i];
+			crc32_be_table[k][i] = (c << 8) ^ crc32_be_table[0][c >> 24];
+		}
+	}
+
+	done = true;
+}
+
+static uint32_t crc32_le_slice8(uint32_t crc, const uint8_t *data, size_t data_len)
+{
+	const uint32_t (*t)[256] = crc32_le_table;
+
+	while (data_len >= 8) {
+		uint32_t lo = crc ^ (data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24);
+		uint32_t hi = data[4] | data[5] << 8 | data[6] << 16 | (uint32_t)data[7] << 24;
+		crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^
+			t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+			t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+			t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+		data += 8;
+		data_len -= 8;
+	}
+
+	while (data_len--)
+		crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+
+	return crc;
+}
+
+static uint32_t crc32_be_slice8(uint32_t crc, const uint8_t *data, size_t data_len)
+{
+	const uint32_t (*t)[256] = crc32_be_table;
+
+	while (data_len >= 8) {
+		uint32_t hi = crc ^ ((uint32_t)data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3]);
+		uint32_t lo = (uint32_t)data[4] << 24 | data[5] << 16 | data[6] << 8 | data[7];
+		crc = t[7][hi >> 24] ^ t[6][(hi >> 16) & 0xff] ^
+			t[5][(hi >> 8) & 0xff] ^ t[4][hi & 0xff] ^
+			t[3][lo >> 24] ^ t[2][(lo >> 16) & 0xff] ^
+			t[1][(lo >> 8) & 0xff] ^ t[0][lo & 0xff];
+		data += 8;
+		data_len -= 8;
+	}
+
+	while (data_len--)
+		crc = (crc << 8) ^ t[0][(crc >> 24) ^ *data++];
+
+	return crc;
+}
+
+#ifdef CRC32_HAVE_PCLMUL
+/*
+ * Folding with carry-less multiplication, see Intel's "Fast CRC Computation
+ * for Generic Polynomials Using PCLMULQDQ Instruction". The constants are
+ * for CRC32_POLY_LE. Needs data_len >= 64 and a multiple of 16.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_le_pclmul(uint32_t crc, const uint8_t *data, size_t data_len)
+{
+	const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+	const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+	const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+	const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128((const __m128i *)(data + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(data + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(data + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(data + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	data += 64;
+	data_len -= 64;
+
+	/* Fold four lanes by 64 bytes at a time */
+	while (data_len >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(data + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(data + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(data + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(data + 0x30)));
+		data += 64;
+		data_len -= 64;
+	}
+
+	/* Fold the four lanes into one */
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	/* Fold remaining blocks of 16 bytes */
+	while (data_len >= 16) {
+		x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)data)), x5);
+		data += 16;
+		data_len -= 16;
+	}
+
+	/* Fold 128 bits to 64 bits */
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask32);
+	x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 bits */
+	x2 = _mm_and_si128(x1, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return _mm_extract_epi32(x1, 1);
+}
+
+static bool crc32_pclmul_supported(void)
+{
+	static int supported = -1;
+
+	if (supported < 0) {
+		__builtin_cpu_init();
+		supported = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+	}
+
+	return supported;
+}
+#endif
+
+#ifdef CRC32_HAVE_ARMV8
+static uint32_t crc32_le_armv8(uint32_t crc, const uint8_t *data, size_t data_len)
+{
+	while (data_len >= 8) {
+		uint64_t v = (uint64_t)data[0] | (uint64_t)data[1] << 8 |
+			(uint64_t)data[2] << 16 | (uint64_t)data[3] << 24 |
+			(uint64_t)data[4] << 32 | (uint64_t)data[5] << 40 |
+			(uint64_t)data[6] << 48 | (uint64_t)data[7] << 56;
+		crc = __crc32d(crc, v);
+		data += 8;
+		data_len -= 8;
+	}
+
+	while (data_len--)
+		crc = __crc32b(crc, *data++);
+
+	return crc;
+}
+#endif
+
 uint32_t crc32_le(uint32_t poly, uint32_t seed, const void *_data,
 		size_t data_len)
 {
-	if (((uintptr_t)_data & 0x3) || (data_len & 0x3)) {
-		/* data is unaligned, processing data one byte at a time */
-		const uint8_t *data = _data;
+	const uint8_t *data = _data;
+
+	if (poly != CRC32_POLY_LE) {
+		/* uncommon polynomial, process data one byte at a time */
 		for (size_t i = 0; i < data_len; i++)
 			seed = crc_le_step(poly, seed, data[i], 8);
-	} else {
-		/* data is aligned, processing 32 bit at a time */
-		data_len >>= 2;
-		const uint32_t *data = _data;
-		for (size_t i = 0; i < data_len; i++)
-			seed = crc_le_step(poly, seed, data[i], 32);
+		return seed;
+	}
+
+#ifdef CRC32_HAVE_ARMV8
+	return crc32_le_armv8(seed, data, data_len);
+#else
+#ifdef CRC32_HAVE_PCLMUL
+	if (data_len >= 64 && crc32_pclmul_supported()) {
+		size_t len = data_len & ~(size_t)15;
+		seed = crc32_le_pclmul(seed, data, len);
+		data += len;
+		data_len -= len;
 	}
+#endif
 
-	return seed;
+	crc32_init_tables();
+	return crc32_le_slice8(seed, data, data_len);
+#endif
+}
+
+uint32_t crc32_be(uint32_t seed, const void *data, size_t data_len)
+{
+	crc32_init_tables();
+	return crc32_be_slice8(seed, data, data_len);
+}
+
+const char *crc32_le_engine(void)
+{
+#ifdef CRC32_HAVE_ARMV8
+	return "armv8-crc";
+#else
+#ifdef CRC32_HAVE_PCLMUL
+	if (crc32_pclmul_supported())
+		return "pclmul";
+#endif
+	return "slice-by-8";
+#endif
 }
@@ -13,6 +13,9 @@
 
 /** @file
  * A generic CRC32 implementation
+ *
+ * Table driven (slice-by-8), using carry-less multiplication or the ARMv8
+ * CRC32 instructions for CRC32_POLY_LE when the host supports them.
  */
 
 /**
@@ -20,6 +23,11 @@
  */
 #define CRC32_POLY_LE	0xedb88320
 
+/**
+ * CRC32 polynomial in MSB first notation, as used by GDB's qCRC packet
+ */
+#define CRC32_POLY_BE	0x04c11db7
+
 /**
  * Calculate the CRC32 value of the given data
  * @param	poly		The polynomial of the CRC
@@ -34,4 +42,19 @@
 uint32_t crc32_le(uint32_t poly, uint32_t seed, const void *data,
 		size_t data_len);
 
+/**
+ * Calculate the MSB first CRC32 value of the given data with polynomial
+ * CRC32_POLY_BE, as GDB does for its "compare-sections" command
+ * @param	seed		The seed to use (mostly `0xffffffff`)
+ * @param	data		The data to calculate the CRC32 of
+ * @param	data_len	The length of the data in @p data in bytes
+ * @return	The CRC value of the first @p data_len bytes at @p data
+ */
+uint32_t crc32_be(uint32_t seed, const void *data, size_t data_len);
+
+/**
+ * Name of the implementation crc32_le() uses for CRC32_POLY_LE on this host
+ */
+const char *crc32_le_engine(void);
+
 #endif /* OPENOCD_HELPER_CRC32_H */
@@ -20,14 +20,38 @@
 #include "fileio.h"
 #include "replacements.h"
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 struct fileio {
 	char *url;
 	size_t size;
 	enum fileio_type type;
 	enum fileio_access access;
 	FILE *file;
+	void *map;		/* contents from fileio_map(), if any */
+	size_t map_size;
+	bool map_is_mmap;
 };
 
+static void fileio_unmap(struct fileio *fileio)
+{
+	if (!fileio->map)
+		return;
+
+#ifdef HAVE_SYS_MMAN_H
+	if (fileio->map_is_mmap) {
+		munmap(fileio->map, fileio->map_size);
+		fileio->map = NULL;
+		return;
+	}
+#endif
+
+	free(fileio->map);
+	fileio->map = NULL;
+}
+
 static inline int fileio_close_local(struct fileio *fileio)
 {
 	int retval = fclose(fileio->file);
@@ -117,6 +141,8 @@ int fileio_open(struct fileio **fileio, const char *url,
 	tmp->type = type;
 	tmp->access = access_type;
 	tmp->url = strdup(url);
+	tmp->map = NULL;
+	tmp->map_is_mmap = false;
 
 	retval = fileio_open_local(tmp);
 
@@ -135,6 +161,8 @@ int fileio_close(struct fileio *fileio)
 {
 	int retval;
 
+	fileio_unmap(fileio);
+
 	retval = fileio_close_local(fileio);
 
 	free(fileio->url);
@@ -179,6 +207,65 @@ int fileio_read(struct fileio *fileio, size_t size, void *buffer,
 	return fileio_local_read(fileio, size, buffer, size_read);
 }
 
+int fileio_map(struct fileio *fileio, const void **data, size_t *size)
+{
+	static const uint8_t empty;
+
+	if (fileio->map) {
+		*data = fileio->map;
+		*size = fileio->map_size;
+		return ERROR_OK;
+	}
+
+	if (fileio->access != FILEIO_READ) {
+		LOG_ERROR("BUG: %s not opened read only, can't map it", fileio->url);
+		return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+	}
+
+	if (fileio->size == 0) {
+		*data = &empty;
+		*size = 0;
+		return ERROR_OK;
+	}
+
+#ifdef HAVE_SYS_MMAN_H
+	void *map = mmap(NULL, fileio->size, PROT_READ, MAP_PRIVATE, fileno(fileio->file), 0);
+	if (map != MAP_FAILED) {
+		fileio->map = map;
+		fileio->map_size = fileio->size;
+		fileio->map_is_mmap = true;
+		*data = map;
+		*size = fileio->map_size;
+		return ERROR_OK;
+	}
+	LOG_DEBUG("can't mmap %s: %s, reading it instead", fileio->url, strerror(errno));
+#endif
+
+	/* no mmap() on this host. Text files may shrink, CRLF is translated. */
+	uint8_t *buffer = malloc(fileio->size);
+	if (!buffer) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	size_t size_read = 0;
+	int retval = fileio_seek(fileio, 0);
+	if (retval == ERROR_OK)
+		retval = fileio_local_read(fileio, fileio->size, buffer, &size_read);
+	if (retval != ERROR_OK) {
+		free(buffer);
+		return retval;
+	}
+
+	fileio->map = buffer;
+	fileio->map_size = size_read;
+	fileio->map_is_mmap = false;
+	*data = buffer;
+	*size = size_read;
+
+	return ERROR_OK;
+}
+
 int fileio_read_u32(struct fileio *fileio, uint32_t *data)
 {
 	int retval;
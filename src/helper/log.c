@@ -24,6 +24,10 @@
 
 #include <stdarg.h>
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #ifdef _DEBUG_FREE_SPACE_
 #ifdef HAVE_MALLOC_H
 #include <malloc.h>
@@ -64,6 +68,126 @@ static const char * const log_strings[6] = {
 
 static int count;
 
+#ifdef HAVE_PTHREAD
+/*
+ * The adapter I/O thread may log while the main thread keeps the clients
+ * alive. Serialize the output, the log callbacks and keep_alive(). The
+ * mutex is recursive, the callbacks and keep_alive() may log themselves.
+ */
+static pthread_mutex_t log_mutex;
+static bool log_mutex_initialized;
+
+static void log_lock(void)
+{
+	if (log_mutex_initialized)
+		pthread_mutex_lock(&log_mutex);
+}
+
+static void log_unlock(void)
+{
+	if (log_mutex_initialized)
+		pthread_mutex_unlock(&log_mutex);
+}
+#else
+static inline void log_lock(void)
+{
+}
+
+static inline void log_unlock(void)
+{
+}
+#endif
+
+/*
+ * Debug messages are collected in a buffer and written out in blocks, when
+ * the buffer is full, with the next message of a higher level or when the
+ * server loop is going to sleep. Other messages are written immediately.
+ */
+#define LOG_BUFFER_SIZE_DEFAULT	(64 * 1024)
+
+static char *log_buffer;
+static size_t log_buffer_size = LOG_BUFFER_SIZE_DEFAULT;
+static size_t log_buffer_length;
+
+/* Cost of logging per level, from LOG_LVL_OUTPUT to LOG_LVL_DEBUG_IO */
+struct log_level_stats {
+	uint64_t messages;
+	uint64_t bytes;
+	uint64_t time_us;
+};
+
+static struct log_level_stats log_stats[LOG_LVL_DEBUG_IO - LOG_LVL_OUTPUT + 1];
+static unsigned int log_flush_count;
+
+static void log_account(enum log_levels level, size_t length, int64_t start_us)
+{
+	struct log_level_stats *stats;
+
+	if (level < LOG_LVL_OUTPUT || level > LOG_LVL_DEBUG_IO)
+		return;
+
+	stats = &log_stats[level - LOG_LVL_OUTPUT];
+	stats->messages++;
+	stats->bytes += length;
+	stats->time_us += timeval_us() - start_us;
+}
+
+/* Write out the buffered messages without flushing the stream */
+static void log_write_buffer(void)
+{
+	if (log_buffer_length && log_output) {
+		fwrite(log_buffer, 1, log_buffer_length, log_output);
+		log_flush_count++;
+	}
+
+	log_buffer_length = 0;
+}
+
+void log_flush(void)
+{
+	log_write_buffer();
+
+	if (log_output)
+		fflush(log_output);
+}
+
+static __attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 1, 2)))
+void log_write(const char *format, ...)
+{
+	va_list ap;
+
+	if (!log_buffer && log_buffer_size)
+		log_buffer = malloc(log_buffer_size);
+
+	va_start(ap, format);
+
+	for (unsigned int i = 0; log_buffer && i < 2; i++) {
+		size_t space = log_buffer_size - log_buffer_length;
+		va_list ap_copy;
+		int length;
+
+		va_copy(ap_copy, ap);
+		length = vsnprintf(log_buffer + log_buffer_length, space, format, ap_copy);
+		va_end(ap_copy);
+
+		if (length < 0)
+			break;
+
+		if ((size_t)length < space) {
+			log_buffer_length += length;
+			va_end(ap);
+			return;
+		}
+
+		/* Doesn't fit, retry with an empty buffer */
+		log_write_buffer();
+	}
+
+	/* No buffer or message larger than the buffer */
+	vfprintf(log_output, format, ap);
+	va_end(ap);
+}
+
 /* forward the log to the listeners */
 static void log_forward(const char *file, unsigned int line, const char *function, const char *string)
 {
@@ -104,8 +228,8 @@ static void log_puts(enum log_levels level,
 
 	if (level == LOG_LVL_OUTPUT) {
 		/* do not prepend any headers, just print out what we were given and return */
-		fputs(string, log_output);
-		fflush(log_output);
+		log_write("%s", string);
+		log_flush();
 		return;
 	}
 
@@ -119,7 +243,7 @@ static void log_puts(enum log_levels level,
 #ifdef _DEBUG_FREE_SPACE_
 		struct mallinfo2 info = mallinfo2();
 #endif
-		fprintf(log_output, "%s%d %" PRId64 " %s:%d %s()"
+		log_write("%s%d %" PRId64 " %s:%d %s()"
 #ifdef _DEBUG_FREE_SPACE_
 			FORDBLKS_FORMAT
 #endif
@@ -131,11 +255,12 @@ static void log_puts(enum log_levels level,
 	} else {
 		/* if we are using gdb through pipes then we do not want any output
 		 * to the pipe otherwise we get repeated strings */
-		fprintf(log_output, "%s%s",
+		log_write("%s%s",
 			(level > LOG_LVL_USER) ? log_strings[level + 1] : "", string);
 	}
 
-	fflush(log_output);
+	if (level <= LOG_LVL_INFO || !log_buffer_size)
+		log_flush();
 
 	/* Never forward LOG_LVL_DEBUG, too verbose and they can be found in the log if need be */
 	if (level <= LOG_LVL_INFO)
@@ -151,16 +276,21 @@ void log_printf(enum log_levels level,
 {
 	char *string;
 	va_list ap;
+	int64_t start_us;
 
 	count++;
 	if (level > debug_level)
 		return;
 
+	start_us = timeval_us();
 	va_start(ap, format);
 
 	string = alloc_vprintf(format, ap);
 	if (string) {
+		log_lock();
 		log_puts(level, file, line, function, string);
+		log_account(level, strlen(string), start_us);
+		log_unlock();
 		free(string);
 	}
 
@@ -171,12 +301,14 @@ void log_vprintf_lf(enum log_levels level, const char *file, unsigned int line,
 		const char *function, const char *format, va_list args)
 {
 	char *tmp;
+	int64_t start_us;
 
 	count++;
 
 	if (level > debug_level)
 		return;
 
+	start_us = timeval_us();
 	tmp = alloc_vprintf(format, args);
 
 	if (!tmp)
@@ -187,7 +319,10 @@ void log_vprintf_lf(enum log_levels level, const char *file, unsigned int line,
 	 * character longer.
 	 */
 	strcat(tmp, "\n");
+	log_lock();
 	log_puts(level, file, line, function, tmp);
+	log_account(level, strlen(tmp), start_us);
+	log_unlock();
 	free(tmp);
 }
 
@@ -205,6 +340,75 @@ void log_printf_lf(enum log_levels level,
 	va_end(ap);
 }
 
+void log_printf_hex(enum log_levels level, const char *file, unsigned int line,
+		const char *function, const void *buf, unsigned int bits,
+		const char *format, ...)
+{
+	/* Reused between calls, hex dumps are often large and frequent */
+	static char *string;
+	static size_t string_size;
+	static const char hex_digits[] = "0123456789abcdef";
+	const uint8_t *data = buf;
+	unsigned int num_bytes = DIV_ROUND_UP(bits, 8);
+	size_t size, length;
+	int64_t start_us;
+	va_list ap;
+	int ret;
+
+	count++;
+
+	if (level > debug_level)
+		return;
+
+	start_us = timeval_us();
+
+	/* The string buffer is shared */
+	log_lock();
+
+	va_start(ap, format);
+	ret = vsnprintf(NULL, 0, format, ap);
+	va_end(ap);
+
+	if (ret < 0)
+		goto unlock;
+
+	size = ret + 2 * num_bytes + 2;
+
+	if (size > string_size) {
+		char *tmp = realloc(string, size);
+
+		if (!tmp)
+			goto unlock;
+
+		string = tmp;
+		string_size = size;
+	}
+
+	va_start(ap, format);
+	length = vsnprintf(string, string_size, format, ap);
+	va_end(ap);
+
+	/* Most significant byte first, unused bits masked */
+	for (unsigned int i = 0; i < num_bytes; i++) {
+		uint8_t tmp = data[num_bytes - i - 1];
+
+		if (i == 0 && (bits % 8))
+			tmp &= 0xff >> (8 - (bits % 8));
+
+		string[length++] = hex_digits[tmp >> 4];
+		string[length++] = hex_digits[tmp & 0xf];
+	}
+
+	string[length++] = '\n';
+	string[length] = '\0';
+
+	log_puts(level, file, line, function, string);
+	log_account(level, length, start_us);
+
+unlock:
+	log_unlock();
+}
+
 COMMAND_HANDLER(handle_debug_level_command)
 {
 	if (CMD_ARGC == 1) {
@@ -241,6 +445,8 @@ COMMAND_HANDLER(handle_log_output_command)
 		command_print(CMD, "set log_output to default");
 	}
 
+	log_flush();
+
 	if (log_output != stderr && log_output) {
 		/* Close previous log file, if it was open and wasn't stderr. */
 		fclose(log_output);
@@ -249,6 +455,63 @@ COMMAND_HANDLER(handle_log_output_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_log_buffer_size_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int size;
+
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size);
+
+		log_flush();
+		free(log_buffer);
+		log_buffer = NULL;
+		log_buffer_size = size;
+	}
+
+	command_print(CMD, "log buffer size: %zu bytes", log_buffer_size);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_log_stats_command)
+{
+	static const char * const level_names[] = {
+		"output", "user", "error", "warning", "info", "debug", "debug_io",
+	};
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		memset(log_stats, 0, sizeof(log_stats));
+		log_flush_count = 0;
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "level      messages         bytes   time [ms]");
+
+	for (unsigned int i = 0; i < ARRAY_SIZE(log_stats); i++) {
+		const struct log_level_stats *stats = &log_stats[i];
+
+		if (!stats->messages)
+			continue;
+
+		command_print(CMD, "%-8s %10" PRIu64 " %13" PRIu64 " %11" PRIu64,
+			level_names[i], stats->messages, stats->bytes,
+			stats->time_us / 1000);
+	}
+
+	command_print(CMD, "buffer writes: %u", log_flush_count);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration log_command_handlers[] = {
 	{
 		.name = "log_output",
@@ -267,6 +530,22 @@ static const struct command_registration log_command_handlers[] = {
 			"4 adds extra verbose debugging.",
 		.usage = "number",
 	},
+	{
+		.name = "log_buffer_size",
+		.handler = handle_log_buffer_size_command,
+		.mode = COMMAND_ANY,
+		.help = "Sets the size of the buffer for debug messages. "
+			"0 writes every message immediately.",
+		.usage = "[size]",
+	},
+	{
+		.name = "log_stats",
+		.handler = handle_log_stats_command,
+		.mode = COMMAND_ANY,
+		.help = "Show or reset the number of messages and the time "
+			"spent for logging, per level.",
+		.usage = "['reset']",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -293,10 +572,25 @@ void log_init(void)
 		log_output = stderr;
 
 	start = last_time = timeval_ms();
+
+#ifdef HAVE_PTHREAD
+	if (!log_mutex_initialized) {
+		pthread_mutexattr_t attr;
+
+		pthread_mutexattr_init(&attr);
+		pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+		log_mutex_initialized = !pthread_mutex_init(&log_mutex, &attr);
+		pthread_mutexattr_destroy(&attr);
+	}
+#endif
 }
 
 void log_exit(void)
 {
+	log_flush();
+	free(log_buffer);
+	log_buffer = NULL;
+
 	if (log_output && log_output != stderr) {
 		/* Close log file, if it was open and wasn't stderr. */
 		fclose(log_output);
@@ -425,6 +719,8 @@ static void gdb_timeout_warning(int64_t delta_time)
 
 void keep_alive(void)
 {
+	log_lock();
+
 	int64_t current_time = timeval_ms();
 	int64_t delta_time = current_time - last_time;
 
@@ -448,11 +744,15 @@ void keep_alive(void)
 		 * These functions should be invoked at a well defined spot in server.c
 		 */
 	}
+
+	log_unlock();
 }
 
 /* reset keep alive timer without sending message */
 void kept_alive(void)
 {
+	log_lock();
+
 	int64_t current_time = timeval_ms();
 
 	int64_t delta_time = current_time - last_time;
@@ -461,6 +761,8 @@ void kept_alive(void)
 
 	if (delta_time > KEEP_ALIVE_TIMEOUT_MS)
 		gdb_timeout_warning(delta_time);
+
+	log_unlock();
 }
 
 /* if we sleep for extended periods of time, we must invoke keep_alive() intermittently */
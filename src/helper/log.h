@@ -56,6 +56,18 @@ void log_vprintf_lf(enum log_levels level, const char *file, unsigned int line,
 void log_printf_lf(enum log_levels level, const char *file, unsigned int line,
 		const char *function, const char *format, ...)
 __attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 5, 6)));
+/**
+ * Log a message followed by the hex dump of @a bits bits of @a buf, most
+ * significant byte first, and a newline. The dump is formatted straight
+ * into a reused buffer instead of an allocated string.
+ */
+void log_printf_hex(enum log_levels level, const char *file, unsigned int line,
+		const char *function, const void *buf, unsigned int bits,
+		const char *format, ...)
+__attribute__ ((format (PRINTF_ATTRIBUTE_FORMAT, 7, 8)));
+
+/** Write out buffered debug messages. */
+void log_flush(void);
 
 /**
  * Initialize logging module.  Call during program startup.
@@ -101,11 +113,19 @@ extern int debug_level;
 #define LOG_DEBUG_IO(expr ...) \
 	do { \
 		if (debug_level >= LOG_LVL_DEBUG_IO) \
-			log_printf_lf(LOG_LVL_DEBUG, \
+			log_printf_lf(LOG_LVL_DEBUG_IO, \
 				__FILE__, __LINE__, __func__, \
 				expr); \
 	} while (0)
 
+#define LOG_DEBUG_IO_HEX(buf, bits, expr ...) \
+	do { \
+		if (debug_level >= LOG_LVL_DEBUG_IO) \
+			log_printf_hex(LOG_LVL_DEBUG_IO, \
+				__FILE__, __LINE__, __func__, \
+				buf, bits, expr); \
+	} while (0)
+
 #define LOG_DEBUG(expr ...) \
 	do { \
 		if (debug_level >= LOG_LVL_DEBUG) \
@@ -12,6 +12,8 @@
 #endif
 
 #include "adapter.h"
+#include "adapter_trace.h"
+#include "adapter_worker.h"
 #include "jtag.h"
 #include "minidriver.h"
 #include "interface.h"
@@ -186,6 +188,8 @@ int adapter_init(struct command_context *cmd_ctx)
 
 int adapter_quit(void)
 {
+	adapter_worker_stop();
+
 	if (is_adapter_initialized() && adapter_driver->quit) {
 		/* close the JTAG interface */
 		int result = adapter_driver->quit();
@@ -1178,6 +1182,12 @@ static const struct command_registration adapter_command_handlers[] = {
 			"[-pull-none|-pull-up|-pull-down]"
 			"[-init-inactive|-init-active|-init-input] ]",
 	},
+	{
+		.chain = adapter_trace_command_handlers,
+	},
+	{
+		.chain = adapter_worker_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
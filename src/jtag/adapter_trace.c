@@ -0,0 +1,725 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+#include <helper/time_support.h>
+
+#include "adapter_trace.h"
+#include "jtag.h"
+#include "commands.h"
+#include "swd.h"
+
+/* Write buffer of the capture file */
+#define ADAPTER_TRACE_FILE_BUFFER	(256 * 1024)
+
+static FILE *trace_file;
+static int64_t trace_start_us;
+static int64_t flush_start_us;
+static uint64_t trace_num_flushes;
+
+/* SWD operations queued since the last run() */
+struct trace_swd_op {
+	enum adapter_trace_record_type type;
+	uint8_t cmd;
+	uint32_t value;
+	uint32_t *read_value;
+	uint32_t ap_delay;
+};
+
+static const struct swd_driver *swd_real;
+static struct swd_driver swd_proxy;
+static struct trace_swd_op *swd_ops;
+static size_t swd_num_ops, swd_ops_size;
+
+static void trace_put(const void *data, size_t size)
+{
+	fwrite(data, 1, size, trace_file);
+}
+
+static void trace_put_u8(uint8_t value)
+{
+	trace_put(&value, 1);
+}
+
+static void trace_put_u32(uint32_t value)
+{
+	uint8_t buf[4];
+
+	h_u32_to_le(buf, value);
+	trace_put(buf, sizeof(buf));
+}
+
+static void trace_put_u64(uint64_t value)
+{
+	uint8_t buf[8];
+
+	h_u64_to_le(buf, value);
+	trace_put(buf, sizeof(buf));
+}
+
+static void trace_put_bits(const uint8_t *bits, unsigned int num_bits)
+{
+	trace_put(bits, DIV_ROUND_UP(num_bits, 8));
+}
+
+static void trace_put_flush(int result)
+{
+	int64_t now = timeval_us();
+
+	trace_put_u8(ADAPTER_TRACE_FLUSH);
+	trace_put_u64(flush_start_us - trace_start_us);
+	trace_put_u32(now - flush_start_us);
+	trace_put_u32(result);
+	trace_num_flushes++;
+}
+
+bool adapter_trace_is_active(void)
+{
+	return trace_file;
+}
+
+void adapter_trace_flush_start(void)
+{
+	flush_start_us = timeval_us();
+}
+
+void adapter_trace_jtag_queue(const struct jtag_command *cmd, int result)
+{
+	for (; cmd; cmd = cmd->next) {
+		switch (cmd->type) {
+		case JTAG_SCAN:
+			trace_put_u8(ADAPTER_TRACE_JTAG_SCAN);
+			trace_put_u8(cmd->cmd.scan->ir_scan);
+			trace_put_u8(cmd->cmd.scan->end_state);
+			trace_put_u32(cmd->cmd.scan->num_fields);
+
+			for (unsigned int i = 0; i < cmd->cmd.scan->num_fields; i++) {
+				const struct scan_field *field = &cmd->cmd.scan->fields[i];
+
+				trace_put_u32(field->num_bits);
+				trace_put_u8((field->out_value ? ADAPTER_TRACE_FIELD_OUT : 0) |
+					(field->in_value ? ADAPTER_TRACE_FIELD_IN : 0));
+
+				if (field->out_value)
+					trace_put_bits(field->out_value, field->num_bits);
+				if (field->in_value)
+					trace_put_bits(field->in_value, field->num_bits);
+			}
+			break;
+		case JTAG_TLR_RESET:
+			trace_put_u8(ADAPTER_TRACE_JTAG_TLR_RESET);
+			trace_put_u8(cmd->cmd.statemove->end_state);
+			break;
+		case JTAG_RUNTEST:
+			trace_put_u8(ADAPTER_TRACE_JTAG_RUNTEST);
+			trace_put_u32(cmd->cmd.runtest->num_cycles);
+			trace_put_u8(cmd->cmd.runtest->end_state);
+			break;
+		case JTAG_RESET:
+			trace_put_u8(ADAPTER_TRACE_JTAG_RESET);
+			trace_put_u8(cmd->cmd.reset->trst);
+			trace_put_u8(cmd->cmd.reset->srst);
+			break;
+		case JTAG_PATHMOVE:
+			trace_put_u8(ADAPTER_TRACE_JTAG_PATHMOVE);
+			trace_put_u32(cmd->cmd.pathmove->num_states);
+			for (unsigned int i = 0; i < cmd->cmd.pathmove->num_states; i++)
+				trace_put_u8(cmd->cmd.pathmove->path[i]);
+			break;
+		case JTAG_SLEEP:
+			trace_put_u8(ADAPTER_TRACE_JTAG_SLEEP);
+			trace_put_u32(cmd->cmd.sleep->us);
+			break;
+		case JTAG_STABLECLOCKS:
+			trace_put_u8(ADAPTER_TRACE_JTAG_STABLECLOCKS);
+			trace_put_u32(cmd->cmd.stableclocks->num_cycles);
+			break;
+		case JTAG_TMS:
+			trace_put_u8(ADAPTER_TRACE_JTAG_TMS);
+			trace_put_u32(cmd->cmd.tms->num_bits);
+			trace_put_bits(cmd->cmd.tms->bits, cmd->cmd.tms->num_bits);
+			break;
+		}
+	}
+
+	trace_put_flush(result);
+}
+
+static void trace_swd_queue(enum adapter_trace_record_type type, uint8_t cmd,
+		uint32_t value, uint32_t *read_value, uint32_t ap_delay)
+{
+	if (swd_num_ops == swd_ops_size) {
+		size_t size = swd_ops_size ? 2 * swd_ops_size : 64;
+		struct trace_swd_op *ops = realloc(swd_ops, size * sizeof(*ops));
+
+		if (!ops) {
+			LOG_ERROR("Out of memory, SWD operation not traced");
+			return;
+		}
+
+		swd_ops = ops;
+		swd_ops_size = size;
+	}
+
+	swd_ops[swd_num_ops++] = (struct trace_swd_op) {
+		.type = type,
+		.cmd = cmd,
+		.value = value,
+		.read_value = read_value,
+		.ap_delay = ap_delay,
+	};
+}
+
+static int trace_swd_switch_seq(enum swd_special_seq seq)
+{
+	if (trace_file)
+		trace_swd_queue(ADAPTER_TRACE_SWD_SEQ, seq, 0, NULL, 0);
+
+	return swd_real->switch_seq(seq);
+}
+
+static void trace_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay_hint)
+{
+	if (trace_file)
+		trace_swd_queue(ADAPTER_TRACE_SWD_READ, cmd, 0, value, ap_delay_hint);
+
+	swd_real->read_reg(cmd, value, ap_delay_hint);
+}
+
+static void trace_swd_write_reg(uint8_t cmd, uint32_t value, uint32_t ap_delay_hint)
+{
+	if (trace_file)
+		trace_swd_queue(ADAPTER_TRACE_SWD_WRITE, cmd, value, NULL, ap_delay_hint);
+
+	swd_real->write_reg(cmd, value, ap_delay_hint);
+}
+
+static int trace_swd_run(void)
+{
+	int retval;
+
+	if (!trace_file) {
+		swd_num_ops = 0;
+		return swd_real->run();
+	}
+
+	adapter_trace_flush_start();
+	retval = swd_real->run();
+
+	for (size_t i = 0; i < swd_num_ops; i++) {
+		const struct trace_swd_op *op = &swd_ops[i];
+
+		trace_put_u8(op->type);
+		trace_put_u8(op->cmd);
+
+		if (op->type == ADAPTER_TRACE_SWD_SEQ)
+			continue;
+
+		trace_put_u32(op->ap_delay);
+
+		if (op->type == ADAPTER_TRACE_SWD_READ)
+			trace_put_u32(retval == ERROR_OK && op->read_value ? *op->read_value : 0);
+		else
+			trace_put_u32(op->value);
+	}
+
+	swd_num_ops = 0;
+	trace_put_flush(retval);
+
+	return retval;
+}
+
+const struct swd_driver *adapter_trace_swd_driver(const struct swd_driver *swd)
+{
+	if (!swd)
+		return NULL;
+
+	swd_real = swd;
+	swd_proxy = *swd;
+	swd_proxy.switch_seq = trace_swd_switch_seq;
+	swd_proxy.read_reg = trace_swd_read_reg;
+	swd_proxy.write_reg = trace_swd_write_reg;
+	swd_proxy.run = trace_swd_run;
+
+	return &swd_proxy;
+}
+
+int adapter_trace_reader_open(struct adapter_trace_reader *reader,
+		const char *filename)
+{
+	char magic[sizeof(ADAPTER_TRACE_MAGIC) - 1];
+	uint8_t version[4];
+
+	*reader = (struct adapter_trace_reader) { 0 };
+	reader->file = fopen(filename, "rb");
+
+	if (!reader->file) {
+		LOG_ERROR("Failed to open trace file '%s': %s", filename, strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	if (fread(magic, 1, sizeof(magic), reader->file) != sizeof(magic) ||
+			memcmp(magic, ADAPTER_TRACE_MAGIC, sizeof(magic)) ||
+			fread(version, 1, sizeof(version), reader->file) != sizeof(version)) {
+		LOG_ERROR("'%s' is not an adapter trace file", filename);
+		adapter_trace_reader_close(reader);
+		return ERROR_FAIL;
+	}
+
+	if (le_to_h_u32(version) != ADAPTER_TRACE_VERSION) {
+		LOG_ERROR("Unsupported adapter trace version %" PRIu32, le_to_h_u32(version));
+		adapter_trace_reader_close(reader);
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+void adapter_trace_reader_close(struct adapter_trace_reader *reader)
+{
+	if (reader->file)
+		fclose(reader->file);
+
+	free(reader->buffer);
+	free(reader->fields);
+	*reader = (struct adapter_trace_reader) { 0 };
+}
+
+static bool trace_get(struct adapter_trace_reader *reader, void *data, size_t size)
+{
+	return fread(data, 1, size, reader->file) == size;
+}
+
+static bool trace_get_u8(struct adapter_trace_reader *reader, uint8_t *value)
+{
+	return trace_get(reader, value, 1);
+}
+
+static bool trace_get_s8(struct adapter_trace_reader *reader, int *value)
+{
+	int8_t tmp;
+
+	if (!trace_get(reader, &tmp, 1))
+		return false;
+
+	*value = tmp;
+	return true;
+}
+
+static bool trace_get_u32(struct adapter_trace_reader *reader, uint32_t *value)
+{
+	uint8_t buf[4];
+
+	if (!trace_get(reader, buf, sizeof(buf)))
+		return false;
+
+	*value = le_to_h_u32(buf);
+	return true;
+}
+
+static bool trace_get_u64(struct adapter_trace_reader *reader, uint64_t *value)
+{
+	uint8_t buf[8];
+
+	if (!trace_get(reader, buf, sizeof(buf)))
+		return false;
+
+	*value = le_to_h_u64(buf);
+	return true;
+}
+
+/* Make room for @a size more bytes after @a used bytes of the buffer */
+static bool trace_reserve(struct adapter_trace_reader *reader, size_t used,
+		size_t size)
+{
+	if (used + size <= reader->buffer_size)
+		return true;
+
+	size_t new_size = MAX(2 * reader->buffer_size, used + size);
+	uint8_t *buffer = realloc(reader->buffer, new_size);
+
+	if (!buffer)
+		return false;
+
+	reader->buffer = buffer;
+	reader->buffer_size = new_size;
+	return true;
+}
+
+static bool trace_get_scan(struct adapter_trace_reader *reader,
+		struct adapter_trace_record *record)
+{
+	uint8_t ir_scan;
+	uint32_t num_fields;
+	size_t used = 0;
+
+	if (!trace_get_u8(reader, &ir_scan) ||
+			!trace_get_s8(reader, &record->end_state) ||
+			!trace_get_u32(reader, &num_fields))
+		return false;
+
+	if (num_fields > reader->num_fields) {
+		struct adapter_trace_field *fields;
+
+		fields = realloc(reader->fields, num_fields * sizeof(*fields));
+		if (!fields)
+			return false;
+
+		reader->fields = fields;
+		reader->num_fields = num_fields;
+	}
+
+	/* Collect the field data first, the buffer may move while growing */
+	size_t *offsets = calloc(2 * num_fields + 1, sizeof(*offsets));
+	if (!offsets)
+		return false;
+
+	for (uint32_t i = 0; i < num_fields; i++) {
+		uint32_t num_bits;
+		uint8_t flags;
+
+		if (!trace_get_u32(reader, &num_bits) || !trace_get_u8(reader, &flags))
+			goto fail;
+
+		size_t size = DIV_ROUND_UP(num_bits, 8);
+		reader->fields[i].num_bits = num_bits;
+		offsets[2 * i] = SIZE_MAX;
+		offsets[2 * i + 1] = SIZE_MAX;
+
+		for (unsigned int j = 0; j < 2; j++) {
+			if (!(flags & (ADAPTER_TRACE_FIELD_OUT << j)))
+				continue;
+
+			if (!trace_reserve(reader, used, size) ||
+					!trace_get(reader, reader->buffer + used, size))
+				goto fail;
+
+			offsets[2 * i + j] = used;
+			used += size;
+		}
+	}
+
+	for (uint32_t i = 0; i < num_fields; i++) {
+		reader->fields[i].out_value = offsets[2 * i] == SIZE_MAX ? NULL :
+			reader->buffer + offsets[2 * i];
+		reader->fields[i].in_value = offsets[2 * i + 1] == SIZE_MAX ? NULL :
+			reader->buffer + offsets[2 * i + 1];
+	}
+
+	free(offsets);
+
+	record->ir_scan = ir_scan;
+	record->count = num_fields;
+	record->fields = reader->fields;
+	return true;
+
+fail:
+	free(offsets);
+	return false;
+}
+
+static bool trace_get_data(struct adapter_trace_reader *reader,
+		struct adapter_trace_record *record, size_t size)
+{
+	if (!trace_reserve(reader, 0, size) || !trace_get(reader, reader->buffer, size))
+		return false;
+
+	record->data = reader->buffer;
+	return true;
+}
+
+int adapter_trace_read(struct adapter_trace_reader *reader,
+		struct adapter_trace_record *record)
+{
+	uint8_t type;
+	uint32_t value = 0;
+	bool ok;
+
+	if (!trace_get_u8(reader, &type))
+		return ERROR_WAIT;
+
+	*record = (struct adapter_trace_record) { .type = type };
+
+	switch (type) {
+	case ADAPTER_TRACE_FLUSH:
+		ok = trace_get_u64(reader, &record->start_us) &&
+			trace_get_u32(reader, &record->duration_us) &&
+			trace_get_u32(reader, &value);
+		record->result = value;
+		break;
+	case ADAPTER_TRACE_JTAG_SCAN:
+		ok = trace_get_scan(reader, record);
+		break;
+	case ADAPTER_TRACE_JTAG_TLR_RESET:
+		ok = trace_get_s8(reader, &record->end_state);
+		break;
+	case ADAPTER_TRACE_JTAG_RUNTEST:
+		ok = trace_get_u32(reader, &value) &&
+			trace_get_s8(reader, &record->end_state);
+		record->count = value;
+		break;
+	case ADAPTER_TRACE_JTAG_RESET:
+		ok = trace_get_s8(reader, &record->trst) &&
+			trace_get_s8(reader, &record->srst);
+		break;
+	case ADAPTER_TRACE_JTAG_PATHMOVE:
+		ok = trace_get_u32(reader, &value) &&
+			trace_get_data(reader, record, value);
+		record->count = value;
+		break;
+	case ADAPTER_TRACE_JTAG_SLEEP:
+	case ADAPTER_TRACE_JTAG_STABLECLOCKS:
+		ok = trace_get_u32(reader, &value);
+		record->count = value;
+		break;
+	case ADAPTER_TRACE_JTAG_TMS:
+		ok = trace_get_u32(reader, &value) &&
+			trace_get_data(reader, record, DIV_ROUND_UP(value, 8));
+		record->count = value;
+		break;
+	case ADAPTER_TRACE_SWD_SEQ:
+		ok = trace_get_u8(reader, &record->swd_cmd);
+		break;
+	case ADAPTER_TRACE_SWD_READ:
+	case ADAPTER_TRACE_SWD_WRITE:
+		ok = trace_get_u8(reader, &record->swd_cmd) &&
+			trace_get_u32(reader, &record->ap_delay) &&
+			trace_get_u32(reader, &record->value);
+		break;
+	default:
+		ok = false;
+		break;
+	}
+
+	if (!ok) {
+		LOG_ERROR("Adapter trace damaged at record %" PRIu64, reader->index);
+		return ERROR_FAIL;
+	}
+
+	reader->index++;
+	return ERROR_OK;
+}
+
+static int adapter_trace_stop(void)
+{
+	int retval = ERROR_OK;
+
+	if (!trace_file)
+		return ERROR_OK;
+
+	if (fclose(trace_file)) {
+		LOG_ERROR("Failed to write the adapter trace: %s", strerror(errno));
+		retval = ERROR_FAIL;
+	}
+
+	trace_file = NULL;
+	swd_num_ops = 0;
+
+	return retval;
+}
+
+COMMAND_HANDLER(handle_adapter_trace_start_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	adapter_trace_stop();
+
+	trace_file = fopen(CMD_ARGV[0], "wb");
+	if (!trace_file) {
+		command_print(CMD, "failed to open '%s': %s", CMD_ARGV[0], strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	setvbuf(trace_file, NULL, _IOFBF, ADAPTER_TRACE_FILE_BUFFER);
+
+	trace_put(ADAPTER_TRACE_MAGIC, strlen(ADAPTER_TRACE_MAGIC));
+	trace_put_u32(ADAPTER_TRACE_VERSION);
+
+	trace_start_us = timeval_us();
+	trace_num_flushes = 0;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_adapter_trace_stop_command)
+{
+	if (CMD_ARGC)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (trace_file)
+		command_print(CMD, "%" PRIu64 " queue executions traced", trace_num_flushes);
+
+	return adapter_trace_stop();
+}
+
+/* Statistics of a capture, to spot inefficient use of the adapter */
+struct trace_info {
+	uint64_t records[256];
+	uint64_t flush_time_us;
+	uint64_t last_us;
+	uint64_t scan_bits;
+	uint64_t failed_flushes;
+	uint64_t redundant_ir_scans;
+	uint64_t max_commands;
+};
+
+COMMAND_HANDLER(handle_adapter_trace_info_command)
+{
+	static const struct {
+		enum adapter_trace_record_type type;
+		const char *name;
+	} names[] = {
+		{ ADAPTER_TRACE_JTAG_SCAN, "JTAG scans" },
+		{ ADAPTER_TRACE_JTAG_TLR_RESET, "JTAG TLR resets" },
+		{ ADAPTER_TRACE_JTAG_RUNTEST, "JTAG runtests" },
+		{ ADAPTER_TRACE_JTAG_RESET, "JTAG resets" },
+		{ ADAPTER_TRACE_JTAG_PATHMOVE, "JTAG pathmoves" },
+		{ ADAPTER_TRACE_JTAG_SLEEP, "JTAG sleeps" },
+		{ ADAPTER_TRACE_JTAG_STABLECLOCKS, "JTAG stableclocks" },
+		{ ADAPTER_TRACE_JTAG_TMS, "JTAG TMS sequences" },
+		{ ADAPTER_TRACE_SWD_SEQ, "SWD sequences" },
+		{ ADAPTER_TRACE_SWD_READ, "SWD reads" },
+		{ ADAPTER_TRACE_SWD_WRITE, "SWD writes" },
+	};
+	struct adapter_trace_reader reader;
+	struct adapter_trace_record record;
+	struct trace_info *info;
+	uint8_t *last_ir = NULL;
+	size_t last_ir_size = 0;
+	uint64_t commands = 0;
+	int retval;
+
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	info = calloc(1, sizeof(*info));
+	if (!info)
+		return ERROR_FAIL;
+
+	retval = adapter_trace_reader_open(&reader, CMD_ARGV[0]);
+	if (retval != ERROR_OK) {
+		free(info);
+		return retval;
+	}
+
+	while ((retval = adapter_trace_read(&reader, &record)) == ERROR_OK) {
+		info->records[record.type]++;
+
+		switch (record.type) {
+		case ADAPTER_TRACE_FLUSH:
+			info->flush_time_us += record.duration_us;
+			info->last_us = record.start_us + record.duration_us;
+			if (record.result != ERROR_OK)
+				info->failed_flushes++;
+			info->max_commands = MAX(info->max_commands, commands);
+			commands = 0;
+			continue;
+		case ADAPTER_TRACE_JTAG_SCAN:
+			/* An IR scan shifting the same instructions again is redundant */
+			if (record.ir_scan) {
+				size_t size = 0;
+
+				for (unsigned int i = 0; i < record.count; i++)
+					size += DIV_ROUND_UP(record.fields[i].num_bits, 8);
+
+				uint8_t *ir = malloc(size);
+				size_t pos = 0;
+
+				for (unsigned int i = 0; ir && i < record.count; i++) {
+					size_t n = DIV_ROUND_UP(record.fields[i].num_bits, 8);
+
+					if (record.fields[i].out_value)
+						memcpy(ir + pos, record.fields[i].out_value, n);
+					else
+						memset(ir + pos, 0xff, n);
+					pos += n;
+				}
+
+				if (ir && last_ir && size == last_ir_size && !memcmp(ir, last_ir, size))
+					info->redundant_ir_scans++;
+
+				free(last_ir);
+				last_ir = ir;
+				last_ir_size = size;
+			}
+
+			for (unsigned int i = 0; i < record.count; i++)
+				info->scan_bits += record.fields[i].num_bits;
+			break;
+		case ADAPTER_TRACE_JTAG_TLR_RESET:
+		case ADAPTER_TRACE_JTAG_RESET:
+			/* The instruction register is reset */
+			free(last_ir);
+			last_ir = NULL;
+			break;
+		default:
+			break;
+		}
+
+		commands++;
+	}
+
+	free(last_ir);
+	adapter_trace_reader_close(&reader);
+
+	if (retval == ERROR_WAIT) {
+		command_print(CMD, "queue executions:   %" PRIu64 " (%" PRIu64 " failed)",
+			info->records[ADAPTER_TRACE_FLUSH], info->failed_flushes);
+		command_print(CMD, "capture duration:   %" PRIu64 " ms, %" PRIu64
+			" ms in the adapter", info->last_us / 1000, info->flush_time_us / 1000);
+		command_print(CMD, "largest queue:      %" PRIu64 " commands", info->max_commands);
+
+		for (unsigned int i = 0; i < ARRAY_SIZE(names); i++) {
+			if (info->records[names[i].type])
+				command_print(CMD, "%-19s %" PRIu64, names[i].name,
+					info->records[names[i].type]);
+		}
+
+		command_print(CMD, "JTAG bits scanned:  %" PRIu64, info->scan_bits);
+		command_print(CMD, "redundant IR scans: %" PRIu64, info->redundant_ir_scans);
+		retval = ERROR_OK;
+	}
+
+	free(info);
+	return retval;
+}
+
+static const struct command_registration adapter_trace_subcommand_handlers[] = {
+	{
+		.name = "start",
+		.handler = handle_adapter_trace_start_command,
+		.mode = COMMAND_ANY,
+		.help = "Start capturing the adapter traffic into a file",
+		.usage = "filename",
+	},
+	{
+		.name = "stop",
+		.handler = handle_adapter_trace_stop_command,
+		.mode = COMMAND_ANY,
+		.help = "Stop capturing the adapter traffic",
+		.usage = "",
+	},
+	{
+		.name = "info",
+		.handler = handle_adapter_trace_info_command,
+		.mode = COMMAND_ANY,
+		.help = "Show statistics of a capture file",
+		.usage = "filename",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+const struct command_registration adapter_trace_command_handlers[] = {
+	{
+		.name = "trace",
+		.mode = COMMAND_ANY,
+		.help = "Binary capture of the adapter traffic",
+		.usage = "",
+		.chain = adapter_trace_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_JTAG_ADAPTER_TRACE_H
+#define OPENOCD_JTAG_ADAPTER_TRACE_H
+
+#include <stdio.h>
+#include <helper/command.h>
+#include <helper/types.h>
+
+struct jtag_command;
+struct swd_driver;
+
+/**
+ * @file
+ * Binary capture of the JTAG and SWD traffic to the debug adapter.
+ *
+ * A capture file starts with the magic "OCDTRACE" and a 32-bit version,
+ * followed by records. Each record starts with a one byte type, all
+ * numbers are little-endian. Commands are recorded when the queue is
+ * executed, with the data captured from the target, and each execution is
+ * closed by a flush record with its start time, duration and result.
+ */
+
+#define ADAPTER_TRACE_MAGIC		"OCDTRACE"
+#define ADAPTER_TRACE_VERSION	1
+
+enum adapter_trace_record_type {
+	/* u64 start [us], u32 duration [us], s32 result */
+	ADAPTER_TRACE_FLUSH = 0x01,
+	/* u8 ir_scan, s8 end_state, u32 num_fields, per field: u32 num_bits,
+	 * u8 flags (1: out, 2: in), out bytes, in bytes */
+	ADAPTER_TRACE_JTAG_SCAN = 0x10,
+	/* s8 end_state */
+	ADAPTER_TRACE_JTAG_TLR_RESET = 0x11,
+	/* u32 num_cycles, s8 end_state */
+	ADAPTER_TRACE_JTAG_RUNTEST = 0x12,
+	/* s8 trst, s8 srst */
+	ADAPTER_TRACE_JTAG_RESET = 0x13,
+	/* u32 num_states, s8 states[num_states] */
+	ADAPTER_TRACE_JTAG_PATHMOVE = 0x14,
+	/* u32 us */
+	ADAPTER_TRACE_JTAG_SLEEP = 0x15,
+	/* u32 num_cycles */
+	ADAPTER_TRACE_JTAG_STABLECLOCKS = 0x16,
+	/* u32 num_bits, bits */
+	ADAPTER_TRACE_JTAG_TMS = 0x17,
+	/* u8 seq */
+	ADAPTER_TRACE_SWD_SEQ = 0x20,
+	/* u8 cmd, u32 ap_delay, u32 value */
+	ADAPTER_TRACE_SWD_READ = 0x21,
+	ADAPTER_TRACE_SWD_WRITE = 0x22,
+};
+
+#define ADAPTER_TRACE_FIELD_OUT	0x01
+#define ADAPTER_TRACE_FIELD_IN	0x02
+
+struct adapter_trace_field {
+	unsigned int num_bits;
+	/* NULL if not present, points into the reader's buffer */
+	const uint8_t *out_value;
+	const uint8_t *in_value;
+};
+
+/** A decoded record, only the members of its type are valid. */
+struct adapter_trace_record {
+	enum adapter_trace_record_type type;
+	/* FLUSH */
+	uint64_t start_us;
+	uint32_t duration_us;
+	int32_t result;
+	/* JTAG */
+	bool ir_scan;
+	int end_state;
+	int trst, srst;
+	/* cycles, microseconds, bits, states or fields */
+	unsigned int count;
+	const struct adapter_trace_field *fields;
+	/* TMS bits or path states */
+	const uint8_t *data;
+	/* SWD */
+	uint8_t swd_cmd;
+	uint32_t ap_delay;
+	uint32_t value;
+};
+
+struct adapter_trace_reader {
+	FILE *file;
+	uint64_t index;
+	uint8_t *buffer;
+	size_t buffer_size;
+	struct adapter_trace_field *fields;
+	unsigned int num_fields;
+};
+
+/** Open a capture file and check its header. */
+int adapter_trace_reader_open(struct adapter_trace_reader *reader,
+		const char *filename);
+void adapter_trace_reader_close(struct adapter_trace_reader *reader);
+
+/**
+ * Read the next record. The data the record points to stays valid until
+ * the next call.
+ *
+ * @returns ERROR_OK, ERROR_WAIT at the end of the file or ERROR_FAIL if
+ * the file is damaged.
+ */
+int adapter_trace_read(struct adapter_trace_reader *reader,
+		struct adapter_trace_record *record);
+
+/** @returns true while a capture is running. */
+bool adapter_trace_is_active(void);
+
+/** Called by the JTAG core before the queue is executed. */
+void adapter_trace_flush_start(void);
+/** Called by the JTAG core with the executed queue and its result. */
+void adapter_trace_jtag_queue(const struct jtag_command *cmd, int result);
+
+/**
+ * Wrap the SWD driver of the adapter, so that its traffic can be captured.
+ * Without a running capture the calls are passed through.
+ */
+const struct swd_driver *adapter_trace_swd_driver(const struct swd_driver *swd);
+
+extern const struct command_registration adapter_trace_command_handlers[];
+
+#endif /* OPENOCD_JTAG_ADAPTER_TRACE_H */
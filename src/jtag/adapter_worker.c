@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+
+#include "adapter_worker.h"
+#include "swd.h"
+
+#include <string.h>
+
+#ifdef HAVE_PTHREAD
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#endif
+
+/* Interval in which the waiting thread checks if clients need a keep-alive */
+#define ADAPTER_WORKER_KEEP_ALIVE_MS	100
+
+static bool worker_enabled;
+
+static const struct swd_driver *swd_real;
+static struct swd_driver swd_proxy;
+
+#ifdef HAVE_PTHREAD
+static bool worker_running;
+static pthread_t worker_thread;
+static pthread_mutex_t worker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_cond = PTHREAD_COND_INITIALIZER;
+
+/* The job handed to the thread, protected by worker_mutex */
+static int (*worker_job)(void *priv);
+static void *worker_job_priv;
+static int worker_job_result;
+static bool worker_job_done;
+static bool worker_quit;
+
+static void *adapter_worker_main(void *arg)
+{
+	pthread_mutex_lock(&worker_mutex);
+
+	while (!worker_quit) {
+		if (!worker_job || worker_job_done) {
+			pthread_cond_wait(&worker_cond, &worker_mutex);
+			continue;
+		}
+
+		int (*job)(void *priv) = worker_job;
+		void *priv = worker_job_priv;
+
+		pthread_mutex_unlock(&worker_mutex);
+		int result = job(priv);
+		pthread_mutex_lock(&worker_mutex);
+
+		worker_job_result = result;
+		worker_job_done = true;
+		pthread_cond_broadcast(&worker_cond);
+	}
+
+	pthread_mutex_unlock(&worker_mutex);
+
+	return NULL;
+}
+
+static int adapter_worker_start(void)
+{
+	worker_job = NULL;
+	worker_quit = false;
+
+	int err = pthread_create(&worker_thread, NULL, adapter_worker_main, NULL);
+	if (err) {
+		LOG_ERROR("Failed to start the adapter I/O thread: %s", strerror(err));
+		return ERROR_FAIL;
+	}
+
+	worker_running = true;
+	LOG_DEBUG("adapter I/O thread started");
+
+	return ERROR_OK;
+}
+
+/* Wait for the job to finish, with worker_mutex held */
+static void adapter_worker_wait(void)
+{
+	while (!worker_job_done) {
+		struct timespec deadline;
+
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += ADAPTER_WORKER_KEEP_ALIVE_MS * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+
+		if (pthread_cond_timedwait(&worker_cond, &worker_mutex, &deadline) == ETIMEDOUT) {
+			/* The logging is serialized with the thread, see log.c */
+			pthread_mutex_unlock(&worker_mutex);
+			keep_alive();
+			pthread_mutex_lock(&worker_mutex);
+		}
+	}
+}
+#endif
+
+int adapter_worker_call(int (*job)(void *priv), void *priv)
+{
+#ifdef HAVE_PTHREAD
+	if (worker_enabled && !worker_running && adapter_worker_start() != ERROR_OK)
+		worker_enabled = false;
+
+	/* Nested calls from a job run directly */
+	if (!worker_running || pthread_equal(pthread_self(), worker_thread))
+		return job(priv);
+
+	pthread_mutex_lock(&worker_mutex);
+
+	worker_job = job;
+	worker_job_priv = priv;
+	worker_job_done = false;
+	pthread_cond_broadcast(&worker_cond);
+
+	adapter_worker_wait();
+
+	int result = worker_job_result;
+	worker_job = NULL;
+
+	pthread_mutex_unlock(&worker_mutex);
+
+	return result;
+#else
+	return job(priv);
+#endif
+}
+
+void adapter_worker_stop(void)
+{
+#ifdef HAVE_PTHREAD
+	if (!worker_running)
+		return;
+
+	pthread_mutex_lock(&worker_mutex);
+	worker_quit = true;
+	pthread_cond_broadcast(&worker_cond);
+	pthread_mutex_unlock(&worker_mutex);
+
+	pthread_join(worker_thread, NULL);
+	worker_running = false;
+	LOG_DEBUG("adapter I/O thread stopped");
+#endif
+}
+
+static int worker_swd_run_job(void *priv)
+{
+	return swd_real->run();
+}
+
+static int worker_swd_run(void)
+{
+	return adapter_worker_call(worker_swd_run_job, NULL);
+}
+
+const struct swd_driver *adapter_worker_swd_driver(const struct swd_driver *swd)
+{
+	if (!swd)
+		return NULL;
+
+	swd_real = swd;
+	swd_proxy = *swd;
+	swd_proxy.run = worker_swd_run;
+
+	return &swd_proxy;
+}
+
+COMMAND_HANDLER(handle_adapter_io_thread_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], enable);
+#ifndef HAVE_PTHREAD
+		if (enable) {
+			command_print(CMD, "adapter I/O thread not supported by this build");
+			return ERROR_NOT_IMPLEMENTED;
+		}
+#endif
+		worker_enabled = enable;
+	}
+
+	command_print(CMD, "adapter I/O thread is %s", worker_enabled ? "on" : "off");
+
+	return ERROR_OK;
+}
+
+const struct command_registration adapter_worker_command_handlers[] = {
+	{
+		.name = "io_thread",
+		.handler = handle_adapter_io_thread_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Execute the adapter queue on a separate thread",
+		.usage = "['on'|'off']",
+	},
+	COMMAND_REGISTRATION_DONE
+};
@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_JTAG_ADAPTER_WORKER_H
+#define OPENOCD_JTAG_ADAPTER_WORKER_H
+
+#include <helper/command.h>
+
+struct swd_driver;
+
+/**
+ * @file
+ * Optional I/O thread for the debug adapter.
+ *
+ * When enabled by "adapter io_thread on", the JTAG queue and the SWD run()
+ * of the adapter driver are executed on a separate thread. The calling
+ * thread waits for the result, but keeps the GDB connections alive while
+ * the adapter is busy, e.g. with a slow USB transfer. The jobs are still
+ * executed one at a time and the caller gets the result synchronously.
+ */
+
+/**
+ * Execute @a job with @a priv on the I/O thread if it is enabled, or
+ * directly otherwise, and return its result.
+ */
+int adapter_worker_call(int (*job)(void *priv), void *priv);
+
+/** Stop the I/O thread, called when the adapter is closed. */
+void adapter_worker_stop(void);
+
+/**
+ * Wrap the SWD driver of the adapter, so that run() is executed on the I/O
+ * thread. Queueing operations are passed through.
+ */
+const struct swd_driver *adapter_worker_swd_driver(const struct swd_driver *swd);
+
+extern const struct command_registration adapter_worker_command_handlers[];
+
+#endif /* OPENOCD_JTAG_ADAPTER_WORKER_H */
@@ -30,11 +30,20 @@ struct cmd_queue_page {
 };
 
 #define CMD_QUEUE_PAGE_SIZE (1024 * 1024)
-static struct cmd_queue_page *cmd_queue_pages;
-static struct cmd_queue_page *cmd_queue_pages_tail;
 
-static struct jtag_command *jtag_command_queue;
-static struct jtag_command **next_command_pointer = &jtag_command_queue;
+/* The commands queued for the adapter and the memory they are allocated in.
+ * There is a single adapter, so there is a single queue. */
+struct jtag_command_queue {
+	struct cmd_queue_page *pages;
+	struct cmd_queue_page *pages_tail;
+
+	struct jtag_command *head;
+	struct jtag_command **next_command_pointer;
+};
+
+static struct jtag_command_queue jtag_queue = {
+	.next_command_pointer = &jtag_queue.head,
+};
 
 void jtag_queue_command(struct jtag_command *cmd)
 {
@@ -54,18 +63,18 @@ void jtag_queue_command(struct jtag_command *cmd)
 	/* this command goes on the end, so ensure the queue terminates */
 	cmd->next = NULL;
 
-	struct jtag_command **last_cmd = next_command_pointer;
+	struct jtag_command **last_cmd = jtag_queue.next_command_pointer;
 	assert(last_cmd);
 	assert(!*last_cmd);
 	*last_cmd = cmd;
 
 	/* store location where the next command pointer will be stored */
-	next_command_pointer = &cmd->next;
+	jtag_queue.next_command_pointer = &cmd->next;
 }
 
 void *cmd_queue_alloc(size_t size)
 {
-	struct cmd_queue_page **p_page = &cmd_queue_pages;
+	struct cmd_queue_page **p_page = &jtag_queue.pages;
 	int offset;
 	uint8_t *t;
 
@@ -102,7 +111,7 @@ void *cmd_queue_alloc(size_t size)
 	/* Done... */
 
 	if (*p_page) {
-		p_page = &cmd_queue_pages_tail;
+		p_page = &jtag_queue.pages_tail;
 		if (CMD_QUEUE_PAGE_SIZE < (*p_page)->used + size)
 			p_page = &((*p_page)->next);
 	}
@@ -114,7 +123,7 @@ void *cmd_queue_alloc(size_t size)
 					CMD_QUEUE_PAGE_SIZE : size;
 		(*p_page)->address = malloc(alloc_size);
 		(*p_page)->next = NULL;
-		cmd_queue_pages_tail = *p_page;
+		jtag_queue.pages_tail = *p_page;
 	}
 
 	offset = (*p_page)->used;
@@ -126,7 +135,7 @@ void *cmd_queue_alloc(size_t size)
 
 static void cmd_queue_free(void)
 {
-	struct cmd_queue_page *page = cmd_queue_pages;
+	struct cmd_queue_page *page = jtag_queue.pages;
 
 	while (page) {
 		struct cmd_queue_page *last = page;
@@ -135,21 +144,21 @@ static void cmd_queue_free(void)
 		free(last);
 	}
 
-	cmd_queue_pages = NULL;
-	cmd_queue_pages_tail = NULL;
+	jtag_queue.pages = NULL;
+	jtag_queue.pages_tail = NULL;
 }
 
 void jtag_command_queue_reset(void)
 {
 	cmd_queue_free();
 
-	jtag_command_queue = NULL;
-	next_command_pointer = &jtag_command_queue;
+	jtag_queue.head = NULL;
+	jtag_queue.next_command_pointer = &jtag_queue.head;
 }
 
 struct jtag_command *jtag_command_queue_get(void)
 {
-	return jtag_command_queue;
+	return jtag_queue.head;
 }
 
 /**
@@ -20,6 +20,8 @@
 #endif
 
 #include "adapter.h"
+#include "adapter_trace.h"
+#include "adapter_worker.h"
 #include "jtag.h"
 #include "swd.h"
 #include "interface.h"
@@ -942,6 +944,11 @@ void jtag_check_value_mask(struct scan_field *field, uint8_t *value, uint8_t *ma
 	jtag_set_error(retval);
 }
 
+static int jtag_execute_queue_job(void *priv)
+{
+	return adapter_driver->jtag_ops->execute_queue(priv);
+}
+
 int default_interface_jtag_execute_queue(void)
 {
 	if (!is_adapter_initialized()) {
@@ -965,7 +972,15 @@ int default_interface_jtag_execute_queue(void)
 	}
 
 	struct jtag_command *cmd = jtag_command_queue_get();
-	int result = adapter_driver->jtag_ops->execute_queue(cmd);
+	bool trace = adapter_trace_is_active();
+
+	if (trace)
+		adapter_trace_flush_start();
+
+	int result = adapter_worker_call(jtag_execute_queue_job, cmd);
+
+	if (trace)
+		adapter_trace_jtag_queue(cmd, result);
 
 	while (debug_level >= LOG_LVL_DEBUG_IO && cmd) {
 		switch (cmd->type) {
@@ -975,16 +990,12 @@ int default_interface_jtag_execute_queue(void)
 						tap_state_name(cmd->cmd.scan->end_state));
 				for (unsigned int i = 0; i < cmd->cmd.scan->num_fields; i++) {
 					struct scan_field *field = cmd->cmd.scan->fields + i;
-					if (field->out_value) {
-						char *str = buf_to_hex_str(field->out_value, field->num_bits);
-						LOG_DEBUG_IO("  %ub out: %s", field->num_bits, str);
-						free(str);
-					}
-					if (field->in_value) {
-						char *str = buf_to_hex_str(field->in_value, field->num_bits);
-						LOG_DEBUG_IO("  %ub  in: %s", field->num_bits, str);
-						free(str);
-					}
+					if (field->out_value)
+						LOG_DEBUG_IO_HEX(field->out_value, field->num_bits,
+							"  %ub out: ", field->num_bits);
+					if (field->in_value)
+						LOG_DEBUG_IO_HEX(field->in_value, field->num_bits,
+							"  %ub  in: ", field->num_bits);
 				}
 				break;
 			case JTAG_TLR_RESET:
@@ -14,6 +14,7 @@
 #include <jtag/interface.h>
 #include <transport/transport.h>
 #include "bitbang.h"
+#include "mmap_gpio.h"
 
 #include <sys/mman.h>
 
@@ -26,6 +27,7 @@
 #define AM335XGPIO_GPIO1_HW_ADDR 0x4804C000
 #define AM335XGPIO_GPIO2_HW_ADDR 0x481AC000
 #define AM335XGPIO_GPIO3_HW_ADDR 0x481AE000
+#define AM335XGPIO_GPIO_CHIP_SIZE 0x1000
 
 /* 32-bit offsets from GPIO chip base address. Values taken from "AM335x and
  * AMIC110 Sitara Processors Technical Reference Manual", Chapter 25
@@ -74,7 +76,6 @@ static const uint32_t am335xgpio_gpio_chip_hw_addr[AM335XGPIO_NUM_GPIO_CHIPS] =
 /* Memory-mapped address pointers */
 static volatile uint32_t *am335xgpio_gpio_chip_mmap_addr[AM335XGPIO_NUM_GPIO_CHIPS];
 
-static int dev_mem_fd;
 static enum amx335gpio_initial_gpio_mode initial_gpio_mode[ADAPTER_GPIO_IDX_NUM];
 
 /* Transition delay coefficients */
@@ -381,9 +382,10 @@ static bool am335xgpio_swd_mode_possible(void)
 
 static void am335xgpio_munmap(void)
 {
-	for (unsigned int i = 0; i < AM335XGPIO_NUM_GPIO_CHIPS && am335xgpio_gpio_chip_mmap_addr[i] != MAP_FAILED; ++i)
-		if (munmap((void *)am335xgpio_gpio_chip_mmap_addr[i], sysconf(_SC_PAGE_SIZE)) < 0)
-			LOG_ERROR("Cannot unmap GPIO memory for chip %d: %s", i, strerror(errno));
+	for (unsigned int i = 0; i < AM335XGPIO_NUM_GPIO_CHIPS; ++i) {
+		mmap_gpio_unmap(am335xgpio_gpio_chip_mmap_addr[i], AM335XGPIO_GPIO_CHIP_SIZE);
+		am335xgpio_gpio_chip_mmap_addr[i] = MAP_FAILED;
+	}
 }
 
 static int am335xgpio_init(void)
@@ -403,22 +405,18 @@ static int am335xgpio_init(void)
 		return ERROR_JTAG_INIT_FAILED;
 	}
 
-	dev_mem_fd = open("/dev/gpiomem", O_RDWR | O_SYNC);
-	if (dev_mem_fd < 0) {
-		LOG_DEBUG("Cannot open /dev/gpiomem, fallback to /dev/mem");
-		dev_mem_fd = open("/dev/mem", O_RDWR | O_SYNC);
-	}
-	if (dev_mem_fd < 0) {
-		LOG_ERROR("open: %s", strerror(errno));
+	int dev_mem_fd = mmap_gpio_open(NULL);
+	if (dev_mem_fd < 0)
 		return ERROR_JTAG_INIT_FAILED;
-	}
+
+	for (unsigned int i = 0; i < AM335XGPIO_NUM_GPIO_CHIPS; ++i)
+		am335xgpio_gpio_chip_mmap_addr[i] = MAP_FAILED;
 
 	for (unsigned int i = 0; i < AM335XGPIO_NUM_GPIO_CHIPS; ++i) {
-		am335xgpio_gpio_chip_mmap_addr[i] = mmap(NULL, sysconf(_SC_PAGE_SIZE), PROT_READ | PROT_WRITE,
-				MAP_SHARED, dev_mem_fd, am335xgpio_gpio_chip_hw_addr[i]);
+		am335xgpio_gpio_chip_mmap_addr[i] = mmap_gpio_map(dev_mem_fd,
+				am335xgpio_gpio_chip_hw_addr[i], AM335XGPIO_GPIO_CHIP_SIZE);
 
 		if (am335xgpio_gpio_chip_mmap_addr[i] == MAP_FAILED) {
-			LOG_ERROR("mmap: %s", strerror(errno));
 			am335xgpio_munmap();
 			close(dev_mem_fd);
 			return ERROR_JTAG_INIT_FAILED;
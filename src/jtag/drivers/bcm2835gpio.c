@@ -16,15 +16,18 @@
 #include <jtag/interface.h>
 #include <transport/transport.h>
 #include "bitbang.h"
+#include "mmap_gpio.h"
 
 #include <sys/mman.h>
 
 static char *bcm2835_peri_mem_dev;
 static off_t bcm2835_peri_base = 0x20000000;
 #define BCM2835_GPIO_BASE	(bcm2835_peri_base + 0x200000) /* GPIO controller */
+#define BCM2835_GPIO_SIZE	0x1000
 
 #define BCM2835_PADS_GPIO_0_27		(bcm2835_peri_base + 0x100000)
 #define BCM2835_PADS_GPIO_0_27_OFFSET	(0x2c / 4)
+#define BCM2835_PADS_SIZE		0x1000
 
 /* See "GPIO Function Select Registers (GPFSELn)" in "Broadcom BCM2835 ARM Peripherals" datasheet. */
 #define BCM2835_GPIO_MODE_INPUT 0
@@ -54,7 +57,6 @@ static off_t bcm2835_peri_base = 0x20000000;
 #define GPIO_CLR (*(pio_base + 10)) /* clears bits which are 1, ignores bits which are 0 */
 #define GPIO_LEV (*(pio_base + 13)) /* current level of the pin */
 
-static int dev_mem_fd;
 static volatile uint32_t *pio_base = MAP_FAILED;
 static volatile uint32_t *pads_base = MAP_FAILED;
 
@@ -207,6 +209,49 @@ static int bcm2835gpio_write(int tck, int tms, int tdi)
 	return ERROR_OK;
 }
 
+/* Shift a byte at a time, with the GPIO masks computed once per call */
+static int bcm2835gpio_shift(unsigned int num_bits, const uint8_t *tms,
+		const uint8_t *tdi, uint8_t *tdo)
+{
+	const uint32_t tck_mask = BIT(adapter_gpio_config[ADAPTER_GPIO_IDX_TCK].gpio_num);
+	const uint32_t tms_mask = BIT(adapter_gpio_config[ADAPTER_GPIO_IDX_TMS].gpio_num);
+	const uint32_t tdi_mask = BIT(adapter_gpio_config[ADAPTER_GPIO_IDX_TDI].gpio_num);
+	const uint32_t all_mask = tck_mask | tms_mask | tdi_mask;
+	const unsigned int tdo_shift = adapter_gpio_config[ADAPTER_GPIO_IDX_TDO].gpio_num;
+	const uint32_t tdo_invert = adapter_gpio_config[ADAPTER_GPIO_IDX_TDO].active_low ? 1 : 0;
+
+	for (unsigned int byte = 0; byte < DIV_ROUND_UP(num_bits, 8); byte++) {
+		unsigned int bits = MIN(num_bits - 8 * byte, 8);
+		uint8_t tms_byte = tms ? tms[byte] : 0;
+		uint8_t tdi_byte = tdi ? tdi[byte] : 0;
+		uint8_t tdo_byte = 0;
+
+		for (unsigned int i = 0; i < bits; i++) {
+			uint32_t set = ((tms_byte >> i) & 1 ? tms_mask : 0) |
+					((tdi_byte >> i) & 1 ? tdi_mask : 0);
+
+			GPIO_SET = set;
+			GPIO_CLR = all_mask & ~set;
+			bcm2835_gpio_synchronize();
+			bcm2835_delay();
+
+			if (tdo)
+				tdo_byte |= (((GPIO_LEV >> tdo_shift) & 1) ^ tdo_invert) << i;
+
+			GPIO_SET = tck_mask;
+			bcm2835_gpio_synchronize();
+			bcm2835_delay();
+		}
+
+		if (tdo) {
+			uint8_t mask = 0xff >> (8 - bits);
+			tdo[byte] = (tdo[byte] & ~mask) | tdo_byte;
+		}
+	}
+
+	return ERROR_OK;
+}
+
 /* Requires push-pull drive mode for swclk and swdio */
 static int bcm2835gpio_swd_write_fast(int swclk, int swdio)
 {
@@ -227,6 +272,43 @@ static int bcm2835gpio_swd_write_fast(int swclk, int swdio)
 	return ERROR_OK;
 }
 
+/* Requires push-pull drive mode for swclk and swdio, like the fast write */
+static int bcm2835gpio_swd_shift(unsigned int num_bits, const uint8_t *out,
+		uint8_t *in, unsigned int offset)
+{
+	const uint32_t swclk_mask = BIT(adapter_gpio_config[ADAPTER_GPIO_IDX_SWCLK].gpio_num);
+	const uint32_t swdio_mask = BIT(adapter_gpio_config[ADAPTER_GPIO_IDX_SWDIO].gpio_num);
+	const uint32_t all_mask = swclk_mask | swdio_mask;
+	const uint32_t swclk_low = adapter_gpio_config[ADAPTER_GPIO_IDX_SWCLK].active_low ? swclk_mask : 0;
+	const uint32_t swdio_invert = adapter_gpio_config[ADAPTER_GPIO_IDX_SWDIO].active_low ? swdio_mask : 0;
+
+	for (unsigned int i = offset; i < offset + num_bits; i++) {
+		uint8_t bit = BIT(i % 8);
+		uint32_t set = ((out && (out[i / 8] & bit)) ? swdio_mask : 0) ^ swdio_invert;
+
+		set |= swclk_low;
+		GPIO_SET = set;
+		GPIO_CLR = all_mask & ~set;
+		bcm2835_gpio_synchronize();
+		bcm2835_delay();
+
+		if (in) {
+			if ((GPIO_LEV ^ swdio_invert) & swdio_mask)
+				in[i / 8] |= bit;
+			else
+				in[i / 8] &= ~bit;
+		}
+
+		set ^= swclk_mask;
+		GPIO_SET = set;
+		GPIO_CLR = all_mask & ~set;
+		bcm2835_gpio_synchronize();
+		bcm2835_delay();
+	}
+
+	return ERROR_OK;
+}
+
 /* Generic mode that works for open-drain/open-source drive modes, but slower */
 static int bcm2835gpio_swd_write_generic(int swclk, int swdio)
 {
@@ -408,15 +490,11 @@ static bool bcm2835gpio_swd_mode_possible(void)
 
 static void bcm2835gpio_munmap(void)
 {
-	if (pio_base != MAP_FAILED) {
-		munmap((void *)pio_base, sysconf(_SC_PAGE_SIZE));
-		pio_base = MAP_FAILED;
-	}
+	mmap_gpio_unmap(pio_base, BCM2835_GPIO_SIZE);
+	pio_base = MAP_FAILED;
 
-	if (pads_base != MAP_FAILED) {
-		munmap((void *)pads_base, sysconf(_SC_PAGE_SIZE));
-		pads_base = MAP_FAILED;
-	}
+	mmap_gpio_unmap(pads_base, BCM2835_PADS_SIZE);
+	pads_base = MAP_FAILED;
 }
 
 static int bcm2835gpio_blink(bool on)
@@ -430,6 +508,7 @@ static int bcm2835gpio_blink(bool on)
 static struct bitbang_interface bcm2835gpio_bitbang = {
 	.read = bcm2835gpio_read,
 	.write = bcm2835gpio_write,
+	.shift = bcm2835gpio_shift,
 	.swdio_read = bcm2835_swdio_read,
 	.swdio_drive = bcm2835_swdio_drive,
 	.swd_write = bcm2835gpio_swd_write_generic,
@@ -456,9 +535,8 @@ static int bcm2835gpio_init(void)
 	bool is_gpiomem = strcmp(bcm2835_get_mem_dev(), "/dev/gpiomem") == 0;
 	bool pad_mapping_possible = !is_gpiomem;
 
-	dev_mem_fd = open(bcm2835_get_mem_dev(), O_RDWR | O_SYNC);
+	int dev_mem_fd = mmap_gpio_open(bcm2835_get_mem_dev());
 	if (dev_mem_fd < 0) {
-		LOG_ERROR("open %s: %s", bcm2835_get_mem_dev(), strerror(errno));
 		/* TODO: add /dev/mem specific doc and refer to it
 		 * if (!is_gpiomem && (errno == EACCES || errno == EPERM))
 		 *	LOG_INFO("Consult the user's guide chapter 4.? how to set permissions and capabilities");
@@ -466,22 +544,16 @@ static int bcm2835gpio_init(void)
 		return ERROR_JTAG_INIT_FAILED;
 	}
 
-	pio_base = mmap(NULL, sysconf(_SC_PAGE_SIZE), PROT_READ | PROT_WRITE,
-				MAP_SHARED, dev_mem_fd, BCM2835_GPIO_BASE);
-
+	pio_base = mmap_gpio_map(dev_mem_fd, BCM2835_GPIO_BASE, BCM2835_GPIO_SIZE);
 	if (pio_base == MAP_FAILED) {
-		LOG_ERROR("mmap: %s", strerror(errno));
 		close(dev_mem_fd);
 		return ERROR_JTAG_INIT_FAILED;
 	}
 
 	/* TODO: move pads config to a separate utility */
 	if (pad_mapping_possible) {
-		pads_base = mmap(NULL, sysconf(_SC_PAGE_SIZE), PROT_READ | PROT_WRITE,
-				MAP_SHARED, dev_mem_fd, BCM2835_PADS_GPIO_0_27);
-
+		pads_base = mmap_gpio_map(dev_mem_fd, BCM2835_PADS_GPIO_0_27, BCM2835_PADS_SIZE);
 		if (pads_base == MAP_FAILED) {
-			LOG_ERROR("mmap pads: %s", strerror(errno));
 			LOG_WARNING("Continuing with unchanged GPIO pad settings (drive strength and slew rate)");
 		}
 	} else {
@@ -530,9 +602,11 @@ LOG_INFO("pads conf set to %08x", pads_base[BCM2835_PADS_GPIO_0_27_OFFSET]);
 				adapter_gpio_config[ADAPTER_GPIO_IDX_SWDIO].drive == ADAPTER_GPIO_DRIVE_MODE_PUSH_PULL) {
 			LOG_DEBUG("BCM2835 GPIO using fast mode for SWD write");
 			bcm2835gpio_bitbang.swd_write = bcm2835gpio_swd_write_fast;
+			bcm2835gpio_bitbang.swd_shift = bcm2835gpio_swd_shift;
 		} else {
 			LOG_DEBUG("BCM2835 GPIO using generic mode for SWD write");
 			bcm2835gpio_bitbang.swd_write = bcm2835gpio_swd_write_generic;
+			bcm2835gpio_bitbang.swd_shift = NULL;
 		}
 	}
 
@@ -66,18 +66,82 @@ static void bitbang_end_state(enum tap_state state)
 	tap_set_end_state(state);
 }
 
+/**
+ * Clock num_bits with TMS and TDI taken from the bit arrays and sample TDO
+ * into tdo, see bitbang_interface::shift. Interfaces without the shift
+ * callback are driven one bit at a time through write() and read().
+ */
+static int bitbang_shift(unsigned int num_bits, const uint8_t *tms,
+		const uint8_t *tdi, uint8_t *tdo)
+{
+	if (bitbang_interface->shift)
+		return bitbang_interface->shift(num_bits, tms, tdi, tdo);
+
+	size_t buffered = 0;
+	for (unsigned int i = 0; i < num_bits; i++) {
+		int bytec = i / 8;
+		int bcval = 1 << (i % 8);
+		int tms_bit = tms && (tms[bytec] & bcval);
+		int tdi_bit = tdi && (tdi[bytec] & bcval);
+
+		if (bitbang_interface->write(0, tms_bit, tdi_bit) != ERROR_OK)
+			return ERROR_FAIL;
+
+		if (tdo) {
+			if (bitbang_interface->buf_size) {
+				if (bitbang_interface->sample() != ERROR_OK)
+					return ERROR_FAIL;
+				buffered++;
+			} else {
+				switch (bitbang_interface->read()) {
+					case BB_LOW:
+						tdo[bytec] &= ~bcval;
+						break;
+					case BB_HIGH:
+						tdo[bytec] |= bcval;
+						break;
+					default:
+						return ERROR_FAIL;
+				}
+			}
+		}
+
+		if (bitbang_interface->write(1, tms_bit, tdi_bit) != ERROR_OK)
+			return ERROR_FAIL;
+
+		if (tdo && bitbang_interface->buf_size &&
+				(buffered == bitbang_interface->buf_size || i == num_bits - 1)) {
+			for (unsigned int j = i + 1 - buffered; j <= i; j++) {
+				switch (bitbang_interface->read_sample()) {
+					case BB_LOW:
+						tdo[j / 8] &= ~(1 << (j % 8));
+						break;
+					case BB_HIGH:
+						tdo[j / 8] |= 1 << (j % 8);
+						break;
+					default:
+						return ERROR_FAIL;
+				}
+			}
+			buffered = 0;
+		}
+	}
+
+	return ERROR_OK;
+}
+
 static int bitbang_state_move(int skip)
 {
-	int i = 0, tms = 0;
 	uint8_t tms_scan = tap_get_tms_path(tap_get_state(), tap_get_end_state());
 	int tms_count = tap_get_tms_path_len(tap_get_state(), tap_get_end_state());
+	int tms = 0;
 
-	for (i = skip; i < tms_count; i++) {
-		tms = (tms_scan >> i) & 1;
-		if (bitbang_interface->write(0, tms, 0) != ERROR_OK)
-			return ERROR_FAIL;
-		if (bitbang_interface->write(1, tms, 0) != ERROR_OK)
+	if (skip < tms_count) {
+		uint8_t tms_bits = tms_scan >> skip;
+
+		if (bitbang_shift(tms_count - skip, &tms_bits, NULL, NULL) != ERROR_OK)
 			return ERROR_FAIL;
+		tms = (tms_scan >> (tms_count - 1)) & 1;
 	}
 	if (bitbang_interface->write(CLOCK_IDLE(), tms, 0) != ERROR_OK)
 		return ERROR_FAIL;
@@ -98,12 +162,10 @@ static int bitbang_execute_tms(struct jtag_command *cmd)
 	LOG_DEBUG_IO("TMS: %u bits", num_bits);
 
 	int tms = 0;
-	for (unsigned int i = 0; i < num_bits; i++) {
-		tms = ((bits[i/8] >> (i % 8)) & 1);
-		if (bitbang_interface->write(0, tms, 0) != ERROR_OK)
-			return ERROR_FAIL;
-		if (bitbang_interface->write(1, tms, 0) != ERROR_OK)
+	if (num_bits) {
+		if (bitbang_shift(num_bits, bits, NULL, NULL) != ERROR_OK)
 			return ERROR_FAIL;
+		tms = (bits[(num_bits - 1) / 8] >> ((num_bits - 1) % 8)) & 1;
 	}
 	if (bitbang_interface->write(CLOCK_IDLE(), tms, 0) != ERROR_OK)
 		return ERROR_FAIL;
@@ -159,12 +221,8 @@ static int bitbang_runtest(unsigned int num_cycles)
 	}
 
 	/* execute num_cycles */
-	for (unsigned int i = 0; i < num_cycles; i++) {
-		if (bitbang_interface->write(0, 0, 0) != ERROR_OK)
-			return ERROR_FAIL;
-		if (bitbang_interface->write(1, 0, 0) != ERROR_OK)
-			return ERROR_FAIL;
-	}
+	if (bitbang_shift(num_cycles, NULL, NULL, NULL) != ERROR_OK)
+		return ERROR_FAIL;
 	if (bitbang_interface->write(CLOCK_IDLE(), 0, 0) != ERROR_OK)
 		return ERROR_FAIL;
 
@@ -192,11 +250,35 @@ static int bitbang_stableclocks(unsigned int num_cycles)
 	return ERROR_OK;
 }
 
+/* Return a TMS bit array for a scan of num_bits, with only the last bit set */
+static uint8_t *bitbang_tms_buffer(unsigned int num_bits)
+{
+	static uint8_t *tms_buffer;
+	static unsigned int tms_buffer_bits;
+
+	if (num_bits > tms_buffer_bits) {
+		unsigned int size = MAX(num_bits, 2 * tms_buffer_bits);
+		uint8_t *buffer = realloc(tms_buffer, DIV_ROUND_UP(size, 8));
+
+		if (!buffer) {
+			LOG_ERROR("Out of memory");
+			return NULL;
+		}
+
+		tms_buffer = buffer;
+		tms_buffer_bits = size;
+	}
+
+	memset(tms_buffer, 0, DIV_ROUND_UP(num_bits, 8));
+	tms_buffer[(num_bits - 1) / 8] = 1 << ((num_bits - 1) % 8);
+
+	return tms_buffer;
+}
+
 static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer,
 		unsigned int scan_size)
 {
 	enum tap_state saved_end_state = tap_get_end_state();
-	unsigned int bit_cnt;
 
 	if (!((!ir_scan &&
 			(tap_get_state() == TAP_DRSHIFT)) ||
@@ -211,63 +293,20 @@ static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer,
 		bitbang_end_state(saved_end_state);
 	}
 
-	size_t buffered = 0;
-	for (bit_cnt = 0; bit_cnt < scan_size; bit_cnt++) {
-		int tms = (bit_cnt == scan_size-1) ? 1 : 0;
-		int tdi;
-		int bytec = bit_cnt/8;
-		int bcval = 1 << (bit_cnt % 8);
-
-		/* if we're just reading the scan, but don't care about the output
-		 * default to outputting 'low', this also makes valgrind traces more readable,
-		 * as it removes the dependency on an uninitialised value
-		 */
-		tdi = 0;
-		if ((type != SCAN_IN) && (buffer[bytec] & bcval))
-			tdi = 1;
+	/* TMS is set on the last bit only, to leave the shift state. If we're
+	 * just reading the scan, but don't care about the output, default to
+	 * outputting 'low', this also makes valgrind traces more readable, as
+	 * it removes the dependency on an uninitialised value.
+	 */
+	if (scan_size) {
+		uint8_t *tms = bitbang_tms_buffer(scan_size);
 
-		if (bitbang_interface->write(0, tms, tdi) != ERROR_OK)
+		if (!tms)
 			return ERROR_FAIL;
 
-		if (type != SCAN_OUT) {
-			if (bitbang_interface->buf_size) {
-				if (bitbang_interface->sample() != ERROR_OK)
-					return ERROR_FAIL;
-				buffered++;
-			} else {
-				switch (bitbang_interface->read()) {
-					case BB_LOW:
-						buffer[bytec] &= ~bcval;
-						break;
-					case BB_HIGH:
-						buffer[bytec] |= bcval;
-						break;
-					default:
-						return ERROR_FAIL;
-				}
-			}
-		}
-
-		if (bitbang_interface->write(1, tms, tdi) != ERROR_OK)
+		if (bitbang_shift(scan_size, tms, type != SCAN_IN ? buffer : NULL,
+					type != SCAN_OUT ? buffer : NULL) != ERROR_OK)
 			return ERROR_FAIL;
-
-		if (type != SCAN_OUT && bitbang_interface->buf_size &&
-				(buffered == bitbang_interface->buf_size ||
-				 bit_cnt == scan_size - 1)) {
-			for (unsigned int i = bit_cnt + 1 - buffered; i <= bit_cnt; i++) {
-				switch (bitbang_interface->read_sample()) {
-					case BB_LOW:
-						buffer[i/8] &= ~(1 << (i % 8));
-						break;
-					case BB_HIGH:
-						buffer[i/8] |= 1 << (i % 8);
-						break;
-					default:
-						return ERROR_FAIL;
-				}
-			}
-			buffered = 0;
-		}
 	}
 
 	if (tap_get_state() != tap_get_end_state()) {
@@ -399,21 +438,25 @@ static void bitbang_swd_exchange(bool rnw, uint8_t buf[], unsigned int offset, u
 		bitbang_interface->blink(true);
 	}
 
-	for (unsigned int i = offset; i < bit_cnt + offset; i++) {
-		int bytec = i/8;
-		int bcval = 1 << (i % 8);
-		int swdio = !rnw && (buf[bytec] & bcval);
-
-		bitbang_interface->swd_write(0, swdio);
+	if (bitbang_interface->swd_shift) {
+		bitbang_interface->swd_shift(bit_cnt, rnw ? NULL : buf, rnw ? buf : NULL, offset);
+	} else {
+		for (unsigned int i = offset; i < bit_cnt + offset; i++) {
+			int bytec = i/8;
+			int bcval = 1 << (i % 8);
+			int swdio = !rnw && (buf[bytec] & bcval);
+
+			bitbang_interface->swd_write(0, swdio);
+
+			if (rnw && buf) {
+				if (bitbang_interface->swdio_read())
+					buf[bytec] |= bcval;
+				else
+					buf[bytec] &= ~bcval;
+			}
 
-		if (rnw && buf) {
-			if (bitbang_interface->swdio_read())
-				buf[bytec] |= bcval;
-			else
-				buf[bytec] &= ~bcval;
+			bitbang_interface->swd_write(1, swdio);
 		}
-
-		bitbang_interface->swd_write(1, swdio);
 	}
 
 	if (bitbang_interface->blink) {
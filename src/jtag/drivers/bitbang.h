@@ -61,6 +61,34 @@ struct bitbang_interface {
 
 	/** Force a flush. */
 	int (*flush)(void);
+
+	/** Clock a sequence of bits (optional).
+	 *
+	 * For each bit TMS and TDI are set while TCK is low, TDO is sampled and
+	 * TCK is raised, so TCK is left high after the last bit. Bit i is
+	 * bit (i % 8) of byte (i / 8) in each of the buffers. A NULL @a tms or
+	 * @a tdi means all zeros, a NULL @a tdo means TDO is not needed. @a tdo
+	 * may be the same buffer as @a tdi, each TDI bit is used before the
+	 * TDO bit at the same position is stored.
+	 *
+	 * Implementing this lets the interface shift whole bytes per call
+	 * instead of going through write() and read() for every bit. */
+	int (*shift)(unsigned int num_bits, const uint8_t *tms, const uint8_t *tdi,
+			uint8_t *tdo);
+
+	/** Clock a sequence of SWD bits (optional).
+	 *
+	 * For each bit SWDIO is set while SWCLK is low, SWDIO is sampled and
+	 * SWCLK is raised, exactly as swd_write() and swdio_read() are used for
+	 * a single bit. The direction of SWDIO is not changed, the SWDIO output
+	 * is written even while it is not driven. Bit i is taken from and stored
+	 * to bit (offset + i) of the buffers. A NULL @a out means all zeros, a
+	 * NULL @a in means SWDIO is not sampled.
+	 *
+	 * Implementing this lets the interface clock each phase of a SWD
+	 * transaction in a single call. */
+	int (*swd_shift)(unsigned int num_bits, const uint8_t *out, uint8_t *in,
+			unsigned int offset);
 };
 
 extern const struct swd_driver bitbang_swd;
@@ -29,6 +29,7 @@
 
 #include <transport/transport.h>
 #include "helper/replacements.h"
+#include <helper/time_support.h>
 #include <jtag/adapter.h>
 #include <jtag/swd.h>
 #include <jtag/interface.h>
@@ -238,20 +239,25 @@ static unsigned int pending_queue_len;
 static unsigned int tfer_max_command_size;
 static unsigned int tfer_max_response_size;
 
-/* pointers to buffers that will receive jtag scan results on the next flush */
+/* pointers to buffers that will receive jtag scan results, one array for
+ * each packet of the FIFO. A CMD_DAP_JTAG_SEQ packet holds at most 255
+ * sequences. The count is for the packet being queued */
 #define MAX_PENDING_SCAN_RESULTS 256
 static int pending_scan_result_count;
-static struct pending_scan_result pending_scan_results[MAX_PENDING_SCAN_RESULTS];
+static struct pending_scan_result pending_scan_results[MAX_PENDING_REQUESTS][MAX_PENDING_SCAN_RESULTS];
 
 /* queued JTAG sequences that will be executed on the next flush */
 #define QUEUED_SEQ_BUF_LEN (cmsis_dap_handle->packet_usable_size - 3)
 static int queued_seq_count;
 static int queued_seq_buf_end;
 static int queued_seq_tdo_ptr;
-static uint8_t queued_seq_buf[1024]; /* TODO: make dynamic / move into cmsis object */
+static uint8_t *queued_seq_buf;
 
 static int queued_retval;
 
+/* Pipeline depth set by "cmsis-dap pipeline", 0 to tune it */
+static unsigned int cmsis_dap_pipeline_cfg;
+
 static uint8_t output_pins = SWJ_PIN_SRST | SWJ_PIN_TRST;
 
 static struct cmsis_dap *cmsis_dap_handle;
@@ -319,6 +325,9 @@ static void cmsis_dap_close(struct cmsis_dap *dap)
 		dap->pending_fifo[i].transfers = NULL;
 	}
 
+	free(queued_seq_buf);
+	queued_seq_buf = NULL;
+
 	free(cmsis_dap_handle);
 	cmsis_dap_handle = NULL;
 }
@@ -768,6 +777,82 @@ static int cmsis_dap_cmd_dap_swo_data(
 	return ERROR_OK;
 }
 
+/* Number of packets which may be pending at the same time */
+static unsigned int cmsis_dap_pipeline_limit(struct cmsis_dap *dap)
+{
+	if (dap->quirk_mode)
+		return 1;
+
+	return MIN(dap->pipeline_depth, dap->packet_count);
+}
+
+static int64_t cmsis_dap_average(int64_t average, int64_t sample)
+{
+	if (average)
+		sample = (7 * average + sample) / 8;
+
+	return MAX(sample, 1);
+}
+
+/* Account a packet sent from the FIFO block at the put index */
+static void cmsis_dap_pipeline_submitted(struct cmsis_dap *dap,
+		struct pending_request_block *block, unsigned int len)
+{
+	struct cmsis_dap_stats *stats = &dap->stats;
+	int64_t now = timeval_us();
+
+	block->submit_us = now;
+	block->submit_idle = !dap->pending_fifo_block_count;
+	if (block->submit_idle)
+		stats->busy_start_us = now;
+
+	stats->packets++;
+	stats->bytes_out += len;
+	stats->max_in_flight = MAX(stats->max_in_flight, dap->pending_fifo_block_count + 1);
+
+	switch (block->command) {
+	case CMD_DAP_TFER:
+		stats->tfer_packets++;
+		stats->transfers += block->transfer_count;
+		break;
+	case CMD_DAP_TFER_BLOCK:
+		stats->tfer_block_packets++;
+		stats->transfers += block->transfer_count;
+		break;
+	case CMD_DAP_JTAG_SEQ:
+		stats->jtag_seq_packets++;
+		break;
+	}
+}
+
+/* Account the response to the FIFO block at the get index and retune the
+ * pipeline depth. A packet sent to an idle adapter measures the latency,
+ * one sent before the response to the previous packet arrived measures
+ * the service time. Enough packets to cover the latency are kept in
+ * flight, plus one which is ready when the adapter finishes the current */
+static void cmsis_dap_pipeline_completed(struct cmsis_dap *dap,
+		const struct pending_request_block *block, unsigned int len)
+{
+	struct cmsis_dap_stats *stats = &dap->stats;
+	int64_t now = timeval_us();
+
+	stats->bytes_in += len;
+	if (dap->pending_fifo_block_count == 1)
+		stats->busy_us += now - stats->busy_start_us;
+
+	if (block->submit_idle)
+		dap->latency_us = cmsis_dap_average(dap->latency_us, now - block->submit_us);
+	else if (dap->last_response_us >= block->submit_us)
+		dap->service_us = cmsis_dap_average(dap->service_us, now - dap->last_response_us);
+	dap->last_response_us = now;
+
+	if (cmsis_dap_pipeline_cfg || !dap->latency_us || !dap->service_us)
+		return;
+
+	unsigned int depth = DIV_ROUND_UP(dap->latency_us, dap->service_us) + 1;
+	dap->pipeline_depth = MIN(depth, dap->packet_count);
+}
+
 static void cmsis_dap_swd_discard_all_pending(struct cmsis_dap *dap)
 {
 	for (unsigned int i = 0; i < MAX_PENDING_REQUESTS; i++)
@@ -870,6 +955,8 @@ static void cmsis_dap_swd_write_from_queue(struct cmsis_dap *dap)
 		goto skip;
 	}
 
+	cmsis_dap_pipeline_submitted(dap, block, idx);
+
 	unsigned int packet_count = dap->quirk_mode ? 1 : dap->packet_count;
 	dap->pending_fifo_put_idx = (dap->pending_fifo_put_idx + 1) % packet_count;
 	dap->pending_fifo_block_count++;
@@ -962,6 +1049,8 @@ static void cmsis_dap_swd_read_process(struct cmsis_dap *dap, enum cmsis_dap_blo
 		return;
 	}
 
+	cmsis_dap_pipeline_completed(dap, block, retval);
+
 	LOG_DEBUG_IO("Received results of %d queued transactions FIFO index %u, %s mode",
 				 transfer_count, dap->pending_fifo_get_idx,
 				 blocking ? "blocking" : "nonblocking");
@@ -1086,8 +1175,8 @@ static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
 		/* Not enough room in the queue. Run the queue. */
 		cmsis_dap_swd_write_from_queue(cmsis_dap_handle);
 
-		unsigned int packet_count = cmsis_dap_handle->quirk_mode ? 1 : cmsis_dap_handle->packet_count;
-		if (cmsis_dap_handle->pending_fifo_block_count >= packet_count)
+		while (cmsis_dap_handle->pending_fifo_block_count
+				>= cmsis_dap_pipeline_limit(cmsis_dap_handle))
 			cmsis_dap_swd_read_process(cmsis_dap_handle, CMSIS_DAP_BLOCKING);
 	}
 
@@ -1398,6 +1487,10 @@ static int cmsis_dap_init(void)
 		LOG_DEBUG("CMSIS-DAP: Packet Count = %u", pkt_cnt);
 	}
 
+	/* Start with all packets in flight until the timing is measured */
+	cmsis_dap_handle->pipeline_depth = cmsis_dap_pipeline_cfg ? cmsis_dap_pipeline_cfg
+		: cmsis_dap_handle->packet_count;
+
 	LOG_DEBUG("Allocating FIFO for %u pending packets", cmsis_dap_handle->packet_count);
 	for (unsigned int i = 0; i < cmsis_dap_handle->packet_count; i++) {
 		cmsis_dap_handle->pending_fifo[i].transfers = malloc(pending_queue_len
@@ -1409,6 +1502,15 @@ static int cmsis_dap_init(void)
 		}
 	}
 
+	if (!swd_mode) {
+		queued_seq_buf = malloc(cmsis_dap_handle->packet_usable_size);
+		if (!queued_seq_buf) {
+			LOG_ERROR("Unable to allocate memory for CMSIS-DAP queue");
+			retval = ERROR_FAIL;
+			goto init_err;
+		}
+	}
+
 	/* Intentionally not checked for error, just logs an info message
 	 * not vital for further debugging */
 	(void)cmsis_dap_get_status();
@@ -1594,6 +1696,51 @@ static void debug_parse_cmsis_buf(const uint8_t *cmd, int cmdlen)
 }
 #endif
 
+/* Receive the response to the oldest pending CMD_DAP_JTAG_SEQ packet and
+ * copy its scan results into the client buffers */
+static void cmsis_dap_jtag_read_process(struct cmsis_dap *dap)
+{
+	struct pending_request_block *block = &dap->pending_fifo[dap->pending_fifo_get_idx];
+	struct pending_scan_result *scans = pending_scan_results[dap->pending_fifo_get_idx];
+
+	int retval = dap->backend->read(dap, LIBUSB_TIMEOUT_MS, CMSIS_DAP_BLOCKING);
+
+	uint8_t *resp = dap->response;
+	if (retval <= 0 || resp[0] != CMD_DAP_JTAG_SEQ || resp[1] != DAP_OK) {
+		LOG_ERROR("CMSIS-DAP command CMD_DAP_JTAG_SEQ failed.");
+		exit(-1);
+	}
+
+	cmsis_dap_pipeline_completed(dap, block, retval);
+
+#ifdef CMSIS_DAP_JTAG_DEBUG
+	LOG_DEBUG_IO("USB response buf:");
+	for (int c = 0; c < retval; ++c)
+		printf("%02X ", resp[c]);
+	printf("\n");
+#endif
+
+	/* copy scan results into client buffers */
+	for (unsigned int i = 0; i < block->transfer_count; ++i) {
+		struct pending_scan_result *scan = &scans[i];
+		LOG_DEBUG_IO("Copying pending_scan_result %u/%u: %d bits from byte %d -> buffer + %d bits",
+			i, block->transfer_count, scan->length, scan->first + 2, scan->buffer_offset);
+#ifdef CMSIS_DAP_JTAG_DEBUG
+		for (uint32_t b = 0; b < DIV_ROUND_UP(scan->length, 8); ++b)
+			printf("%02X ", resp[2+scan->first+b]);
+		printf("\n");
+#endif
+		bit_copy(scan->buffer, scan->buffer_offset, &resp[2 + scan->first], 0, scan->length);
+	}
+
+	block->transfer_count = 0;
+	if (!dap->quirk_mode && dap->packet_count > 1)
+		dap->pending_fifo_get_idx = (dap->pending_fifo_get_idx + 1) % dap->packet_count;
+	dap->pending_fifo_block_count--;
+}
+
+/* Send the queued sequences. Up to the pipeline depth packets are left
+ * pending, their scan results are copied when the responses are read */
 static void cmsis_dap_flush(void)
 {
 	if (!queued_seq_count)
@@ -1602,8 +1749,11 @@ static void cmsis_dap_flush(void)
 	LOG_DEBUG_IO("Flushing %d queued sequences (%d bytes) with %d pending scan results to capture",
 		queued_seq_count, queued_seq_buf_end, pending_scan_result_count);
 
+	struct cmsis_dap *dap = cmsis_dap_handle;
+	struct pending_request_block *block = &dap->pending_fifo[dap->pending_fifo_put_idx];
+
 	/* prepare CMSIS-DAP packet */
-	uint8_t *command = cmsis_dap_handle->command;
+	uint8_t *command = dap->command;
 	command[0] = CMD_DAP_JTAG_SEQ;
 	command[1] = queued_seq_count;
 	memcpy(&command[2], queued_seq_buf, queued_seq_buf_end);
@@ -1612,40 +1762,42 @@ static void cmsis_dap_flush(void)
 	debug_parse_cmsis_buf(command, queued_seq_buf_end + 2);
 #endif
 
-	/* send command to USB device */
-	int retval = cmsis_dap_xfer(cmsis_dap_handle, queued_seq_buf_end + 2);
+	block->command = CMD_DAP_JTAG_SEQ;
+	block->transfer_count = pending_scan_result_count;
 
-	uint8_t *resp = cmsis_dap_handle->response;
-	if (retval != ERROR_OK || resp[1] != DAP_OK) {
+	/* send command to USB device */
+	int retval = dap->backend->write(dap, queued_seq_buf_end + 2, LIBUSB_TIMEOUT_MS);
+	if (retval < 0) {
 		LOG_ERROR("CMSIS-DAP command CMD_DAP_JTAG_SEQ failed.");
 		exit(-1);
 	}
 
-#ifdef CMSIS_DAP_JTAG_DEBUG
-	LOG_DEBUG_IO("USB response buf:");
-	for (int c = 0; c < queued_seq_buf_end + 3; ++c)
-		printf("%02X ", resp[c]);
-	printf("\n");
-#endif
+	cmsis_dap_pipeline_submitted(dap, block, queued_seq_buf_end + 2);
 
-	/* copy scan results into client buffers */
-	for (int i = 0; i < pending_scan_result_count; ++i) {
-		struct pending_scan_result *scan = &pending_scan_results[i];
-		LOG_DEBUG_IO("Copying pending_scan_result %d/%d: %d bits from byte %d -> buffer + %d bits",
-			i, pending_scan_result_count, scan->length, scan->first + 2, scan->buffer_offset);
-#ifdef CMSIS_DAP_JTAG_DEBUG
-		for (uint32_t b = 0; b < DIV_ROUND_UP(scan->length, 8); ++b)
-			printf("%02X ", resp[2+scan->first+b]);
-		printf("\n");
-#endif
-		bit_copy(scan->buffer, scan->buffer_offset, &resp[2 + scan->first], 0, scan->length);
-	}
+	unsigned int packet_count = dap->quirk_mode ? 1 : dap->packet_count;
+	dap->pending_fifo_put_idx = (dap->pending_fifo_put_idx + 1) % packet_count;
+	dap->pending_fifo_block_count++;
 
 	/* reset */
 	queued_seq_count = 0;
 	queued_seq_buf_end = 0;
 	queued_seq_tdo_ptr = 0;
 	pending_scan_result_count = 0;
+
+	while (dap->pending_fifo_block_count >= cmsis_dap_pipeline_limit(dap))
+		cmsis_dap_jtag_read_process(dap);
+}
+
+/* Send the queued sequences and wait for all responses */
+static void cmsis_dap_jtag_sync(void)
+{
+	cmsis_dap_flush();
+
+	while (cmsis_dap_handle->pending_fifo_block_count)
+		cmsis_dap_jtag_read_process(cmsis_dap_handle);
+
+	cmsis_dap_handle->pending_fifo_put_idx = 0;
+	cmsis_dap_handle->pending_fifo_get_idx = 0;
 }
 
 /* queue a sequence of bits to clock out TDI / in TDO, executing if the buffer is full.
@@ -1705,7 +1857,8 @@ static void cmsis_dap_add_jtag_sequence(unsigned int s_len, const uint8_t *seque
 	queued_seq_buf_end += cmd_len;
 
 	if (tdo_buffer) {
-		struct pending_scan_result *scan = &pending_scan_results[pending_scan_result_count++];
+		struct pending_scan_result *scan =
+			&pending_scan_results[cmsis_dap_handle->pending_fifo_put_idx][pending_scan_result_count++];
 		scan->first = queued_seq_tdo_ptr;
 		queued_seq_tdo_ptr += DIV_ROUND_UP(s_len, 8);
 		scan->length = s_len;
@@ -1931,11 +2084,11 @@ static void cmsis_dap_execute_command(struct jtag_command *cmd)
 {
 	switch (cmd->type) {
 		case JTAG_SLEEP:
-			cmsis_dap_flush();
+			cmsis_dap_jtag_sync();
 			cmsis_dap_execute_sleep(cmd);
 			break;
 		case JTAG_TLR_RESET:
-			cmsis_dap_flush();
+			cmsis_dap_jtag_sync();
 			cmsis_dap_execute_tlr_reset(cmd);
 			break;
 		case JTAG_SCAN:
@@ -1951,6 +2104,7 @@ static void cmsis_dap_execute_command(struct jtag_command *cmd)
 			cmsis_dap_execute_stableclocks(cmd);
 			break;
 		case JTAG_TMS:
+			cmsis_dap_jtag_sync();
 			cmsis_dap_execute_tms(cmd);
 			break;
 		default:
@@ -1968,7 +2122,7 @@ static int cmsis_dap_execute_queue(struct jtag_command *cmd_queue)
 		cmd = cmd->next;
 	}
 
-	cmsis_dap_flush();
+	cmsis_dap_jtag_sync();
 
 	return ERROR_OK;
 }
@@ -2246,6 +2400,84 @@ COMMAND_HANDLER(cmsis_dap_handle_quirk_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(cmsis_dap_handle_pipeline_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int depth = 0;
+		if (strcmp(CMD_ARGV[0], "auto") != 0) {
+			COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], depth);
+			if (depth < 1 || depth > MAX_PENDING_REQUESTS) {
+				command_print(CMD, "pipeline depth must be 'auto' or 1 to %d",
+					MAX_PENDING_REQUESTS);
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			}
+		}
+
+		cmsis_dap_pipeline_cfg = depth;
+		if (cmsis_dap_handle)
+			cmsis_dap_handle->pipeline_depth = depth ? depth : cmsis_dap_handle->packet_count;
+	}
+
+	if (!cmsis_dap_handle) {
+		if (cmsis_dap_pipeline_cfg)
+			command_print(CMD, "CMSIS-DAP pipeline depth %u", cmsis_dap_pipeline_cfg);
+		else
+			command_print(CMD, "CMSIS-DAP pipeline depth auto");
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "CMSIS-DAP pipeline depth %u of %u packets (%s), "
+		"latency %" PRId64 " us, service time %" PRId64 " us",
+		cmsis_dap_pipeline_limit(cmsis_dap_handle), cmsis_dap_handle->packet_count,
+		cmsis_dap_pipeline_cfg ? "fixed" : "auto",
+		cmsis_dap_handle->latency_us, cmsis_dap_handle->service_us);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(cmsis_dap_handle_stats_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct cmsis_dap_stats *stats = &cmsis_dap_handle->stats;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset") != 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		memset(stats, 0, sizeof(*stats));
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "packets: %" PRIu64 " (DAP_Transfer %" PRIu64
+		", DAP_TransferBlock %" PRIu64 ", DAP_JTAG_Sequence %" PRIu64 ")",
+		stats->packets, stats->tfer_packets, stats->tfer_block_packets,
+		stats->jtag_seq_packets);
+	command_print(CMD, "transfers: %" PRIu64, stats->transfers);
+	command_print(CMD, "bytes: %" PRIu64 " sent, %" PRIu64 " received",
+		stats->bytes_out, stats->bytes_in);
+
+	if (stats->busy_us) {
+		command_print(CMD, "busy: %" PRId64 " us, %" PRIu64 " packets/s, %"
+			PRIu64 " transfers/s, %" PRIu64 " bytes/s",
+			stats->busy_us,
+			stats->packets * 1000000 / stats->busy_us,
+			stats->transfers * 1000000 / stats->busy_us,
+			(stats->bytes_out + stats->bytes_in) * 1000000 / stats->busy_us);
+	}
+
+	command_print(CMD, "in flight: at most %u, depth %u, latency %" PRId64
+		" us, service time %" PRId64 " us",
+		stats->max_in_flight, cmsis_dap_pipeline_limit(cmsis_dap_handle),
+		cmsis_dap_handle->latency_us, cmsis_dap_handle->service_us);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration cmsis_dap_subcommand_handlers[] = {
 	{
 		.name = "info",
@@ -2282,6 +2514,20 @@ static const struct command_registration cmsis_dap_subcommand_handlers[] = {
 		.help = "allow expensive workarounds of known adapter quirks.",
 		.usage = "[enable | disable]",
 	},
+	{
+		.name = "pipeline",
+		.handler = &cmsis_dap_handle_pipeline_command,
+		.mode = COMMAND_ANY,
+		.help = "set the number of packets kept in flight or let it be tuned.",
+		.usage = "[auto | depth]",
+	},
+	{
+		.name = "stats",
+		.handler = &cmsis_dap_handle_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "show or reset the packet and transfer counters.",
+		.usage = "['reset']",
+	},
 #if BUILD_CMSIS_DAP_USB
 	{
 		.name = "usb",
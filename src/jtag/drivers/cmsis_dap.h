@@ -3,6 +3,7 @@
 #ifndef OPENOCD_JTAG_DRIVERS_CMSIS_DAP_H
 #define OPENOCD_JTAG_DRIVERS_CMSIS_DAP_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 struct cmsis_dap_backend;
@@ -16,12 +17,31 @@ struct pending_transfer_result {
 
 /* Up to MIN(packet_count, MAX_PENDING_REQUESTS) requests may be issued
  * until the first response arrives */
-#define MAX_PENDING_REQUESTS 4
+#define MAX_PENDING_REQUESTS 8
 
 struct pending_request_block {
 	struct pending_transfer_result *transfers;
+	/* SWD transfers or JTAG scan results in the block */
 	unsigned int transfer_count;
 	uint8_t command;
+	/* Time the packet was sent and whether no other packet was pending */
+	int64_t submit_us;
+	bool submit_idle;
+};
+
+/* Counters reported by "cmsis-dap stats" */
+struct cmsis_dap_stats {
+	uint64_t packets;
+	uint64_t tfer_packets;
+	uint64_t tfer_block_packets;
+	uint64_t jtag_seq_packets;
+	uint64_t transfers;
+	uint64_t bytes_out;
+	uint64_t bytes_in;
+	/* Time with at least one packet pending */
+	int64_t busy_us;
+	int64_t busy_start_us;
+	unsigned int max_in_flight;
 };
 
 struct cmsis_dap {
@@ -51,6 +71,18 @@ struct cmsis_dap {
 	unsigned int pending_fifo_put_idx, pending_fifo_get_idx;
 	unsigned int pending_fifo_block_count;
 
+	/* Number of packets kept in flight, at most packet_count. Unless set
+	 * by "cmsis-dap pipeline", it is tuned from the response time of a
+	 * packet sent to an idle adapter (latency) and the interval between
+	 * responses to back-to-back packets (service time), so that the adapter
+	 * does not wait for the next packet while a response travels back */
+	unsigned int pipeline_depth;
+	int64_t latency_us;
+	int64_t service_us;
+	int64_t last_response_us;
+
+	struct cmsis_dap_stats stats;
+
 	uint16_t caps;
 	bool quirk_mode;	/* enable expensive workarounds */
 
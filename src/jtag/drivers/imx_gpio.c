@@ -13,6 +13,7 @@
 #include <jtag/interface.h>
 #include <transport/transport.h>
 #include "bitbang.h"
+#include "mmap_gpio.h"
 
 #include <sys/mman.h>
 
@@ -33,8 +34,7 @@ struct imx_gpio_regs {
 	uint32_t edge_sel;
 } __attribute__((aligned(IMX_GPIO_SIZE)));
 
-static int dev_mem_fd;
-static volatile struct imx_gpio_regs *pio_base;
+static volatile struct imx_gpio_regs *pio_base = MAP_FAILED;
 
 /* GPIO setup functions */
 static inline bool gpio_mode_get(int g)
@@ -478,23 +478,18 @@ static int imx_gpio_init(void)
 		return ERROR_JTAG_INIT_FAILED;
 	}
 
-	dev_mem_fd = open("/dev/mem", O_RDWR | O_SYNC);
-	if (dev_mem_fd < 0) {
-		LOG_ERROR("open: %s", strerror(errno));
+	int dev_mem_fd = mmap_gpio_open("/dev/mem");
+	if (dev_mem_fd < 0)
 		return ERROR_JTAG_INIT_FAILED;
-	}
 
 	LOG_INFO("imx_gpio mmap: pagesize: %u, regionsize: %u",
 			(unsigned int) sysconf(_SC_PAGE_SIZE), IMX_GPIO_REGS_COUNT * IMX_GPIO_SIZE);
-	pio_base = mmap(NULL, IMX_GPIO_REGS_COUNT * IMX_GPIO_SIZE,
-				PROT_READ | PROT_WRITE,
-				MAP_SHARED, dev_mem_fd, imx_gpio_peri_base);
-
+	pio_base = mmap_gpio_map(dev_mem_fd, imx_gpio_peri_base, IMX_GPIO_REGS_COUNT * IMX_GPIO_SIZE);
 	if (pio_base == MAP_FAILED) {
-		LOG_ERROR("mmap: %s", strerror(errno));
 		close(dev_mem_fd);
 		return ERROR_JTAG_INIT_FAILED;
 	}
+	close(dev_mem_fd);
 
 	/*
 	 * Configure TDO as an input, and TDI, TCK, TMS, TRST, SRST
@@ -565,5 +560,8 @@ static int imx_gpio_quit(void)
 	if (srst_gpio != -1)
 		gpio_mode_set(srst_gpio, srst_gpio_mode);
 
+	mmap_gpio_unmap(pio_base, IMX_GPIO_REGS_COUNT * IMX_GPIO_SIZE);
+	pio_base = MAP_FAILED;
+
 	return ERROR_OK;
 }
@@ -37,6 +37,19 @@
 #define CMD_SCAN_CHAIN		2
 #define CMD_SCAN_CHAIN_FLIP_TMS	3
 #define CMD_STOP_SIMU		4
+#define CMD_BATCH		5
+
+/*
+ * A CMD_BATCH message carries the commands of a whole JTAG queue. It starts
+ * with the u32 values CMD_BATCH, the number of commands and the number of
+ * bytes that follow. Each command is sent as u32 cmd, u32 nb_bits and the
+ * nb_bits bits of buffer_out, without padding. The server answers with the
+ * u32 number of bytes that follow and the buffer_in bits of each scan chain
+ * command of the batch, in order, once it has received the whole batch.
+ * All values are little endian.
+ */
+#define BATCH_HEADER_SIZE	12
+#define BATCH_CMD_HEADER_SIZE	8
 
 /* jtag_vpi server port and address to connect to */
 static int server_port = DEFAULT_SERVER_PORT;
@@ -45,6 +58,9 @@ static char *server_address;
 /* Send CMD_STOP_SIMU to server when OpenOCD exits? */
 static bool stop_sim_on_exit;
 
+/* Send each JTAG queue as one CMD_BATCH message? */
+static bool batch_mode;
+
 static int sockfd;
 static struct sockaddr_in serv_addr;
 
@@ -66,6 +82,24 @@ struct vpi_cmd {
 	};
 };
 
+/* Where the buffer_in bits of a scan chain command of the batch go */
+struct batch_reply {
+	/* NULL to drop the bits */
+	uint8_t *buf;
+	unsigned int length;
+	/* scan to complete from buf once the batch was answered, or NULL */
+	struct scan_command *scan;
+};
+
+static uint8_t *batch_buf;
+static size_t batch_used;
+static size_t batch_size;
+static unsigned int batch_num_cmds;
+
+static struct batch_reply *batch_replies;
+static unsigned int batch_num_replies;
+static unsigned int batch_replies_size;
+
 static char *jtag_vpi_cmd_to_str(int cmd_num)
 {
 	switch (cmd_num) {
@@ -79,6 +113,8 @@ static char *jtag_vpi_cmd_to_str(int cmd_num)
 		return "CMD_SCAN_CHAIN_FLIP_TMS";
 	case CMD_STOP_SIMU:
 		return "CMD_STOP_SIMU";
+	case CMD_BATCH:
+		return "CMD_BATCH";
 	default:
 		return "<unknown>";
 	}
@@ -195,6 +231,212 @@ static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
 	return ERROR_OK;
 }
 
+static int jtag_vpi_write_all(const uint8_t *buf, size_t size)
+{
+	while (size) {
+		int retval = write_socket(sockfd, buf, size);
+		if (retval < 0) {
+#ifdef _WIN32
+			if (WSAGetLastError() == WSAEINTR)
+				continue;
+#else
+			if (errno == EINTR)
+				continue;
+#endif
+			log_socket_error("jtag_vpi xmit");
+			return ERROR_FAIL;
+		}
+		buf += retval;
+		size -= retval;
+	}
+
+	return ERROR_OK;
+}
+
+/* Receive size bytes into buf, or drop them if buf is NULL */
+static int jtag_vpi_read_all(uint8_t *buf, size_t size)
+{
+	uint8_t discard[256];
+
+	while (size) {
+		uint8_t *dest = buf ? buf : discard;
+		size_t count = buf ? size : MIN(size, sizeof(discard));
+		int retval = read_socket(sockfd, dest, count);
+		if (retval < 0) {
+#ifdef _WIN32
+			if (WSAGetLastError() == WSAEINTR)
+				continue;
+#else
+			if (errno == EINTR)
+				continue;
+#endif
+			log_socket_error("jtag_vpi recv");
+			return ERROR_FAIL;
+		} else if (retval == 0) {
+			LOG_ERROR("Connection prematurely closed by jtag_vpi server.");
+			return ERROR_FAIL;
+		}
+		if (buf)
+			buf += retval;
+		size -= retval;
+	}
+
+	return ERROR_OK;
+}
+
+/* Make room for size more bytes in the batch, returns where they go */
+static uint8_t *jtag_vpi_batch_reserve(size_t size)
+{
+	if (batch_used + size > batch_size) {
+		size_t new_size = MAX(batch_used + size, 2 * batch_size);
+		uint8_t *buf = realloc(batch_buf, new_size);
+
+		if (!buf) {
+			LOG_ERROR("Out of memory");
+			return NULL;
+		}
+
+		batch_buf = buf;
+		batch_size = new_size;
+	}
+
+	uint8_t *ptr = batch_buf + batch_used;
+	batch_used += size;
+	return ptr;
+}
+
+/**
+ * jtag_vpi_batch_add - append a command to the batch
+ * @param cmd the jtag_vpi command
+ * @param bits buffer_out bits of the command (or NULL to send all ones)
+ * @param nb_bits number of bits
+ */
+static int jtag_vpi_batch_add(uint32_t cmd, const uint8_t *bits, unsigned int nb_bits)
+{
+	unsigned int nb_bytes = DIV_ROUND_UP(nb_bits, 8);
+
+	if (batch_used == 0 && !jtag_vpi_batch_reserve(BATCH_HEADER_SIZE))
+		return ERROR_FAIL;
+
+	uint8_t *ptr = jtag_vpi_batch_reserve(BATCH_CMD_HEADER_SIZE + nb_bytes);
+	if (!ptr)
+		return ERROR_FAIL;
+
+	h_u32_to_le(ptr, cmd);
+	h_u32_to_le(ptr + 4, nb_bits);
+	if (bits)
+		memcpy(ptr + BATCH_CMD_HEADER_SIZE, bits, nb_bytes);
+	else
+		memset(ptr + BATCH_CMD_HEADER_SIZE, 0xff, nb_bytes);
+
+	batch_num_cmds++;
+	return ERROR_OK;
+}
+
+/**
+ * jtag_vpi_batch_queue_tdi - append a scan chain command to the batch
+ * @param bits bits to be queued on TDI, replaced by the TDO bits once the
+ * batch is answered (or NULL to send ones and drop the TDO bits)
+ * @param nb_bits number of bits
+ * @param tap_shift
+ * @param scan the scan to complete once the batch is answered (or NULL)
+ */
+static int jtag_vpi_batch_queue_tdi(uint8_t *bits, unsigned int nb_bits, int tap_shift,
+		struct scan_command *scan)
+{
+	if (batch_num_replies == batch_replies_size) {
+		unsigned int size = batch_replies_size ? 2 * batch_replies_size : 64;
+		struct batch_reply *replies = realloc(batch_replies, size * sizeof(*replies));
+
+		if (!replies) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+
+		batch_replies = replies;
+		batch_replies_size = size;
+	}
+
+	int retval = jtag_vpi_batch_add(tap_shift ? CMD_SCAN_CHAIN_FLIP_TMS : CMD_SCAN_CHAIN,
+			bits, nb_bits);
+	if (retval != ERROR_OK)
+		return retval;
+
+	batch_replies[batch_num_replies++] = (struct batch_reply) {
+		.buf = bits,
+		.length = DIV_ROUND_UP(nb_bits, 8),
+		.scan = scan,
+	};
+
+	return ERROR_OK;
+}
+
+/* Forget the batch, releasing the buffers of its scans */
+static void jtag_vpi_batch_discard(void)
+{
+	for (unsigned int i = 0; i < batch_num_replies; i++) {
+		if (batch_replies[i].scan)
+			free(batch_replies[i].buf);
+	}
+
+	batch_used = 0;
+	batch_num_cmds = 0;
+	batch_num_replies = 0;
+}
+
+/**
+ * jtag_vpi_batch_flush - send the batch and wait for its answer
+ *
+ * Returns ERROR_OK if OK, ERROR_JTAG_QUEUE_FAILED if a scan check failed or
+ * ERROR_xxx if a read/write error occurred.
+ */
+static int jtag_vpi_batch_flush(void)
+{
+	if (!batch_num_cmds)
+		return ERROR_OK;
+
+	size_t expected = 0;
+	for (unsigned int i = 0; i < batch_num_replies; i++)
+		expected += batch_replies[i].length;
+
+	h_u32_to_le(batch_buf, CMD_BATCH);
+	h_u32_to_le(batch_buf + 4, batch_num_cmds);
+	h_u32_to_le(batch_buf + 8, batch_used - BATCH_HEADER_SIZE);
+
+	LOG_DEBUG_IO("sending JTAG VPI batch: %u commands, %zu bytes, %zu bytes expected",
+			batch_num_cmds, batch_used, expected);
+
+	int retval = jtag_vpi_write_all(batch_buf, batch_used);
+
+	uint8_t length_buf[4];
+	if (retval == ERROR_OK)
+		retval = jtag_vpi_read_all(length_buf, sizeof(length_buf));
+
+	if (retval == ERROR_OK && le_to_h_u32(length_buf) != expected) {
+		LOG_ERROR("jtag_vpi: batch answer of %" PRIu32 " bytes, expected %zu",
+				le_to_h_u32(length_buf), expected);
+		retval = ERROR_FAIL;
+	}
+
+	for (unsigned int i = 0; retval == ERROR_OK && i < batch_num_replies; i++)
+		retval = jtag_vpi_read_all(batch_replies[i].buf, batch_replies[i].length);
+
+	if (retval != ERROR_OK) {
+		jtag_vpi_batch_discard();
+		return retval;
+	}
+
+	for (unsigned int i = 0; i < batch_num_replies; i++) {
+		struct batch_reply *reply = &batch_replies[i];
+
+		if (reply->scan && jtag_read_buffer(reply->buf, reply->scan) != ERROR_OK)
+			retval = ERROR_JTAG_QUEUE_FAILED;
+	}
+
+	jtag_vpi_batch_discard();
+	return retval;
+}
+
 /**
  * jtag_vpi_reset - ask to reset the JTAG device
  * @param trst 1 if TRST is to be asserted
@@ -203,6 +445,10 @@ static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
 static int jtag_vpi_reset(int trst, int srst)
 {
 	struct vpi_cmd vpi;
+
+	if (batch_mode)
+		return jtag_vpi_batch_add(CMD_RESET, NULL, 0);
+
 	memset(&vpi, 0, sizeof(struct vpi_cmd));
 
 	vpi.cmd = CMD_RESET;
@@ -226,6 +472,9 @@ static int jtag_vpi_tms_seq(const uint8_t *bits, int nb_bits)
 	struct vpi_cmd vpi;
 	int nb_bytes;
 
+	if (batch_mode)
+		return jtag_vpi_batch_add(CMD_TMS_SEQ, bits, nb_bits);
+
 	memset(&vpi, 0, sizeof(struct vpi_cmd));
 	nb_bytes = DIV_ROUND_UP(nb_bits, 8);
 
@@ -340,6 +589,9 @@ static int jtag_vpi_queue_tdi(uint8_t *bits, int nb_bits, int tap_shift)
 	int nb_xfer = DIV_ROUND_UP(nb_bits, XFERT_MAX_SIZE * 8);
 	int retval;
 
+	if (batch_mode)
+		return jtag_vpi_batch_queue_tdi(bits, nb_bits, tap_shift, NULL);
+
 	while (nb_xfer) {
 		if (nb_xfer ==  1) {
 			retval = jtag_vpi_queue_tdi_xfer(bits, nb_bits, tap_shift);
@@ -400,7 +652,15 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 			return retval;
 	}
 
-	if (cmd->end_state == TAP_DRSHIFT) {
+	if (batch_mode) {
+		/* the scan is completed when the batch is answered */
+		retval = jtag_vpi_batch_queue_tdi(buf, scan_bits,
+				cmd->end_state == TAP_DRSHIFT ? NO_TAP_SHIFT : TAP_SHIFT, cmd);
+		if (retval != ERROR_OK) {
+			free(buf);
+			return retval;
+		}
+	} else if (cmd->end_state == TAP_DRSHIFT) {
 		retval = jtag_vpi_queue_tdi(buf, scan_bits, NO_TAP_SHIFT);
 		if (retval != ERROR_OK)
 			return retval;
@@ -425,11 +685,13 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 			tap_set_state(TAP_DRPAUSE);
 	}
 
-	retval = jtag_read_buffer(buf, cmd);
-	if (retval != ERROR_OK)
-		return retval;
+	if (!batch_mode) {
+		retval = jtag_read_buffer(buf, cmd);
+		if (retval != ERROR_OK)
+			return retval;
 
-	free(buf);
+		free(buf);
+	}
 
 	if (cmd->end_state != TAP_DRSHIFT) {
 		retval = jtag_vpi_state_move(cmd->end_state);
@@ -506,6 +768,8 @@ static int jtag_vpi_execute_queue(struct jtag_command *cmd_queue)
 			retval = jtag_vpi_tms(cmd->cmd.tms);
 			break;
 		case JTAG_SLEEP:
+			if (batch_mode)
+				retval = jtag_vpi_batch_flush();
 			jtag_sleep(cmd->cmd.sleep->us);
 			break;
 		case JTAG_SCAN:
@@ -519,6 +783,13 @@ static int jtag_vpi_execute_queue(struct jtag_command *cmd_queue)
 		}
 	}
 
+	if (batch_mode) {
+		if (retval == ERROR_OK)
+			retval = jtag_vpi_batch_flush();
+		else
+			jtag_vpi_batch_discard();
+	}
+
 	return retval;
 }
 
@@ -586,6 +857,12 @@ static int jtag_vpi_quit(void)
 		log_socket_error("jtag_vpi");
 	}
 	free(server_address);
+	free(batch_buf);
+	free(batch_replies);
+	batch_buf = NULL;
+	batch_size = 0;
+	batch_replies = NULL;
+	batch_replies_size = 0;
 	return ERROR_OK;
 }
 
@@ -622,6 +899,15 @@ COMMAND_HANDLER(jtag_vpi_stop_sim_on_exit_handler)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(jtag_vpi_batch_handler)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ON_OFF(CMD_ARGV[0], batch_mode);
+	return ERROR_OK;
+}
+
 static const struct command_registration jtag_vpi_subcommand_handlers[] = {
 	{
 		.name = "set_port",
@@ -645,6 +931,14 @@ static const struct command_registration jtag_vpi_subcommand_handlers[] = {
 			"before OpenOCD exits (default: off)",
 		.usage = "<on|off>",
 	},
+	{
+		.name = "batch",
+		.handler = &jtag_vpi_batch_handler,
+		.mode = COMMAND_CONFIG,
+		.help = "Configure if each JTAG queue is sent as one batch "
+			"message, the server must support it (default: off)",
+		.usage = "<on|off>",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+#include <helper/types.h>
+
+#include "mmap_gpio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static size_t mmap_gpio_size(size_t size)
+{
+	size_t page_size = sysconf(_SC_PAGE_SIZE);
+
+	return DIV_ROUND_UP(size, page_size) * page_size;
+}
+
+int mmap_gpio_open(const char *dev)
+{
+	int fd;
+
+	if (dev) {
+		fd = open(dev, O_RDWR | O_SYNC);
+	} else {
+		dev = "/dev/gpiomem";
+		fd = open(dev, O_RDWR | O_SYNC);
+		if (fd < 0) {
+			LOG_DEBUG("Cannot open %s, fallback to /dev/mem", dev);
+			dev = "/dev/mem";
+			fd = open(dev, O_RDWR | O_SYNC);
+		}
+	}
+
+	if (fd < 0)
+		LOG_ERROR("open %s: %s", dev, strerror(errno));
+
+	return fd;
+}
+
+volatile void *mmap_gpio_map(int fd, off_t phys_addr, size_t size)
+{
+	void *base = mmap(NULL, mmap_gpio_size(size), PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, phys_addr);
+
+	if (base == MAP_FAILED)
+		LOG_ERROR("mmap 0x%llx: %s", (unsigned long long)phys_addr, strerror(errno));
+
+	return base;
+}
+
+void mmap_gpio_unmap(volatile void *base, size_t size)
+{
+	if (base == MAP_FAILED)
+		return;
+
+	if (munmap((void *)base, mmap_gpio_size(size)) < 0)
+		LOG_ERROR("munmap: %s", strerror(errno));
+}
@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_JTAG_DRIVERS_MMAP_GPIO_H
+#define OPENOCD_JTAG_DRIVERS_MMAP_GPIO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * @file
+ * Memory mapping of SoC GPIO registers, shared by the bcm2835gpio,
+ * am335xgpio and imx_gpio drivers. The pins are then toggled by plain
+ * register accesses, without a system call per edge.
+ */
+
+/**
+ * Open the device used to map the GPIO registers. If @a dev is NULL,
+ * /dev/gpiomem is tried first, then /dev/mem.
+ * @returns the file descriptor, or -1 with the error logged.
+ */
+int mmap_gpio_open(const char *dev);
+
+/**
+ * Map @a size bytes of registers at the physical address @a phys_addr. The
+ * size is rounded up to whole pages.
+ * @returns the mapped registers, or MAP_FAILED with the error logged.
+ */
+volatile void *mmap_gpio_map(int fd, off_t phys_addr, size_t size);
+
+/** Undo mmap_gpio_map(), nothing is done for MAP_FAILED. */
+void mmap_gpio_unmap(volatile void *base, size_t size);
+
+#endif /* OPENOCD_JTAG_DRIVERS_MMAP_GPIO_H */
@@ -24,25 +24,48 @@
 /* arbitrary limit on host name length: */
 #define REMOTE_BITBANG_HOST_MAX 255
 
+#define REMOTE_BITBANG_DEFAULT_BUF_SIZE	16384
+#define REMOTE_BITBANG_MIN_BUF_SIZE		64
+
+/* How long to wait for the answer to a version request */
+#define REMOTE_BITBANG_VERSION_TIMEOUT_MS	1000
+
+/* Flags of the bulk shift request of protocol version 2 */
+#define REMOTE_BITBANG_SHIFT_TDI		0x01
+#define REMOTE_BITBANG_SHIFT_TMS		0x02
+#define REMOTE_BITBANG_SHIFT_TMS_LAST	0x04
+#define REMOTE_BITBANG_SHIFT_TDO		0x08
+
+enum remote_bitbang_protocol {
+	REMOTE_BITBANG_PROTOCOL_V1 = 1,
+	REMOTE_BITBANG_PROTOCOL_V2 = 2,
+	REMOTE_BITBANG_PROTOCOL_AUTO,
+};
+
 static char *remote_bitbang_host;
 static char *remote_bitbang_port;
 
+static enum remote_bitbang_protocol remote_bitbang_protocol = REMOTE_BITBANG_PROTOCOL_V1;
+static unsigned int remote_bitbang_buf_size = REMOTE_BITBANG_DEFAULT_BUF_SIZE;
+
 static int remote_bitbang_fd;
-static uint8_t remote_bitbang_send_buf[512];
+static uint8_t *remote_bitbang_send_buf;
+static unsigned int remote_bitbang_send_buf_size;
 static unsigned int remote_bitbang_send_buf_used;
 
 static bool use_remote_sleep;
 
 /* Circular buffer. When start == end, the buffer is empty. */
-static char remote_bitbang_recv_buf[256];
+static char *remote_bitbang_recv_buf;
+static unsigned int remote_bitbang_recv_buf_size;
 static unsigned int remote_bitbang_recv_buf_start;
 static unsigned int remote_bitbang_recv_buf_end;
 
 static bool remote_bitbang_recv_buf_full(void)
 {
 	return remote_bitbang_recv_buf_end ==
-		((remote_bitbang_recv_buf_start + sizeof(remote_bitbang_recv_buf) - 1) %
-		 sizeof(remote_bitbang_recv_buf));
+		((remote_bitbang_recv_buf_start + remote_bitbang_recv_buf_size - 1) %
+		 remote_bitbang_recv_buf_size);
 }
 
 static bool remote_bitbang_recv_buf_empty(void)
@@ -53,7 +76,7 @@ static bool remote_bitbang_recv_buf_empty(void)
 static unsigned int remote_bitbang_recv_buf_contiguous_available_space(void)
 {
 	if (remote_bitbang_recv_buf_end >= remote_bitbang_recv_buf_start) {
-		unsigned int space = sizeof(remote_bitbang_recv_buf) -
+		unsigned int space = remote_bitbang_recv_buf_size -
 				     remote_bitbang_recv_buf_end;
 		if (remote_bitbang_recv_buf_start == 0)
 			space -= 1;
@@ -64,6 +87,45 @@ static unsigned int remote_bitbang_recv_buf_contiguous_available_space(void)
 	}
 }
 
+enum block_bool {
+	NO_BLOCK,
+	BLOCK
+};
+
+static int remote_bitbang_fill_buf(enum block_bool block);
+
+static bool remote_bitbang_would_block(void)
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+/* Wait until the socket accepts more data. Answers arriving meanwhile are
+ * received, so that the remote is not stuck on a full socket either. */
+static int remote_bitbang_wait_writable(void)
+{
+	fd_set read_fds, write_fds;
+
+	FD_ZERO(&read_fds);
+	FD_ZERO(&write_fds);
+	FD_SET(remote_bitbang_fd, &write_fds);
+	if (!remote_bitbang_recv_buf_full())
+		FD_SET(remote_bitbang_fd, &read_fds);
+
+	if (socket_select(remote_bitbang_fd + 1, &read_fds, &write_fds, NULL, NULL) < 0) {
+		log_socket_error("remote_bitbang_wait_writable");
+		return ERROR_FAIL;
+	}
+
+	if (FD_ISSET(remote_bitbang_fd, &read_fds))
+		return remote_bitbang_fill_buf(NO_BLOCK);
+
+	return ERROR_OK;
+}
+
 static int remote_bitbang_flush(void)
 {
 	if (remote_bitbang_send_buf_used <= 0)
@@ -73,6 +135,13 @@ static int remote_bitbang_flush(void)
 	while (offset < remote_bitbang_send_buf_used) {
 		ssize_t written = write_socket(remote_bitbang_fd, remote_bitbang_send_buf + offset,
 									   remote_bitbang_send_buf_used - offset);
+		if (written < 0 && remote_bitbang_would_block()) {
+			if (remote_bitbang_wait_writable() != ERROR_OK) {
+				remote_bitbang_send_buf_used = 0;
+				return ERROR_FAIL;
+			}
+			continue;
+		}
 		if (written < 0) {
 			log_socket_error("remote_bitbang_putc");
 			remote_bitbang_send_buf_used = 0;
@@ -84,11 +153,6 @@ static int remote_bitbang_flush(void)
 	return ERROR_OK;
 }
 
-enum block_bool {
-	NO_BLOCK,
-	BLOCK
-};
-
 /* Read any incoming data, placing it into the buffer. */
 static int remote_bitbang_fill_buf(enum block_bool block)
 {
@@ -116,7 +180,7 @@ static int remote_bitbang_fill_buf(enum block_bool block)
 			socket_nonblock(remote_bitbang_fd);
 		if (count > 0) {
 			remote_bitbang_recv_buf_end += count;
-			if (remote_bitbang_recv_buf_end == sizeof(remote_bitbang_recv_buf))
+			if (remote_bitbang_recv_buf_end == remote_bitbang_recv_buf_size)
 				remote_bitbang_recv_buf_end = 0;
 		} else if (count == 0) {
 			/* When read_socket returns 0, socket reached EOF and there is
@@ -128,11 +192,7 @@ static int remote_bitbang_fill_buf(enum block_bool block)
 			}
 			return ERROR_OK;
 		} else if (count < 0) {
-#ifdef _WIN32
-			if (WSAGetLastError() == WSAEWOULDBLOCK) {
-#else
-			if (errno == EAGAIN) {
-#endif
+			if (remote_bitbang_would_block()) {
 				return ERROR_OK;
 			} else {
 				log_socket_error("remote_bitbang_fill_buf");
@@ -154,11 +214,52 @@ static int remote_bitbang_queue(int c, enum flush_bool flush)
 {
 	remote_bitbang_send_buf[remote_bitbang_send_buf_used++] = c;
 	if (flush == FLUSH_SEND_BUF ||
-			remote_bitbang_send_buf_used >= ARRAY_SIZE(remote_bitbang_send_buf))
+			remote_bitbang_send_buf_used >= remote_bitbang_send_buf_size)
 		return remote_bitbang_flush();
 	return ERROR_OK;
 }
 
+static int remote_bitbang_queue_buf(const uint8_t *buf, size_t size)
+{
+	while (size) {
+		size_t count = MIN(size, remote_bitbang_send_buf_size - remote_bitbang_send_buf_used);
+
+		memcpy(remote_bitbang_send_buf + remote_bitbang_send_buf_used, buf, count);
+		remote_bitbang_send_buf_used += count;
+		buf += count;
+		size -= count;
+
+		if (remote_bitbang_send_buf_used == remote_bitbang_send_buf_size &&
+				remote_bitbang_flush() != ERROR_OK)
+			return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+/* Take size bytes of answers from the receive buffer, waiting for them */
+static int remote_bitbang_recv(uint8_t *buf, size_t size)
+{
+	while (size) {
+		if (remote_bitbang_recv_buf_empty()) {
+			if (remote_bitbang_fill_buf(BLOCK) != ERROR_OK)
+				return ERROR_FAIL;
+		}
+
+		unsigned int end = remote_bitbang_recv_buf_end >= remote_bitbang_recv_buf_start ?
+			remote_bitbang_recv_buf_end : remote_bitbang_recv_buf_size;
+		size_t count = MIN(size, end - remote_bitbang_recv_buf_start);
+
+		memcpy(buf, remote_bitbang_recv_buf + remote_bitbang_recv_buf_start, count);
+		remote_bitbang_recv_buf_start =
+			(remote_bitbang_recv_buf_start + count) % remote_bitbang_recv_buf_size;
+		buf += count;
+		size -= count;
+	}
+
+	return ERROR_OK;
+}
+
 static int remote_bitbang_quit(void)
 {
 	if (remote_bitbang_queue('Q', FLUSH_SEND_BUF) == ERROR_FAIL)
@@ -171,6 +272,12 @@ static int remote_bitbang_quit(void)
 
 	free(remote_bitbang_host);
 	free(remote_bitbang_port);
+	free(remote_bitbang_send_buf);
+	free(remote_bitbang_recv_buf);
+	remote_bitbang_host = NULL;
+	remote_bitbang_port = NULL;
+	remote_bitbang_send_buf = NULL;
+	remote_bitbang_recv_buf = NULL;
 
 	LOG_INFO("remote_bitbang interface quit");
 	return ERROR_OK;
@@ -184,7 +291,6 @@ static enum bb_value char_to_int(int c)
 		case '1':
 			return BB_HIGH;
 		default:
-			remote_bitbang_quit();
 			LOG_ERROR("remote_bitbang: invalid read response: %c(%i)", c, c);
 			return BB_ERROR;
 	}
@@ -207,7 +313,7 @@ static enum bb_value remote_bitbang_read_sample(void)
 	assert(!remote_bitbang_recv_buf_empty());
 	int c = remote_bitbang_recv_buf[remote_bitbang_recv_buf_start];
 	remote_bitbang_recv_buf_start =
-		(remote_bitbang_recv_buf_start + 1) % sizeof(remote_bitbang_recv_buf);
+		(remote_bitbang_recv_buf_start + 1) % remote_bitbang_recv_buf_size;
 	return char_to_int(c);
 }
 
@@ -217,6 +323,81 @@ static int remote_bitbang_write(int tck, int tms, int tdi)
 	return remote_bitbang_queue(c, NO_FLUSH);
 }
 
+/* Check whether TMS is only set on the last bit of the sequence */
+static bool remote_bitbang_tms_last_only(const uint8_t *tms, unsigned int num_bits,
+		bool last_chunk)
+{
+	unsigned int bytes = DIV_ROUND_UP(num_bits, 8);
+	uint8_t last = tms[bytes - 1] & (0xff >> (8 * bytes - num_bits));
+
+	for (unsigned int i = 0; i < bytes - 1; i++) {
+		if (tms[i])
+			return false;
+	}
+
+	if (!last_chunk)
+		return !last;
+
+	return last == 0 || last == 1 << ((num_bits - 1) % 8);
+}
+
+/* Bulk shift of protocol version 2. The sequence is split into chunks whose
+ * TDO answer fits into the receive buffer. */
+static int remote_bitbang_shift(unsigned int num_bits, const uint8_t *tms,
+		const uint8_t *tdi, uint8_t *tdo)
+{
+	const unsigned int chunk_bits = 8 * (remote_bitbang_recv_buf_size - 1);
+
+	for (unsigned int offset = 0; offset < num_bits; offset += chunk_bits) {
+		unsigned int bits = MIN(num_bits - offset, chunk_bits);
+		unsigned int bytes = DIV_ROUND_UP(bits, 8);
+		bool last_chunk = offset + bits == num_bits;
+		uint8_t header[6];
+		uint8_t flags = 0;
+		bool send_tms = false;
+
+		if (tdi)
+			flags |= REMOTE_BITBANG_SHIFT_TDI;
+		if (tdo)
+			flags |= REMOTE_BITBANG_SHIFT_TDO;
+		if (tms) {
+			if (!remote_bitbang_tms_last_only(tms + offset / 8, bits, last_chunk)) {
+				flags |= REMOTE_BITBANG_SHIFT_TMS;
+				send_tms = true;
+			} else if (last_chunk && (tms[(num_bits - 1) / 8] >> ((num_bits - 1) % 8)) & 1) {
+				flags |= REMOTE_BITBANG_SHIFT_TMS_LAST;
+			}
+		}
+
+		header[0] = 'X';
+		h_u32_to_le(header + 1, bits);
+		header[5] = flags;
+
+		if (remote_bitbang_queue_buf(header, sizeof(header)) != ERROR_OK)
+			return ERROR_FAIL;
+		if (send_tms && remote_bitbang_queue_buf(tms + offset / 8, bytes) != ERROR_OK)
+			return ERROR_FAIL;
+		if (tdi && remote_bitbang_queue_buf(tdi + offset / 8, bytes) != ERROR_OK)
+			return ERROR_FAIL;
+
+		if (tdo) {
+			uint8_t *in = tdo + offset / 8;
+			uint8_t last = in[bytes - 1];
+
+			if (remote_bitbang_recv(in, bytes) != ERROR_OK)
+				return ERROR_FAIL;
+
+			/* keep the bits following the sequence */
+			if (bits % 8) {
+				uint8_t mask = 0xff >> (8 - bits % 8);
+				in[bytes - 1] = (in[bytes - 1] & mask) | (last & ~mask);
+			}
+		}
+	}
+
+	return ERROR_OK;
+}
+
 static int remote_bitbang_reset(int trst, int srst)
 {
 	char c = 'r' + ((trst ? 0x2 : 0x0) | (srst ? 0x1 : 0x0));
@@ -278,8 +459,7 @@ static int remote_bitbang_swd_write(int swclk, int swdio)
 	return remote_bitbang_queue(c, NO_FLUSH);
 }
 
-static const struct bitbang_interface remote_bitbang_bitbang = {
-	.buf_size = sizeof(remote_bitbang_recv_buf) - 1,
+static struct bitbang_interface remote_bitbang_bitbang = {
 	.sample = &remote_bitbang_sample,
 	.read_sample = &remote_bitbang_read_sample,
 	.write = &remote_bitbang_write,
@@ -368,12 +548,72 @@ static int remote_bitbang_init_unix(void)
 	return fd;
 }
 
+/* Ask the remote for its protocol version, a remote only knowing version 1
+ * is expected to ignore the request. */
+static int remote_bitbang_negotiate(void)
+{
+	if (remote_bitbang_queue('V', FLUSH_SEND_BUF) != ERROR_OK)
+		return ERROR_FAIL;
+
+	fd_set read_fds;
+	struct timeval timeout = {
+		.tv_sec = REMOTE_BITBANG_VERSION_TIMEOUT_MS / 1000,
+		.tv_usec = (REMOTE_BITBANG_VERSION_TIMEOUT_MS % 1000) * 1000,
+	};
+
+	FD_ZERO(&read_fds);
+	FD_SET(remote_bitbang_fd, &read_fds);
+
+	int retval = socket_select(remote_bitbang_fd + 1, &read_fds, NULL, NULL, &timeout);
+	if (retval < 0) {
+		log_socket_error("remote_bitbang_negotiate");
+		return ERROR_FAIL;
+	}
+
+	uint8_t version = '1';
+	if (retval > 0 && remote_bitbang_recv(&version, 1) != ERROR_OK)
+		return ERROR_FAIL;
+
+	if (version < '1' || version > '9') {
+		LOG_ERROR("remote_bitbang: invalid version response: %c(%i)", version, version);
+		return ERROR_FAIL;
+	}
+
+	if (version == '1' && remote_bitbang_protocol == REMOTE_BITBANG_PROTOCOL_V2) {
+		LOG_ERROR("remote_bitbang: remote does not support protocol version 2");
+		return ERROR_FAIL;
+	}
+
+	if (version == '1') {
+		LOG_INFO("remote_bitbang: using protocol version 1");
+		return ERROR_OK;
+	}
+
+	LOG_INFO("remote_bitbang: using protocol version 2");
+	remote_bitbang_bitbang.shift = remote_bitbang_shift;
+	return ERROR_OK;
+}
+
 static int remote_bitbang_init(void)
 {
 	bitbang_interface = &remote_bitbang_bitbang;
 
+	free(remote_bitbang_send_buf);
+	free(remote_bitbang_recv_buf);
+	remote_bitbang_send_buf = malloc(remote_bitbang_buf_size);
+	remote_bitbang_recv_buf = malloc(remote_bitbang_buf_size);
+	if (!remote_bitbang_send_buf || !remote_bitbang_recv_buf) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	remote_bitbang_send_buf_size = remote_bitbang_buf_size;
+	remote_bitbang_send_buf_used = 0;
+	remote_bitbang_recv_buf_size = remote_bitbang_buf_size;
 	remote_bitbang_recv_buf_start = 0;
 	remote_bitbang_recv_buf_end = 0;
+	remote_bitbang_bitbang.buf_size = remote_bitbang_recv_buf_size - 1;
+	remote_bitbang_bitbang.shift = NULL;
 
 	LOG_INFO("Initializing remote_bitbang driver");
 	if (!remote_bitbang_port)
@@ -386,6 +626,10 @@ static int remote_bitbang_init(void)
 
 	socket_nonblock(remote_bitbang_fd);
 
+	if (remote_bitbang_protocol != REMOTE_BITBANG_PROTOCOL_V1 &&
+			remote_bitbang_negotiate() != ERROR_OK)
+		return ERROR_JTAG_INIT_FAILED;
+
 	LOG_INFO("remote_bitbang driver initialized");
 	return ERROR_OK;
 }
@@ -424,6 +668,51 @@ COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_use_remote_sleep_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_protocol_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "1") == 0)
+			remote_bitbang_protocol = REMOTE_BITBANG_PROTOCOL_V1;
+		else if (strcmp(CMD_ARGV[0], "2") == 0)
+			remote_bitbang_protocol = REMOTE_BITBANG_PROTOCOL_V2;
+		else if (strcmp(CMD_ARGV[0], "auto") == 0)
+			remote_bitbang_protocol = REMOTE_BITBANG_PROTOCOL_AUTO;
+		else
+			return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	if (remote_bitbang_protocol == REMOTE_BITBANG_PROTOCOL_AUTO)
+		command_print(CMD, "remote_bitbang protocol: auto");
+	else
+		command_print(CMD, "remote_bitbang protocol: %d", remote_bitbang_protocol);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_buffer_size_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned int size;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size);
+		if (size < REMOTE_BITBANG_MIN_BUF_SIZE) {
+			command_print(CMD, "buffer size must be at least %d bytes",
+				REMOTE_BITBANG_MIN_BUF_SIZE);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		remote_bitbang_buf_size = size;
+	}
+
+	command_print(CMD, "remote_bitbang buffer size: %u bytes", remote_bitbang_buf_size);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration remote_bitbang_subcommand_handlers[] = {
 	{
 		.name = "port",
@@ -449,6 +738,21 @@ static const struct command_registration remote_bitbang_subcommand_handlers[] =
 			"instruction stream for the remote host.",
 		.usage = "(on|off)",
 	},
+	{
+		.name = "protocol",
+		.handler = remote_bitbang_handle_remote_bitbang_protocol_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Select the protocol version, 'auto' uses version 2 if the "
+			"remote host supports it.",
+		.usage = "['1'|'2'|'auto']",
+	},
+	{
+		.name = "buffer_size",
+		.handler = remote_bitbang_handle_remote_bitbang_buffer_size_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Set the size of the send and receive buffers.",
+		.usage = "[bytes]",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -0,0 +1,392 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Adapter that replays a capture of "adapter trace start", see
+ * adapter_trace.h. The commands queued by OpenOCD are checked against the
+ * capture and the data captured from the target is returned, so a session
+ * can be repeated without hardware, e.g. to benchmark the host side.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/binarybuffer.h>
+#include <helper/time_support.h>
+#include <jtag/adapter_trace.h>
+#include <jtag/interface.h>
+#include <jtag/commands.h>
+#include <jtag/swd.h>
+
+struct replay_swd_op {
+	enum adapter_trace_record_type type;
+	uint8_t cmd;
+	uint32_t value;
+	uint32_t *read_value;
+};
+
+static char *replay_filename;
+static bool replay_timing;
+static struct adapter_trace_reader replay_reader;
+
+static struct replay_swd_op *replay_swd_ops;
+static size_t replay_swd_num_ops, replay_swd_ops_size;
+static int replay_swd_queued_retval = ERROR_OK;
+
+/* Read the next record, which must be of the expected type */
+static int replay_next(enum adapter_trace_record_type type,
+		struct adapter_trace_record *record)
+{
+	int retval = adapter_trace_read(&replay_reader, record);
+
+	if (retval == ERROR_WAIT) {
+		LOG_ERROR("trace_replay: end of the capture reached");
+		return ERROR_FAIL;
+	}
+
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (record->type != type) {
+		LOG_ERROR("trace_replay: diverged at record %" PRIu64
+			", expected type 0x%02x but captured 0x%02x",
+			replay_reader.index - 1, type, record->type);
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+static int replay_diverged(const char *what)
+{
+	LOG_ERROR("trace_replay: diverged at record %" PRIu64 ", %s differs",
+		replay_reader.index - 1, what);
+	return ERROR_FAIL;
+}
+
+/* Read the flush record closing a queue execution */
+static int replay_flush(void)
+{
+	struct adapter_trace_record record;
+	int retval = replay_next(ADAPTER_TRACE_FLUSH, &record);
+
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (replay_timing && record.duration_us)
+		usleep(record.duration_us);
+
+	return record.result;
+}
+
+static int replay_scan(const struct scan_command *scan)
+{
+	struct adapter_trace_record record;
+	int retval = replay_next(ADAPTER_TRACE_JTAG_SCAN, &record);
+
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (record.ir_scan != scan->ir_scan || record.end_state != (int)scan->end_state ||
+			record.count != scan->num_fields)
+		return replay_diverged("scan");
+
+	for (unsigned int i = 0; i < scan->num_fields; i++) {
+		const struct adapter_trace_field *captured = &record.fields[i];
+		struct scan_field *field = &scan->fields[i];
+
+		if (captured->num_bits != field->num_bits)
+			return replay_diverged("scan length");
+
+		if (!captured->out_value != !field->out_value ||
+				(field->out_value && !buf_eq(captured->out_value,
+					field->out_value, field->num_bits)))
+			return replay_diverged("scan data");
+
+		if (field->in_value) {
+			if (!captured->in_value)
+				return replay_diverged("scan direction");
+
+			buf_cpy(captured->in_value, field->in_value, field->num_bits);
+		}
+	}
+
+	return ERROR_OK;
+}
+
+static int replay_command(const struct jtag_command *cmd)
+{
+	struct adapter_trace_record record;
+	int retval;
+
+	switch (cmd->type) {
+	case JTAG_SCAN:
+		return replay_scan(cmd->cmd.scan);
+	case JTAG_TLR_RESET:
+		retval = replay_next(ADAPTER_TRACE_JTAG_TLR_RESET, &record);
+		if (retval == ERROR_OK && record.end_state != (int)cmd->cmd.statemove->end_state)
+			return replay_diverged("TLR reset");
+		return retval;
+	case JTAG_RUNTEST:
+		retval = replay_next(ADAPTER_TRACE_JTAG_RUNTEST, &record);
+		if (retval == ERROR_OK && (record.count != cmd->cmd.runtest->num_cycles ||
+				record.end_state != (int)cmd->cmd.runtest->end_state))
+			return replay_diverged("runtest");
+		return retval;
+	case JTAG_RESET:
+		retval = replay_next(ADAPTER_TRACE_JTAG_RESET, &record);
+		if (retval == ERROR_OK && (record.trst != cmd->cmd.reset->trst ||
+				record.srst != cmd->cmd.reset->srst))
+			return replay_diverged("reset");
+		return retval;
+	case JTAG_PATHMOVE:
+		retval = replay_next(ADAPTER_TRACE_JTAG_PATHMOVE, &record);
+		if (retval != ERROR_OK)
+			return retval;
+		if (record.count != cmd->cmd.pathmove->num_states)
+			return replay_diverged("pathmove");
+		for (unsigned int i = 0; i < record.count; i++) {
+			if ((int8_t)record.data[i] != (int)cmd->cmd.pathmove->path[i])
+				return replay_diverged("pathmove");
+		}
+		return ERROR_OK;
+	case JTAG_SLEEP:
+		retval = replay_next(ADAPTER_TRACE_JTAG_SLEEP, &record);
+		if (retval == ERROR_OK && record.count != cmd->cmd.sleep->us)
+			return replay_diverged("sleep");
+		return retval;
+	case JTAG_STABLECLOCKS:
+		retval = replay_next(ADAPTER_TRACE_JTAG_STABLECLOCKS, &record);
+		if (retval == ERROR_OK && record.count != cmd->cmd.stableclocks->num_cycles)
+			return replay_diverged("stableclocks");
+		return retval;
+	case JTAG_TMS:
+		retval = replay_next(ADAPTER_TRACE_JTAG_TMS, &record);
+		if (retval == ERROR_OK && (record.count != cmd->cmd.tms->num_bits ||
+				!buf_eq(record.data, cmd->cmd.tms->bits, record.count)))
+			return replay_diverged("TMS sequence");
+		return retval;
+	}
+
+	LOG_ERROR("trace_replay: unknown JTAG command type %d", cmd->type);
+	return ERROR_FAIL;
+}
+
+static int replay_execute_queue(struct jtag_command *cmd_queue)
+{
+	for (struct jtag_command *cmd = cmd_queue; cmd; cmd = cmd->next) {
+		int retval = replay_command(cmd);
+
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return replay_flush();
+}
+
+static void replay_swd_queue(enum adapter_trace_record_type type, uint8_t cmd,
+		uint32_t value, uint32_t *read_value)
+{
+	if (replay_swd_num_ops == replay_swd_ops_size) {
+		size_t size = replay_swd_ops_size ? 2 * replay_swd_ops_size : 64;
+		struct replay_swd_op *ops = realloc(replay_swd_ops, size * sizeof(*ops));
+
+		if (!ops) {
+			LOG_ERROR("Out of memory");
+			replay_swd_queued_retval = ERROR_FAIL;
+			return;
+		}
+
+		replay_swd_ops = ops;
+		replay_swd_ops_size = size;
+	}
+
+	replay_swd_ops[replay_swd_num_ops++] = (struct replay_swd_op) {
+		.type = type,
+		.cmd = cmd,
+		.value = value,
+		.read_value = read_value,
+	};
+}
+
+static int replay_swd_init(void)
+{
+	return ERROR_OK;
+}
+
+static int replay_swd_switch_seq(enum swd_special_seq seq)
+{
+	replay_swd_queue(ADAPTER_TRACE_SWD_SEQ, seq, 0, NULL);
+	return ERROR_OK;
+}
+
+static void replay_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay_hint)
+{
+	replay_swd_queue(ADAPTER_TRACE_SWD_READ, cmd, 0, value);
+}
+
+static void replay_swd_write_reg(uint8_t cmd, uint32_t value, uint32_t ap_delay_hint)
+{
+	replay_swd_queue(ADAPTER_TRACE_SWD_WRITE, cmd, value, NULL);
+}
+
+static int replay_swd_run(void)
+{
+	struct adapter_trace_record record;
+	int retval = replay_swd_queued_retval;
+
+	for (size_t i = 0; retval == ERROR_OK && i < replay_swd_num_ops; i++) {
+		const struct replay_swd_op *op = &replay_swd_ops[i];
+
+		retval = replay_next(op->type, &record);
+		if (retval != ERROR_OK)
+			break;
+
+		if (record.swd_cmd != op->cmd)
+			retval = replay_diverged("SWD request");
+		else if (op->type == ADAPTER_TRACE_SWD_WRITE && record.value != op->value)
+			retval = replay_diverged("SWD write data");
+		else if (op->type == ADAPTER_TRACE_SWD_READ && op->read_value)
+			*op->read_value = record.value;
+	}
+
+	replay_swd_num_ops = 0;
+	replay_swd_queued_retval = ERROR_OK;
+
+	if (retval != ERROR_OK)
+		return retval;
+
+	return replay_flush();
+}
+
+static int replay_init(void)
+{
+	if (!replay_filename) {
+		LOG_ERROR("trace_replay: no capture file configured");
+		return ERROR_FAIL;
+	}
+
+	return adapter_trace_reader_open(&replay_reader, replay_filename);
+}
+
+static int replay_quit(void)
+{
+	adapter_trace_reader_close(&replay_reader);
+
+	free(replay_swd_ops);
+	replay_swd_ops = NULL;
+	replay_swd_num_ops = 0;
+	replay_swd_ops_size = 0;
+
+	return ERROR_OK;
+}
+
+static int replay_reset(int trst, int srst)
+{
+	return ERROR_OK;
+}
+
+static int replay_speed(int speed)
+{
+	return ERROR_OK;
+}
+
+static int replay_khz(int khz, int *jtag_speed)
+{
+	*jtag_speed = khz;
+	return ERROR_OK;
+}
+
+static int replay_speed_div(int speed, int *khz)
+{
+	*khz = speed;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(replay_handle_file_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	free(replay_filename);
+	replay_filename = strdup(CMD_ARGV[0]);
+
+	if (!replay_filename) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(replay_handle_timing_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], replay_timing);
+
+	command_print(CMD, "trace_replay timing is %s", replay_timing ? "on" : "off");
+
+	return ERROR_OK;
+}
+
+static const struct command_registration replay_subcommand_handlers[] = {
+	{
+		.name = "file",
+		.handler = replay_handle_file_command,
+		.mode = COMMAND_CONFIG,
+		.help = "set the capture file to replay",
+		.usage = "filename",
+	},
+	{
+		.name = "timing",
+		.handler = replay_handle_timing_command,
+		.mode = COMMAND_ANY,
+		.help = "wait for the captured duration of each queue execution",
+		.usage = "['on'|'off']",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration replay_command_handlers[] = {
+	{
+		.name = "trace_replay",
+		.mode = COMMAND_ANY,
+		.help = "trace_replay adapter driver commands",
+		.chain = replay_subcommand_handlers,
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const char * const replay_transports[] = { "jtag", "swd", NULL };
+
+static struct jtag_interface replay_interface = {
+	.execute_queue = replay_execute_queue,
+};
+
+static const struct swd_driver replay_swd = {
+	.init = replay_swd_init,
+	.switch_seq = replay_swd_switch_seq,
+	.read_reg = replay_swd_read_reg,
+	.write_reg = replay_swd_write_reg,
+	.run = replay_swd_run,
+};
+
+struct adapter_driver trace_replay_adapter_driver = {
+	.name = "trace_replay",
+	.transports = replay_transports,
+	.commands = replay_command_handlers,
+
+	.init = replay_init,
+	.quit = replay_quit,
+	.reset = replay_reset,
+	.speed = replay_speed,
+	.khz = replay_khz,
+	.speed_div = replay_speed_div,
+
+	.jtag_ops = &replay_interface,
+	.swd_ops = &replay_swd,
+};
@@ -397,6 +397,7 @@ extern struct adapter_driver rlink_adapter_driver;
 extern struct adapter_driver rshim_dap_adapter_driver;
 extern struct adapter_driver stlink_dap_adapter_driver;
 extern struct adapter_driver sysfsgpio_adapter_driver;
+extern struct adapter_driver trace_replay_adapter_driver;
 extern struct adapter_driver ulink_adapter_driver;
 extern struct adapter_driver usb_blaster_adapter_driver;
 extern struct adapter_driver usbprog_adapter_driver;
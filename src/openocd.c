@@ -27,6 +27,7 @@
 #include <target/arm_cti.h>
 #include <target/arm_adi_v5.h>
 #include <target/arm_tpiu_swo.h>
+#include <target/bench.h>
 #include <rtt/rtt.h>
 
 #include <server/server.h>
@@ -247,6 +248,7 @@ static int (* const command_registrants[])(struct command_context *cmd_ctx_value
 	cti_register_commands,
 	dap_register_commands,
 	arm_tpiu_swo_register_commands,
+	bench_register_commands,
 };
 
 static struct command_context *setup_command_handler(Jim_Interp *interp)
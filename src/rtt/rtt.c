@@ -19,6 +19,15 @@
 
 #include "rtt.h"
 
+/* Size of the host-side queue of a down-channel in bytes */
+#define RTT_WRITE_QUEUE_SIZE	(16 * 1024)
+
+/** Data waiting to be written into a down-channel. */
+struct rtt_write_queue {
+	uint8_t *buffer;
+	size_t length;
+};
+
 static struct {
 	struct rtt_source source;
 	/** Control block. */
@@ -34,15 +43,23 @@ static struct {
 	bool configured;
 	/** Whether RTT is started. */
 	bool started;
-	/** Whether configuration changed. */
-	bool changed;
 	/** Whether the control block was found. */
 	bool found_cb;
+	/** Target the control block was found on. */
+	struct target *found_target;
 
 	struct rtt_sink_list **sink_list;
 	size_t sink_list_length;
 
+	struct rtt_write_queue *write_queues;
+	size_t num_write_queues;
+
+	/** Polling interval while idle, in milliseconds. */
 	unsigned int polling_interval;
+	/** Minimal polling interval, in milliseconds. */
+	unsigned int min_polling_interval;
+	/** Current polling interval, in milliseconds. */
+	unsigned int current_interval;
 } rtt;
 
 int rtt_init(void)
@@ -58,6 +75,8 @@ int rtt_init(void)
 	rtt.started = false;
 
 	rtt.polling_interval = 100;
+	rtt.min_polling_interval = 1;
+	rtt.current_interval = rtt.polling_interval;
 
 	return ERROR_OK;
 }
@@ -66,22 +85,90 @@ int rtt_exit(void)
 {
 	free(rtt.sink_list);
 
+	for (size_t i = 0; i < rtt.num_write_queues; i++)
+		free(rtt.write_queues[i].buffer);
+
+	free(rtt.write_queues);
+
+	return ERROR_OK;
+}
+
+/*
+ * Adapt the polling interval to the fill level of the up-channels: poll
+ * faster while they fill up, so the target doesn't have to drop data or
+ * block, and back off to the configured interval while they stay empty.
+ */
+static unsigned int next_polling_interval(const struct rtt_read_stats *stats)
+{
+	unsigned int interval = rtt.current_interval;
+
+	if (stats->max_fill >= 50)
+		interval /= 4;
+	else if (stats->max_fill >= 25)
+		interval /= 2;
+	else if (!stats->bytes)
+		interval *= 2;
+
+	return MIN(MAX(interval, rtt.min_polling_interval), rtt.polling_interval);
+}
+
+/* Write as much queued data as fits into the down-channels */
+static int flush_write_queues(size_t *written)
+{
+	*written = 0;
+
+	for (size_t i = 0; i < rtt.num_write_queues; i++) {
+		int ret;
+		struct rtt_write_queue *queue = &rtt.write_queues[i];
+		size_t length = queue->length;
+
+		if (!length)
+			continue;
+
+		if (i >= rtt.ctrl.num_down_channels) {
+			LOG_WARNING("rtt: Down-channel %zu is not available", i);
+			queue->length = 0;
+			continue;
+		}
+
+		ret = rtt.source.write(rtt.target, &rtt.ctrl, i, queue->buffer,
+			&length, NULL);
+
+		if (ret != ERROR_OK)
+			return ret;
+
+		queue->length -= length;
+		memmove(queue->buffer, queue->buffer + length, queue->length);
+		*written += length;
+	}
+
 	return ERROR_OK;
 }
 
 static int read_channel_callback(void *user_data)
 {
 	int ret;
+	size_t written;
+	struct rtt_read_stats stats;
 
 	ret = rtt.source.read(rtt.target, &rtt.ctrl, rtt.sink_list,
-		rtt.sink_list_length, NULL);
+		rtt.sink_list_length, &stats, NULL);
+
+	if (ret == ERROR_OK)
+		ret = flush_write_queues(&written);
 
 	if (ret != ERROR_OK) {
-		target_unregister_timer_callback(&read_channel_callback, NULL);
 		rtt.source.stop(rtt.target, NULL);
 		return ret;
 	}
 
+	/* Keep polling fast while the host sends data */
+	stats.bytes += written;
+
+	rtt.current_interval = next_polling_interval(&stats);
+	target_register_timer_callback(&read_channel_callback,
+		rtt.current_interval, TARGET_TIMER_TYPE_ONESHOT, NULL);
+
 	return ERROR_OK;
 }
 
@@ -97,7 +184,6 @@ int rtt_setup(target_addr_t address, size_t size, const char *id)
 	rtt.addr = address;
 	rtt.size = size;
 	strncpy(rtt.id, id, id_length + 1);
-	rtt.changed = true;
 	rtt.configured = true;
 
 	return ERROR_OK;
@@ -121,6 +207,23 @@ int rtt_register_source(const struct rtt_source source,
 	return ERROR_OK;
 }
 
+/* Check whether the control block is still at its last known location */
+static bool check_control_block(void)
+{
+	struct rtt_control ctrl;
+
+	if (!rtt.found_cb || rtt.found_target != rtt.target)
+		return false;
+
+	if (rtt.ctrl.address < rtt.addr || rtt.ctrl.address - rtt.addr >= rtt.size)
+		return false;
+
+	if (rtt.source.read_cb(rtt.target, rtt.ctrl.address, &ctrl, NULL) != ERROR_OK)
+		return false;
+
+	return !strncmp(ctrl.id, rtt.id, strlen(rtt.id));
+}
+
 int rtt_start(void)
 {
 	int ret;
@@ -129,16 +232,23 @@ int rtt_start(void)
 	if (rtt.started)
 		return ERROR_OK;
 
-	if (!rtt.found_cb || rtt.changed) {
+	/*
+	 * The control block usually stays at the same address across resets
+	 * and reconfigurations, only search the whole area if it moved.
+	 */
+	if (check_control_block()) {
+		LOG_DEBUG("rtt: Control block still at 0x%" TARGET_PRIxADDR,
+			rtt.ctrl.address);
+	} else {
+		rtt.found_cb = false;
 		rtt.source.find_cb(rtt.target, &addr, rtt.size, rtt.id,
 			&rtt.found_cb, NULL);
 
-		rtt.changed = false;
-
 		if (rtt.found_cb) {
 			LOG_INFO("rtt: Control block found at 0x%" TARGET_PRIxADDR,
 				addr);
 			rtt.ctrl.address = addr;
+			rtt.found_target = rtt.target;
 		} else {
 			LOG_ERROR("rtt: No control block found");
 			return ERROR_FAIL;
@@ -155,8 +265,9 @@ int rtt_start(void)
 	if (ret != ERROR_OK)
 		return ret;
 
+	rtt.current_interval = rtt.polling_interval;
 	target_register_timer_callback(&read_channel_callback,
-		rtt.polling_interval, 1, NULL);
+		rtt.current_interval, TARGET_TIMER_TYPE_ONESHOT, NULL);
 	rtt.started = true;
 
 	return ERROR_OK;
@@ -174,6 +285,9 @@ int rtt_stop(void)
 	target_unregister_timer_callback(&read_channel_callback, NULL);
 	rtt.started = false;
 
+	for (size_t i = 0; i < rtt.num_write_queues; i++)
+		rtt.write_queues[i].length = 0;
+
 	ret = rtt.source.stop(rtt.target, NULL);
 
 	if (ret != ERROR_OK)
@@ -259,36 +373,42 @@ int rtt_unregister_sink(unsigned int channel_index, rtt_sink_read read,
 	return ERROR_OK;
 }
 
-int rtt_get_polling_interval(unsigned int *interval)
+int rtt_get_polling_interval(unsigned int *interval,
+		unsigned int *min_interval)
 {
 	if (!interval)
 		return ERROR_FAIL;
 
 	*interval = rtt.polling_interval;
 
+	if (min_interval)
+		*min_interval = rtt.min_polling_interval;
+
 	return ERROR_OK;
 }
 
-int rtt_set_polling_interval(unsigned int interval)
+int rtt_set_polling_interval(unsigned int interval, unsigned int min_interval)
 {
-	if (!interval)
+	if (!interval || !min_interval || min_interval > interval)
 		return ERROR_FAIL;
 
-	if (rtt.polling_interval != interval) {
+	rtt.polling_interval = interval;
+	rtt.min_polling_interval = min_interval;
+
+	if (rtt.started) {
+		rtt.current_interval = interval;
 		target_unregister_timer_callback(&read_channel_callback, NULL);
-		target_register_timer_callback(&read_channel_callback, interval, 1,
-			NULL);
+		target_register_timer_callback(&read_channel_callback, interval,
+			TARGET_TIMER_TYPE_ONESHOT, NULL);
 	}
 
-	rtt.polling_interval = interval;
-
 	return ERROR_OK;
 }
 
 int rtt_write_channel(unsigned int channel_index, const uint8_t *buffer,
 		size_t *length)
 {
-	if (channel_index >= rtt.ctrl.num_up_channels) {
+	if (channel_index >= rtt.ctrl.num_down_channels) {
 		LOG_WARNING("rtt: Down-channel %u is not available", channel_index);
 		return ERROR_OK;
 	}
@@ -297,6 +417,66 @@ int rtt_write_channel(unsigned int channel_index, const uint8_t *buffer,
 		length, NULL);
 }
 
+static struct rtt_write_queue *get_write_queue(unsigned int channel_index)
+{
+	if (channel_index >= rtt.num_write_queues) {
+		struct rtt_write_queue *tmp;
+
+		tmp = realloc(rtt.write_queues, (channel_index + 1) * sizeof(*tmp));
+
+		if (!tmp)
+			return NULL;
+
+		for (size_t i = rtt.num_write_queues; i <= channel_index; i++)
+			tmp[i] = (struct rtt_write_queue) { 0 };
+
+		rtt.write_queues = tmp;
+		rtt.num_write_queues = channel_index + 1;
+	}
+
+	struct rtt_write_queue *queue = &rtt.write_queues[channel_index];
+
+	if (!queue->buffer) {
+		queue->buffer = malloc(RTT_WRITE_QUEUE_SIZE);
+
+		if (!queue->buffer)
+			return NULL;
+	}
+
+	return queue;
+}
+
+size_t rtt_write_queue_space(unsigned int channel_index)
+{
+	if (channel_index >= rtt.num_write_queues)
+		return RTT_WRITE_QUEUE_SIZE;
+
+	return RTT_WRITE_QUEUE_SIZE - rtt.write_queues[channel_index].length;
+}
+
+int rtt_queue_write(unsigned int channel_index, const uint8_t *buffer,
+		size_t *length)
+{
+	struct rtt_write_queue *queue;
+
+	/* Data can't be delivered without a control block, drop it */
+	if (!rtt.started)
+		return ERROR_OK;
+
+	queue = get_write_queue(channel_index);
+
+	if (!queue) {
+		LOG_ERROR("rtt: Out of memory");
+		return ERROR_FAIL;
+	}
+
+	*length = MIN(*length, RTT_WRITE_QUEUE_SIZE - queue->length);
+	memcpy(queue->buffer + queue->length, buffer, *length);
+	queue->length += *length;
+
+	return ERROR_OK;
+}
+
 bool rtt_configured(void)
 {
 	return rtt.configured;
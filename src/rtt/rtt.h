@@ -77,6 +77,14 @@ struct rtt_channel_info {
 	uint32_t flags;
 };
 
+/** Statistics of one read of the up-channels. */
+struct rtt_read_stats {
+	/** Number of bytes read from all up-channels. */
+	size_t bytes;
+	/** Highest fill level of an up-channel in percent of its size. */
+	unsigned int max_fill;
+};
+
 typedef int (*rtt_sink_read)(unsigned int channel, const uint8_t *buffer,
 		size_t length, void *user_data);
 
@@ -112,7 +120,7 @@ struct rtt_source {
 	int (*stop)(struct target *target, void *user_data);
 	int (*read)(struct target *target,
 		const struct rtt_control *ctrl, struct rtt_sink_list **sinks,
-		size_t num_channels, void *user_data);
+		size_t num_channels, struct rtt_read_stats *stats, void *user_data);
 	int (*write)(struct target *target,
 		struct rtt_control *ctrl, unsigned int channel,
 		const uint8_t *buffer, size_t *length, void *user_data);
@@ -172,19 +180,27 @@ int rtt_stop(void);
  * Get the polling interval.
  *
  * @param[out] interval Polling interval in milliseconds.
+ * @param[out] min_interval Minimal polling interval in milliseconds, may be
+ *                          NULL.
  *
  * @returns ERROR_OK on success, an error code on failure.
  */
-int rtt_get_polling_interval(unsigned int *interval);
+int rtt_get_polling_interval(unsigned int *interval,
+		unsigned int *min_interval);
 
 /**
  * Set the polling interval.
  *
+ * The up-channels are polled every @a interval milliseconds while no data
+ * arrives. While they fill up, the interval is shortened down to
+ * @a min_interval.
+ *
  * @param[in] interval Polling interval in milliseconds.
+ * @param[in] min_interval Minimal polling interval in milliseconds.
  *
  * @returns ERROR_OK on success, an error code on failure.
  */
-int rtt_set_polling_interval(unsigned int interval);
+int rtt_set_polling_interval(unsigned int interval, unsigned int min_interval);
 
 /**
  * Get whether RTT is configured.
@@ -256,6 +272,33 @@ int rtt_unregister_sink(unsigned int channel_index, rtt_sink_read read,
 int rtt_write_channel(unsigned int channel_index, const uint8_t *buffer,
 		size_t *length);
 
+/**
+ * Queue data for an RTT down-channel.
+ *
+ * The data is written into the channel with the next poll of the
+ * up-channels, together with data queued before. Data that doesn't fit into
+ * the channel stays queued for the following polls.
+ *
+ * @param[in] channel_index Channel index.
+ * @param[in] buffer Buffer with data that should be written to the channel.
+ * @param[in,out] length Number of bytes to queue. On success, the argument
+ *                       gets updated with the number of queued bytes, which
+ *                       is less when the queue is full.
+ *
+ * @returns ERROR_OK on success, an error code on failure.
+ */
+int rtt_queue_write(unsigned int channel_index, const uint8_t *buffer,
+		size_t *length);
+
+/**
+ * Get the free space in the queue of an RTT down-channel.
+ *
+ * @param[in] channel_index Channel index.
+ *
+ * @returns Number of bytes that can be queued.
+ */
+size_t rtt_write_queue_space(unsigned int channel_index);
+
 extern const struct command_registration rtt_target_command_handlers[];
 
 #endif /* OPENOCD_RTT_RTT_H */
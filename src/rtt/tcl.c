@@ -73,24 +73,32 @@ COMMAND_HANDLER(handle_rtt_stop_command)
 
 COMMAND_HANDLER(handle_rtt_polling_interval_command)
 {
-	if (CMD_ARGC == 0) {
-		int ret;
-		unsigned int interval;
-
-		ret = rtt_get_polling_interval(&interval);
+	int ret;
+	unsigned int interval;
+	unsigned int min_interval;
 
-		if (ret != ERROR_OK) {
-			command_print(CMD, "Failed to get polling interval");
-			return ret;
-		}
+	ret = rtt_get_polling_interval(&interval, &min_interval);
 
-		command_print(CMD, "%u ms", interval);
-	} else if (CMD_ARGC == 1) {
-		int ret;
-		unsigned int interval;
+	if (ret != ERROR_OK) {
+		command_print(CMD, "Failed to get polling interval");
+		return ret;
+	}
 
+	if (CMD_ARGC == 0) {
+		if (min_interval < interval)
+			command_print(CMD, "%u ms, down to %u ms while data arrives",
+				interval, min_interval);
+		else
+			command_print(CMD, "%u ms", interval);
+	} else if (CMD_ARGC <= 2) {
 		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], interval);
-		ret = rtt_set_polling_interval(interval);
+
+		if (CMD_ARGC == 2)
+			COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], min_interval);
+		else
+			min_interval = MIN(min_interval, interval);
+
+		ret = rtt_set_polling_interval(interval, min_interval);
 
 		if (ret != ERROR_OK) {
 			command_print(CMD, "Failed to set polling interval");
@@ -245,7 +253,7 @@ static const struct command_registration rtt_subcommand_handlers[] = {
 		.handler = handle_rtt_polling_interval_command,
 		.mode = COMMAND_EXEC,
 		.help = "show or set polling interval in ms",
-		.usage = "[interval]"
+		.usage = "[interval [min_interval]]"
 	},
 	{
 		.name = "channels",
@@ -29,9 +29,7 @@ struct rtt_service {
 };
 
 struct rtt_connection_data {
-	unsigned char buffer[64];
-	unsigned int length;
-	unsigned int offset;
+	unsigned char buffer[4096];
 };
 
 static int read_callback(unsigned int channel, const uint8_t *buffer,
@@ -102,46 +100,45 @@ static int rtt_connection_closed(struct connection *connection)
 
 static int rtt_input(struct connection *connection)
 {
+	int bytes_read;
+	size_t length, space;
 	struct rtt_service *service;
 	struct rtt_connection_data *data;
 
 	data = connection->priv;
 	service = connection->service->priv;
+	space = rtt_write_queue_space(service->channel);
+
+	/*
+	 * Stop reading from the socket while the queue of the down-channel is
+	 * full. The client is slowed down by TCP flow control until the target
+	 * has consumed enough data.
+	 */
+	if (!space) {
+		connection->input_throttled = true;
+		connection->input_pending = true;
+		return ERROR_OK;
+	}
 
-	if (!connection->input_pending) {
-		int bytes_read;
+	if (connection->input_throttled) {
+		connection->input_throttled = false;
+		connection->input_pending = false;
+		return ERROR_OK;
+	}
 
-		bytes_read = connection_read(connection, data->buffer, sizeof(data->buffer));
+	bytes_read = connection_read(connection, data->buffer,
+		MIN(sizeof(data->buffer), space));
 
-		if (!bytes_read) {
-			return ERROR_SERVER_REMOTE_CLOSED;
-		} else if (bytes_read < 0) {
-			LOG_ERROR("error during read: %s", strerror(errno));
-			return ERROR_SERVER_REMOTE_CLOSED;
-		}
-
-		data->length = bytes_read;
-		data->offset = 0;
+	if (!bytes_read) {
+		return ERROR_SERVER_REMOTE_CLOSED;
+	} else if (bytes_read < 0) {
+		LOG_ERROR("error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
 	}
-	if (data->length > 0) {
-		unsigned char *ptr;
-		size_t length, to_write;
-
-		ptr = data->buffer + data->offset;
-		length = data->length - data->offset;
-		to_write = length;
-		rtt_write_channel(service->channel, ptr, &length);
-
-		if (length < to_write) {
-			data->offset += length;
-			connection->input_pending = true;
-		} else {
-			data->offset = 0;
-			data->length = 0;
-			connection->input_pending = false;
-		}
-	}
-	return ERROR_OK;
+
+	length = bytes_read;
+
+	return rtt_queue_write(service->channel, data->buffer, &length);
 }
 
 static const struct service_driver rtt_service_driver = {
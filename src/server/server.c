@@ -68,6 +68,7 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	c->cmd_ctx = copy_command_context(cmd_ctx);
 	c->service = service;
 	c->input_pending = false;
+	c->input_throttled = false;
 	c->priv = NULL;
 	c->next = NULL;
 
@@ -432,8 +433,6 @@ int server_loop(struct command_context *command_context)
 	/* used in accept() */
 	int retval;
 
-	int64_t next_event = timeval_ms() + polling_period;
-
 #ifndef _WIN32
 	if (signal(SIGPIPE, SIG_IGN) == SIG_ERR)
 		LOG_ERROR("couldn't set SIGPIPE to SIG_IGN");
@@ -458,6 +457,9 @@ int server_loop(struct command_context *command_context)
 				struct connection *c;
 
 				for (c = service->connections; c; c = c->next) {
+					if (c->input_throttled)
+						continue;
+
 					/* check for activity on the connection */
 					FD_SET(c->fd, &read_fds);
 					if (c->fd > fd_max)
@@ -474,13 +476,18 @@ int server_loop(struct command_context *command_context)
 			tv.tv_usec = 0;
 			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
 		} else {
-			/* Timeout socket_select() when a target timer expires or every polling_period */
+			/* Timeout socket_select() when a target timer expires or every polling_period.
+			 * Timers may have been added while serving connections, so look at
+			 * the current next deadline rather than the one from the last round. */
+			int64_t next_event = target_timer_next_event();
 			int timeout_ms = next_event - timeval_ms();
 			if (timeout_ms < 0)
 				timeout_ms = 0;
 			else if (timeout_ms > polling_period)
 				timeout_ms = polling_period;
 			tv.tv_usec = timeout_ms * 1000;
+			/* Don't keep buffered debug messages while idle */
+			log_flush();
 			/* Only while we're sleeping we'll let others run */
 			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
 		}
@@ -514,7 +521,6 @@ int server_loop(struct command_context *command_context)
 			 *   timers expired or the polling period elapsed
 			 */
 			target_call_timer_callbacks();
-			next_event = target_timer_next_event();
 			process_jim_events(command_context);
 
 			FD_ZERO(&read_fds);	/* eCos leaves read_fds unchanged in this case!  */
@@ -40,6 +40,8 @@ struct connection {
 	struct command_context *cmd_ctx;
 	struct service *service;
 	bool input_pending;
+	/* Don't watch the socket while the service can't take more input */
+	bool input_throttled;
 	void *priv;
 	struct connection *next;
 };
@@ -201,9 +201,16 @@ struct svf_check_tdo_para {
 	int bit_len;		/* bit length to check */
 };
 
+/*
+ * TDO checks are deferred until the JTAG queue is executed. The queue is
+ * only executed when the scan buffers or the list of checks reach their
+ * limit, or when a command needs it.
+ */
 #define SVF_CHECK_TDO_PARA_SIZE 1024
+#define SVF_MAX_CHECK_TDO_PARA_TO_COMMIT (16 * 1024)
 static struct svf_check_tdo_para *svf_check_tdo_para;
 static int svf_check_tdo_para_index;
+static int svf_check_tdo_para_size;
 
 static int svf_read_command_from_file(FILE *fd);
 static int svf_check_tdo(void);
@@ -219,6 +226,11 @@ static size_t svf_command_buffer_size;
 static int svf_line_number;
 static int svf_getline(char **lineptr, size_t *n, FILE *stream);
 
+/* The file is read in large blocks, lines are split from the block */
+#define SVF_READ_BLOCK_SIZE (256 * 1024)
+static char *svf_read_block;
+static size_t svf_read_block_pos, svf_read_block_len;
+
 #define SVF_MAX_BUFFER_SIZE_TO_COMMIT   (1024 * 1024)
 static uint8_t *svf_tdi_buffer, *svf_tdo_buffer, *svf_mask_buffer;
 static int svf_buffer_index, svf_buffer_size;
@@ -234,10 +246,15 @@ static int svf_set_padding(struct svf_xxr_para *para, int len, unsigned char tdi
 
 /* Progress Indicator */
 static int svf_progress_enabled;
-static long svf_total_lines;
+static uint64_t svf_file_size;
 static int svf_percentage;
 static int svf_last_printed_percentage = -1;
 
+/* Statistics */
+static uint64_t svf_file_pos;
+static uint64_t svf_scan_bits;
+static unsigned int svf_flush_count;
+
 /*
  * macro is used to print the svf hex buffer at desired debug level
  * DEBUG, INFO, ERROR, USER
@@ -384,7 +401,7 @@ COMMAND_HANDLER(handle_svf_command)
 #define SVF_MAX_NUM_OF_OPTIONS 8
 	int command_num = 0;
 	int ret = ERROR_OK;
-	int64_t time_measure_ms;
+	int64_t start_ms, elapsed_ms, time_measure_ms;
 	int time_measure_s, time_measure_m;
 
 	/*
@@ -481,13 +498,21 @@ COMMAND_HANDLER(handle_svf_command)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
 	/* get time */
-	time_measure_ms = timeval_ms();
+	start_ms = timeval_ms();
+	time_measure_ms = start_ms;
 
 	/* init */
 	svf_line_number = 0;
 	svf_command_buffer_size = 0;
+	svf_read_block_pos = 0;
+	svf_read_block_len = 0;
+	svf_file_pos = 0;
+	svf_scan_bits = 0;
+	svf_flush_count = 0;
+	svf_last_printed_percentage = -1;
 
 	svf_check_tdo_para_index = 0;
+	svf_check_tdo_para_size = SVF_CHECK_TDO_PARA_SIZE;
 	svf_check_tdo_para = malloc(sizeof(struct svf_check_tdo_para) * SVF_CHECK_TDO_PARA_SIZE);
 	if (!svf_check_tdo_para) {
 		LOG_ERROR("not enough memory");
@@ -560,19 +585,23 @@ COMMAND_HANDLER(handle_svf_command)
 		}
 	}
 
-	if (svf_progress_enabled) {
-		/* Count total lines in file. */
-		while (!feof(svf_fd)) {
-			svf_getline(&svf_command_buffer, &svf_command_buffer_size, svf_fd);
-			svf_total_lines++;
-		}
-		rewind(svf_fd);
+	/* The progress is based on the position in the file */
+	svf_file_size = 0;
+	if (fseek(svf_fd, 0, SEEK_END) == 0) {
+		long size = ftell(svf_fd);
+
+		if (size > 0)
+			svf_file_size = size;
 	}
+	rewind(svf_fd);
+
 	while (svf_read_command_from_file(svf_fd) == ERROR_OK) {
+		if (svf_file_size)
+			svf_percentage = ((svf_file_pos * 20) / svf_file_size) * 5;
+
 		/* Log Output */
 		if (svf_quiet) {
 			if (svf_progress_enabled) {
-				svf_percentage = ((svf_line_number * 20) / svf_total_lines) * 5;
 				if (svf_last_printed_percentage != svf_percentage) {
 					LOG_USER_N("\r%d%%    ", svf_percentage);
 					svf_last_printed_percentage = svf_percentage;
@@ -580,7 +609,6 @@ COMMAND_HANDLER(handle_svf_command)
 			}
 		} else {
 			if (svf_progress_enabled) {
-				svf_percentage = ((svf_line_number * 20) / svf_total_lines) * 5;
 				LOG_USER_N("%3d%%  %s", svf_percentage, svf_read_line);
 			} else
 				LOG_USER_N("%s", svf_read_line);
@@ -612,6 +640,12 @@ COMMAND_HANDLER(handle_svf_command)
 			time_measure_s,
 			time_measure_ms);
 
+	elapsed_ms = MAX(timeval_ms() - start_ms, 1);
+	command_print(CMD, "%" PRIu64 " bytes parsed (%" PRIu64 " KiB/s), "
+		"%" PRIu64 " bits scanned (%" PRIu64 " kbit/s), %u queue flushes",
+		svf_file_pos, svf_file_pos * 1000 / 1024 / elapsed_ms,
+		svf_scan_bits, svf_scan_bits / elapsed_ms, svf_flush_count);
+
 free_all:
 
 	fclose(svf_fd);
@@ -622,9 +656,15 @@ free_all:
 	svf_command_buffer = NULL;
 	svf_command_buffer_size = 0;
 
+	free(svf_read_block);
+	svf_read_block = NULL;
+	svf_read_block_pos = 0;
+	svf_read_block_len = 0;
+
 	free(svf_check_tdo_para);
 	svf_check_tdo_para = NULL;
 	svf_check_tdo_para_index = 0;
+	svf_check_tdo_para_size = 0;
 
 	free(svf_tdi_buffer);
 	svf_tdi_buffer = NULL;
@@ -660,7 +700,7 @@ free_all:
 
 static int svf_getline(char **lineptr, size_t *n, FILE *stream)
 {
-#define MIN_CHUNK 16	/* Buffer is increased by this size each time as required */
+#define MIN_CHUNK 16	/* Minimal size of the line buffer */
 	size_t i = 0;
 
 	if (!*lineptr) {
@@ -670,22 +710,54 @@ static int svf_getline(char **lineptr, size_t *n, FILE *stream)
 			return -1;
 	}
 
-	(*lineptr)[0] = fgetc(stream);
-	while ((*lineptr)[i] != '\n') {
-		(*lineptr)[++i] = fgetc(stream);
-		if (feof(stream)) {
-			(*lineptr)[0] = 0;
+	if (!svf_read_block) {
+		svf_read_block = malloc(SVF_READ_BLOCK_SIZE);
+		if (!svf_read_block)
 			return -1;
+	}
+
+	while (true) {
+		if (svf_read_block_pos == svf_read_block_len) {
+			svf_read_block_pos = 0;
+			svf_read_block_len = fread(svf_read_block, 1, SVF_READ_BLOCK_SIZE, stream);
+
+			/* a last line without newline is dropped */
+			if (!svf_read_block_len) {
+				(*lineptr)[0] = 0;
+				return -1;
+			}
 		}
-		if ((i + 2) > *n) {
-			*n += MIN_CHUNK;
-			*lineptr = realloc(*lineptr, *n);
+
+		char *start = svf_read_block + svf_read_block_pos;
+		size_t length = svf_read_block_len - svf_read_block_pos;
+		char *end = memchr(start, '\n', length);
+
+		if (end)
+			length = end - start + 1;
+
+		if (i + length + 1 > *n) {
+			size_t size = MAX(2 * *n, i + length + 1);
+			char *ptr = realloc(*lineptr, size);
+
+			if (!ptr)
+				return -1;
+
+			*lineptr = ptr;
+			*n = size;
 		}
+
+		memcpy(*lineptr + i, start, length);
+		i += length;
+		svf_read_block_pos += length;
+		svf_file_pos += length;
+
+		if (end)
+			break;
 	}
 
-	(*lineptr)[++i] = 0;
+	(*lineptr)[i] = 0;
 
-	return sizeof(*lineptr);
+	return i;
 }
 
 #define SVFP_CMD_INC_CNT 1024
@@ -749,8 +821,11 @@ static int svf_read_command_from_file(FILE *fd)
 				 *  - terminating NUL ('\0')
 				 */
 				if (cmd_pos + 3 > svf_command_buffer_size) {
-					svf_command_buffer = realloc(svf_command_buffer, cmd_pos + 3);
-					svf_command_buffer_size = cmd_pos + 3;
+					size_t size = MAX(2 * svf_command_buffer_size,
+						cmd_pos + SVFP_CMD_INC_CNT);
+
+					svf_command_buffer = realloc(svf_command_buffer, size);
+					svf_command_buffer_size = size;
 					if (!svf_command_buffer) {
 						LOG_ERROR("not enough memory");
 						return ERROR_FAIL;
@@ -953,9 +1028,18 @@ static int svf_check_tdo(void)
 
 static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len)
 {
-	if (svf_check_tdo_para_index >= SVF_CHECK_TDO_PARA_SIZE) {
-		LOG_ERROR("toooooo many operation undone");
-		return ERROR_FAIL;
+	if (svf_check_tdo_para_index >= svf_check_tdo_para_size) {
+		int size = 2 * svf_check_tdo_para_size;
+		struct svf_check_tdo_para *para;
+
+		para = realloc(svf_check_tdo_para, sizeof(*para) * size);
+		if (!para) {
+			LOG_ERROR("not enough memory");
+			return ERROR_FAIL;
+		}
+
+		svf_check_tdo_para = para;
+		svf_check_tdo_para_size = size;
 	}
 
 	svf_check_tdo_para[svf_check_tdo_para_index].line_num = svf_line_number;
@@ -969,6 +1053,8 @@ static int svf_add_check_para(uint8_t enabled, int buffer_offset, int bit_len)
 
 static int svf_execute_tap(void)
 {
+	svf_flush_count++;
+
 	if ((!svf_nil) && (jtag_execute_queue() != ERROR_OK))
 		return ERROR_FAIL;
 	else if (svf_check_tdo() != ERROR_OK)
@@ -1262,9 +1348,11 @@ xxr_common:
 							svf_para.tdr_para.len);
 					i += svf_para.tdr_para.len;
 
-					svf_add_check_para(1, svf_buffer_index, i);
-				} else
-					svf_add_check_para(0, svf_buffer_index, i);
+					if (svf_add_check_para(1, svf_buffer_index, i) != ERROR_OK)
+						return ERROR_FAIL;
+				} else if (svf_add_check_para(0, svf_buffer_index, i) != ERROR_OK) {
+					return ERROR_FAIL;
+				}
 				field.num_bits = i;
 				field.out_value = &svf_tdi_buffer[svf_buffer_index];
 				field.in_value = (xxr_para_tmp->data_mask & XXR_TDO) ? &svf_tdi_buffer[svf_buffer_index] : NULL;
@@ -1280,6 +1368,7 @@ xxr_common:
 					jtag_add_clocks(svf_addcycles);
 
 				svf_buffer_index += (i + 7) >> 3;
+				svf_scan_bits += i;
 			} else if (command == SIR) {
 				/* check buffer size first, reallocate if necessary */
 				i = svf_para.hir_para.len + svf_para.sir_para.len +
@@ -1355,9 +1444,11 @@ xxr_common:
 							svf_para.tir_para.len);
 					i += svf_para.tir_para.len;
 
-					svf_add_check_para(1, svf_buffer_index, i);
-				} else
-					svf_add_check_para(0, svf_buffer_index, i);
+					if (svf_add_check_para(1, svf_buffer_index, i) != ERROR_OK)
+						return ERROR_FAIL;
+				} else if (svf_add_check_para(0, svf_buffer_index, i) != ERROR_OK) {
+					return ERROR_FAIL;
+				}
 				field.num_bits = i;
 				field.out_value = &svf_tdi_buffer[svf_buffer_index];
 				field.in_value = (xxr_para_tmp->data_mask & XXR_TDO) ? &svf_tdi_buffer[svf_buffer_index] : NULL;
@@ -1370,6 +1461,7 @@ xxr_common:
 				}
 
 				svf_buffer_index += (i + 7) >> 3;
+				svf_scan_bits += i;
 			}
 			break;
 		case PIO:
@@ -1620,7 +1712,7 @@ xxr_common:
 		/* for fast executing, execute tap if necessary */
 		/* half of the buffer is for the next command */
 		if (((svf_buffer_index >= SVF_MAX_BUFFER_SIZE_TO_COMMIT) ||
-				(svf_check_tdo_para_index >= SVF_CHECK_TDO_PARA_SIZE / 2)) &&
+				(svf_check_tdo_para_index >= SVF_MAX_CHECK_TDO_PARA_TO_COMMIT)) &&
 				(((command != STATE) && (command != RUNTEST)) ||
 						((command == STATE) && (num_of_argu == 2))))
 			return svf_execute_tap();
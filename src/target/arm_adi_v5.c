@@ -180,20 +180,35 @@ static uint32_t mem_ap_get_tar_increment(struct adiv5_ap *ap)
 	return 0;
 }
 
-/* mem_ap_update_tar_cache is called after an access to MEM_AP_REG_DRW
+/* mem_ap_update_tar_cache is called after @a transfers accesses to MEM_AP_REG_DRW
  */
-static void mem_ap_update_tar_cache(struct adiv5_ap *ap)
+static void mem_ap_update_tar_cache(struct adiv5_ap *ap, size_t transfers)
 {
 	if (!ap->tar_valid)
 		return;
 
-	uint32_t inc = mem_ap_get_tar_increment(ap);
+	uint64_t inc = (uint64_t)mem_ap_get_tar_increment(ap) * transfers;
 	if (inc >= max_tar_block_size(ap->tar_autoincr_block, ap->tar_value))
 		ap->tar_valid = false;
 	else
 		ap->tar_value += inc;
 }
 
+/* Number of transfers of @a this_size bytes, out of the remaining @a nbytes,
+ * that can follow the setup of TAR to @a address before TAR has to be
+ * written again because the auto-increment would leave its block. */
+static size_t mem_ap_chunk_transfers(struct adiv5_ap *ap, unsigned int this_size,
+		target_addr_t address, size_t nbytes, bool addrinc)
+{
+	size_t transfers = nbytes / this_size;
+
+	if (addrinc)
+		transfers = MIN(transfers,
+			max_tar_block_size(ap->tar_autoincr_block, address) / this_size);
+
+	return MAX(transfers, 1);
+}
+
 /**
  * Queue transactions setting up transfer parameters for the
  * currently selected MEM-AP.
@@ -523,54 +538,62 @@ static int mem_ap_write(struct adiv5_ap *ap, const uint8_t *buffer, uint32_t siz
 		if (retval != ERROR_OK)
 			return retval;
 
-		/* How many source bytes each transfer will consume, and their location in the DRW,
-		 * depends on the type of transfer and alignment. See ARM document IHI0031C. */
-		uint32_t drw_byte_idx = address;
-		unsigned int drw_ops = DIV_ROUND_UP(this_size, 4);
-
-		while (drw_ops--) {
-			uint32_t outvalue = 0;
-			if (dap->nu_npcx_quirks && this_size <= 2) {
-				switch (this_size) {
-				case 2:
-					{
-						/* Alternate low and high byte to all byte lanes */
-						uint32_t low = *buffer++;
-						uint32_t high = *buffer++;
-						outvalue |= low << 8 * (drw_byte_idx++ & 3);
-						outvalue |= high << 8 * (drw_byte_idx++ & 3);
-						outvalue |= low << 8 * (drw_byte_idx++ & 3);
-						outvalue |= high << 8 * (drw_byte_idx & 3);
-					}
-					break;
-				case 1:
-					{
-						/* Mirror output byte to all byte lanes */
-						uint32_t data = *buffer++;
-						outvalue |= data;
-						outvalue |= data << 8;
-						outvalue |= data << 16;
-						outvalue |= data << 24;
+		/* Queue all transfers up to the next TAR reload. With the TI BE-32
+		 * quirks TAR is set for every transfer of less than 32 bits. */
+		size_t transfers = ti_be_addr_xor ? 1 :
+			mem_ap_chunk_transfers(ap, this_size, address, nbytes, addrinc);
+
+		for (size_t i = 0; i < transfers && retval == ERROR_OK; i++) {
+			/* How many source bytes each transfer will consume, and their location in the DRW,
+			 * depends on the type of transfer and alignment. See ARM document IHI0031C. */
+			uint32_t drw_byte_idx = address;
+			unsigned int drw_ops = DIV_ROUND_UP(this_size, 4);
+
+			while (drw_ops--) {
+				uint32_t outvalue = 0;
+				if (dap->nu_npcx_quirks && this_size <= 2) {
+					switch (this_size) {
+					case 2:
+						{
+							/* Alternate low and high byte to all byte lanes */
+							uint32_t low = *buffer++;
+							uint32_t high = *buffer++;
+							outvalue |= low << 8 * (drw_byte_idx++ & 3);
+							outvalue |= high << 8 * (drw_byte_idx++ & 3);
+							outvalue |= low << 8 * (drw_byte_idx++ & 3);
+							outvalue |= high << 8 * (drw_byte_idx & 3);
+						}
+						break;
+					case 1:
+						{
+							/* Mirror output byte to all byte lanes */
+							uint32_t data = *buffer++;
+							outvalue |= data;
+							outvalue |= data << 8;
+							outvalue |= data << 16;
+							outvalue |= data << 24;
+						}
 					}
+				} else {
+					unsigned int drw_bytes = MIN(this_size, 4);
+					while (drw_bytes--)
+						outvalue |= (uint32_t)*buffer++ <<
+									8 * ((drw_byte_idx++ & 3) ^ ti_be_lane_xor);
 				}
-			} else {
-				unsigned int drw_bytes = MIN(this_size, 4);
-				while (drw_bytes--)
-					outvalue |= (uint32_t)*buffer++ <<
-								8 * ((drw_byte_idx++ & 3) ^ ti_be_lane_xor);
+
+				retval = dap_queue_ap_write(ap, MEM_AP_REG_DRW(dap), outvalue);
+				if (retval != ERROR_OK)
+					break;
 			}
 
-			retval = dap_queue_ap_write(ap, MEM_AP_REG_DRW(dap), outvalue);
-			if (retval != ERROR_OK)
-				break;
+			nbytes -= this_size;
+			if (addrinc)
+				address += this_size;
 		}
 		if (retval != ERROR_OK)
 			break;
 
-		mem_ap_update_tar_cache(ap);
-		nbytes -= this_size;
-		if (addrinc)
-			address += this_size;
+		mem_ap_update_tar_cache(ap, transfers);
 	}
 
 	/* REVISIT: Might want to have a queued version of this function that does not run. */
@@ -588,27 +611,9 @@ static int mem_ap_write(struct adiv5_ap *ap, const uint8_t *buffer, uint32_t siz
 	return retval;
 }
 
-/**
- * Synchronous read of a block of memory, using a specific access size.
- *
- * @param ap The MEM-AP to access.
- * @param buffer The data buffer to receive the data. No particular alignment is assumed.
- * @param size Which access size to use, in bytes. 1, 2, or 4.
- *	If large data extension is available also accepts sizes 8, 16, 32.
- * @param count The number of reads to do (in size units, not bytes).
- * @param adr Address to be read; it must be readable by the currently selected MEM-AP.
- * @param addrinc Whether the target address should be increased after each read or not. This
- *  should normally be true, except when reading from e.g. a FIFO.
- * @return ERROR_OK on success, otherwise an error code.
- */
-static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint32_t count,
-		target_addr_t adr, bool addrinc)
+/* Check the arguments of a mem_ap_read() style access */
+static int mem_ap_read_check(struct adiv5_ap *ap, uint32_t size, target_addr_t adr)
 {
-	struct adiv5_dap *dap = ap->dap;
-	size_t nbytes = size * count;
-	target_addr_t address = adr;
-	int retval = ERROR_OK;
-
 	/* TI BE-32 Quirks mode:
 	 * Reads on big-endian TMS570 behave strangely differently than writes.
 	 * They read from the physical address requested, but with DRW byte-reversed.
@@ -616,7 +621,7 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 	 * Also, packed 8-bit and 16-bit transfers seem to sometimes return garbage in some bytes,
 	 * so avoid them (ap->packed_transfers is forced to false in mem_ap_init). */
 
-	if (dap->ti_be_32_quirks && size > 4) {
+	if (ap->dap->ti_be_32_quirks && size > 4) {
 		LOG_ERROR("Read more than 32 bits not supported with ti_be_32_quirks");
 		return ERROR_TARGET_SIZE_NOT_SUPPORTED;
 	}
@@ -624,19 +629,20 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 	if (ap->unaligned_access_bad && (adr % size != 0))
 		return ERROR_TARGET_UNALIGNED_ACCESS;
 
-	/* Allocate buffer to hold the sequence of DRW reads that will be made. This is a significant
-	 * over-allocation if packed transfers are going to be used, but determining the real need at
-	 * this point would be messy. */
-	uint32_t *read_buf = calloc(count, MAX(sizeof(uint32_t), size));
+	return ERROR_OK;
+}
 
-	/* Multiplication count * sizeof(uint32_t) may overflow, calloc() is safe */
+/* Queue up all DRW reads of a block into @a read_buf, which must hold
+ * count * MAX(4, size) bytes. The queue is not run. */
+static int mem_ap_read_queue(struct adiv5_ap *ap, uint32_t *read_buf, uint32_t size, uint32_t count,
+		target_addr_t address, bool addrinc)
+{
+	struct adiv5_dap *dap = ap->dap;
+	size_t nbytes = size * count;
 	uint32_t *read_ptr = read_buf;
-	if (!read_buf) {
-		LOG_ERROR("Failed to allocate read buffer");
-		return ERROR_FAIL;
-	}
+	int retval = ERROR_OK;
 
-	/* Queue up all reads. Each read will store the entire DRW word in the read buffer. How many
+	/* Each read will store the entire DRW word in the read buffer. How many
 	 * useful bytes it contains, and their location in the word, depends on the type of transfer
 	 * and alignment. */
 	while (nbytes > 0) {
@@ -647,49 +653,35 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 		if (retval != ERROR_OK)
 			break;
 
-
-		unsigned int drw_ops = DIV_ROUND_UP(this_size, 4);
+		/* Queue all reads up to the next TAR reload */
+		size_t transfers = mem_ap_chunk_transfers(ap, this_size, address, nbytes, addrinc);
+		size_t drw_ops = transfers * DIV_ROUND_UP(this_size, 4);
 		while (drw_ops--) {
 			retval = dap_queue_ap_read(ap, MEM_AP_REG_DRW(dap), read_ptr++);
 			if (retval != ERROR_OK)
 				break;
 		}
+		if (retval != ERROR_OK)
+			break;
 
-		nbytes -= this_size;
+		nbytes -= transfers * this_size;
 		if (addrinc)
-			address += this_size;
+			address += transfers * this_size;
 
-		mem_ap_update_tar_cache(ap);
+		mem_ap_update_tar_cache(ap, transfers);
 	}
 
-	if (retval == ERROR_OK)
-		retval = dap_run(dap);
-
-	/* Restore state */
-	address = adr;
-	nbytes = size * count;
-	read_ptr = read_buf;
-
-	/* If something failed, read TAR to find out how much data was successfully read, so we can
-	 * at least give the caller what we have. */
-	if (retval == ERROR_TARGET_SIZE_NOT_SUPPORTED) {
-		nbytes = 0;
-	} else if (retval != ERROR_OK) {
-		target_addr_t tar;
-		if (mem_ap_read_tar(ap, &tar) == ERROR_OK) {
-			/* TAR is incremented after failed transfer on some devices (eg Cortex-M4) */
-			LOG_ERROR("Failed to read memory at " TARGET_ADDR_FMT, tar);
-			if (nbytes > tar - address)
-				nbytes = tar - address;
-		} else {
-			LOG_ERROR("Failed to read memory and, additionally, failed to find out where");
-			nbytes = 0;
-		}
-	}
+	return retval;
+}
 
-	target_addr_t ti_be_lane_xor = dap->ti_be_32_quirks ? 3 : 0;
+/* Populate caller's buffer from the correct DRW word and byte lane of the
+ * @a nbytes read into @a read_buf by mem_ap_read_queue() */
+static void mem_ap_read_unpack(struct adiv5_ap *ap, uint8_t *buffer, const uint32_t *read_buf,
+		uint32_t size, size_t nbytes, target_addr_t address, bool addrinc)
+{
+	const uint32_t *read_ptr = read_buf;
+	target_addr_t ti_be_lane_xor = ap->dap->ti_be_32_quirks ? 3 : 0;
 
-	/* Replay loop to populate caller's buffer from the correct word and byte lane */
 	while (nbytes > 0) {
 		/* Convert transfers longer than 32-bit on word-at-a-time basis */
 		unsigned int this_size = MIN(size, 4);
@@ -714,8 +706,121 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 		read_ptr++;
 		nbytes -= this_size;
 	}
+}
+
+/**
+ * Synchronous read of a block of memory, using a specific access size.
+ *
+ * @param ap The MEM-AP to access.
+ * @param buffer The data buffer to receive the data. No particular alignment is assumed.
+ * @param size Which access size to use, in bytes. 1, 2, or 4.
+ *	If large data extension is available also accepts sizes 8, 16, 32.
+ * @param count The number of reads to do (in size units, not bytes).
+ * @param adr Address to be read; it must be readable by the currently selected MEM-AP.
+ * @param addrinc Whether the target address should be increased after each read or not. This
+ *  should normally be true, except when reading from e.g. a FIFO.
+ * @return ERROR_OK on success, otherwise an error code.
+ */
+static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint32_t count,
+		target_addr_t adr, bool addrinc)
+{
+	size_t nbytes = size * count;
+	target_addr_t address = adr;
+
+	int retval = mem_ap_read_check(ap, size, adr);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* Allocate buffer to hold the sequence of DRW reads that will be made. This is a significant
+	 * over-allocation if packed transfers are going to be used, but determining the real need at
+	 * this point would be messy. */
+	uint32_t *read_buf = calloc(count, MAX(sizeof(uint32_t), size));
+
+	/* Multiplication count * sizeof(uint32_t) may overflow, calloc() is safe */
+	if (!read_buf) {
+		LOG_ERROR("Failed to allocate read buffer");
+		return ERROR_FAIL;
+	}
+
+	retval = mem_ap_read_queue(ap, read_buf, size, count, address, addrinc);
+	if (retval == ERROR_OK)
+		retval = dap_run(ap->dap);
+
+	/* If something failed, read TAR to find out how much data was successfully read, so we can
+	 * at least give the caller what we have. */
+	if (retval == ERROR_TARGET_SIZE_NOT_SUPPORTED) {
+		nbytes = 0;
+	} else if (retval != ERROR_OK) {
+		target_addr_t tar;
+		if (mem_ap_read_tar(ap, &tar) == ERROR_OK) {
+			/* TAR is incremented after failed transfer on some devices (eg Cortex-M4) */
+			LOG_ERROR("Failed to read memory at " TARGET_ADDR_FMT, tar);
+			if (nbytes > tar - address)
+				nbytes = tar - address;
+		} else {
+			LOG_ERROR("Failed to read memory and, additionally, failed to find out where");
+			nbytes = 0;
+		}
+	}
+
+	mem_ap_read_unpack(ap, buffer, read_buf, size, nbytes, address, addrinc);
+
+	free(read_buf);
+	return retval;
+}
+
+int mem_ap_read_buf_multi(struct adiv5_ap *ap,
+		unsigned int num, const struct target_memory_chunk *chunks)
+{
+	size_t words = 0;
+	int retval;
+
+	for (unsigned int i = 0; i < num; i++) {
+		retval = mem_ap_read_check(ap, chunks[i].size, chunks[i].address);
+		if (retval != ERROR_OK)
+			return retval;
+		words += (size_t)chunks[i].count * MAX(sizeof(uint32_t), chunks[i].size) / sizeof(uint32_t);
+	}
+
+	uint32_t *read_buf = calloc(words, sizeof(uint32_t));
+	if (!read_buf) {
+		LOG_ERROR("Failed to allocate read buffer");
+		return ERROR_FAIL;
+	}
+
+	/* Queue all regions, run the queue once */
+	uint32_t *read_ptr = read_buf;
+	retval = ERROR_OK;
+	for (unsigned int i = 0; i < num && retval == ERROR_OK; i++) {
+		retval = mem_ap_read_queue(ap, read_ptr, chunks[i].size, chunks[i].count,
+				chunks[i].address, true);
+		read_ptr += chunks[i].count * MAX(sizeof(uint32_t), chunks[i].size) / sizeof(uint32_t);
+	}
+	if (retval == ERROR_OK)
+		retval = dap_run(ap->dap);
+
+	if (retval == ERROR_OK) {
+		read_ptr = read_buf;
+		for (unsigned int i = 0; i < num; i++) {
+			mem_ap_read_unpack(ap, chunks[i].buffer, read_ptr, chunks[i].size,
+					chunks[i].size * chunks[i].count, chunks[i].address, true);
+			read_ptr += chunks[i].count * MAX(sizeof(uint32_t), chunks[i].size) / sizeof(uint32_t);
+		}
+	}
 
 	free(read_buf);
+
+	if (retval != ERROR_OK && retval != ERROR_TARGET_SIZE_NOT_SUPPORTED) {
+		/* Find out which region failed, with precise error reporting */
+		LOG_DEBUG("multi-region read failed, retrying region by region");
+		for (unsigned int i = 0; i < num; i++) {
+			retval = mem_ap_read(ap, chunks[i].buffer, chunks[i].size, chunks[i].count,
+					chunks[i].address, true);
+			if (retval != ERROR_OK)
+				break;
+		}
+	}
+
 	return retval;
 }
 
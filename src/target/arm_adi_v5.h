@@ -724,6 +724,11 @@ int mem_ap_read_buf_noincr(struct adiv5_ap *ap,
 int mem_ap_write_buf_noincr(struct adiv5_ap *ap,
 		const uint8_t *buffer, uint32_t size, uint32_t count, target_addr_t address);
 
+/* Synchronous read of several blocks, sharing a single queue run. */
+struct target_memory_chunk;
+int mem_ap_read_buf_multi(struct adiv5_ap *ap,
+		unsigned int num, const struct target_memory_chunk *chunks);
+
 /* Initialisation of the debug system, power domains and registers */
 int dap_dp_init(struct adiv5_dap *dap);
 int dap_dp_init_or_reconnect(struct adiv5_dap *dap);
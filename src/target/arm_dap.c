@@ -17,6 +17,8 @@
 #include "helper/command.h"
 #include "transport/transport.h"
 #include "jtag/interface.h"
+#include "jtag/adapter_trace.h"
+#include "jtag/adapter_worker.h"
 
 static OOCD_LIST_HEAD(all_dap);
 
@@ -108,7 +110,8 @@ static int dap_init_all(void)
 
 		if (transport_is_swd()) {
 			dap->ops = &swd_dap_ops;
-			obj->swd = adapter_driver->swd_ops;
+			obj->swd = adapter_worker_swd_driver(
+				adapter_trace_swd_driver(adapter_driver->swd_ops));
 		} else if (transport_is_dapdirect_swd()) {
 			dap->ops = adapter_driver->dap_swd_ops;
 		} else if (transport_is_dapdirect_jtag()) {
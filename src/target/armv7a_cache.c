@@ -15,6 +15,7 @@
 #include "armv7a_cache.h"
 #include <helper/time_support.h>
 #include "arm_opcodes.h"
+#include "mem_cache.h"
 #include "smp.h"
 
 static int armv7a_l1_d_cache_sanity_check(struct target *target)
@@ -96,6 +97,9 @@ static int armv7a_l1_d_cache_clean_inval_all(struct target *target)
 	if (retval != ERROR_OK)
 		return retval;
 
+	/* written back or discarded lines change the memory seen through the bus */
+	mem_cache_invalidate(target);
+
 	retval = dpm->prepare(dpm);
 	if (retval != ERROR_OK)
 		goto done;
@@ -157,6 +161,9 @@ int armv7a_l1_d_cache_inval_virt(struct target *target, uint32_t virt,
 	if (retval != ERROR_OK)
 		return retval;
 
+	/* written back or discarded lines change the memory seen through the bus */
+	mem_cache_invalidate(target);
+
 	retval = dpm->prepare(dpm);
 	if (retval != ERROR_OK)
 		goto done;
@@ -221,6 +228,9 @@ int armv7a_l1_d_cache_clean_virt(struct target *target, uint32_t virt,
 	if (retval != ERROR_OK)
 		return retval;
 
+	/* written back or discarded lines change the memory seen through the bus */
+	mem_cache_invalidate(target);
+
 	retval = dpm->prepare(dpm);
 	if (retval != ERROR_OK)
 		goto done;
@@ -265,6 +275,9 @@ int armv7a_l1_d_cache_flush_virt(struct target *target, uint32_t virt,
 	if (retval != ERROR_OK)
 		return retval;
 
+	/* written back or discarded lines change the memory seen through the bus */
+	mem_cache_invalidate(target);
+
 	retval = dpm->prepare(dpm);
 	if (retval != ERROR_OK)
 		goto done;
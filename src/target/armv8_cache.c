@@ -12,6 +12,7 @@
 #include "armv8_cache.h"
 #include "armv8_dpm.h"
 #include "armv8_opcodes.h"
+#include "mem_cache.h"
 #include "smp.h"
 
 /* CLIDR cache types */
@@ -113,6 +114,9 @@ int armv8_cache_d_inner_flush_virt(struct armv8_common *armv8, target_addr_t va,
 	if (retval != ERROR_OK)
 		return retval;
 
+	/* written back lines change the memory seen through the bus */
+	mem_cache_invalidate(armv8->arm.target);
+
 	retval = dpm->prepare(dpm);
 	if (retval != ERROR_OK)
 		goto done;
@@ -236,6 +240,9 @@ static int  armv8_flush_all_data(struct target *target)
 		return retval;
 	}
 
+	/* written back lines change the memory seen through the bus */
+	mem_cache_invalidate(target);
+
 	if (target->smp) {
 		/*  look if all the other target have been flushed in order to flush level
 		 *  2 */
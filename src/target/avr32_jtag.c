@@ -378,6 +378,89 @@ int avr32_jtag_mwa_read(struct avr32_jtag *jtag_info, int slave,
 	return ERROR_OK;
 }
 
+/* Number of words queued before the JTAG queue is executed */
+#define AVR32_MWA_BATCH		256
+
+/*
+ * Read a list of words with one JTAG queue run per batch instead of two
+ * per word. The busy flags are checked once the batch has been executed;
+ * words from the first busy one on are re-read one by one.
+ */
+int avr32_jtag_mwa_read_words(struct avr32_jtag *jtag_info, int slave,
+		const uint32_t *addrs, int count, uint32_t *values)
+{
+	uint8_t *addr_buf, *slave_buf, *abusy_buf, *data_buf, *dbusy_buf;
+	struct scan_field fields[2];
+	int retval = ERROR_OK;
+
+	addr_buf = calloc(AVR32_MWA_BATCH, 4 * 5);
+	if (!addr_buf)
+		return ERROR_FAIL;
+	slave_buf = addr_buf + 4 * AVR32_MWA_BATCH;
+	abusy_buf = slave_buf + 4 * AVR32_MWA_BATCH;
+	data_buf = abusy_buf + 4 * AVR32_MWA_BATCH;
+	dbusy_buf = data_buf + 4 * AVR32_MWA_BATCH;
+
+	for (int done = 0; done < count; ) {
+		int n = MIN(count - done, AVR32_MWA_BATCH);
+
+		retval = avr32_jtag_set_instr(jtag_info, AVR32_INST_MW_ACCESS);
+		if (retval != ERROR_OK)
+			break;
+
+		memset(addr_buf, 0, 4 * 5 * AVR32_MWA_BATCH);
+
+		for (int i = 0; i < n; i++) {
+			buf_set_u32(slave_buf + 4 * i, 0, 4, slave);
+			buf_set_u32(addr_buf + 4 * i, 0, 1, MODE_READ);
+			buf_set_u32(addr_buf + 4 * i, 1, 30, addrs[done + i] >> 2);
+
+			fields[0].num_bits = 31;
+			fields[0].in_value = NULL;
+			fields[0].out_value = addr_buf + 4 * i;
+			fields[1].num_bits = 4;
+			fields[1].in_value = abusy_buf + 4 * i;
+			fields[1].out_value = slave_buf + 4 * i;
+			jtag_add_dr_scan(jtag_info->tap, 2, fields, TAP_IDLE);
+
+			fields[0].num_bits = 32;
+			fields[0].out_value = NULL;
+			fields[0].in_value = data_buf + 4 * i;
+			fields[1].num_bits = 3;
+			fields[1].in_value = dbusy_buf + 4 * i;
+			fields[1].out_value = NULL;
+			jtag_add_dr_scan(jtag_info->tap, 2, fields, TAP_IDLE);
+		}
+
+		if (jtag_execute_queue() != ERROR_OK) {
+			LOG_ERROR("%s: reading data failed", __func__);
+			retval = ERROR_FAIL;
+			break;
+		}
+
+		int i;
+		for (i = 0; i < n; i++) {
+			if (buf_get_u32(abusy_buf + 4 * i, 1, 1) || buf_get_u32(dbusy_buf + 4 * i, 0, 1))
+				break;
+			values[done + i] = buf_get_u32(data_buf + 4 * i, 0, 32);
+		}
+
+		/* busy: the bus did not keep up, fall back to the handshaking path */
+		for (; i < n; i++) {
+			retval = avr32_jtag_mwa_read(jtag_info, slave, addrs[done + i], &values[done + i]);
+			if (retval != ERROR_OK)
+				break;
+		}
+		if (retval != ERROR_OK)
+			break;
+
+		done += n;
+	}
+
+	free(addr_buf);
+	return retval;
+}
+
 int avr32_jtag_mwa_write(struct avr32_jtag *jtag_info, int slave,
 		uint32_t addr, uint32_t value)
 {
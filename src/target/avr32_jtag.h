@@ -98,6 +98,8 @@ int avr32_jtag_nexus_write(struct avr32_jtag *jtag_info,
 
 int avr32_jtag_mwa_read(struct avr32_jtag *jtag_info, int slave,
 		uint32_t addr, uint32_t *value);
+int avr32_jtag_mwa_read_words(struct avr32_jtag *jtag_info, int slave,
+		const uint32_t *addrs, int count, uint32_t *values);
 int avr32_jtag_mwa_write(struct avr32_jtag *jtag_info, int slave,
 		uint32_t addr, uint32_t value);
 
@@ -17,18 +17,25 @@ int avr32_jtag_read_memory32(struct avr32_jtag *jtag_info,
 	uint32_t addr, int count, uint32_t *buffer)
 {
 	int i, retval;
-	uint32_t data;
+	uint32_t *addrs;
 
-	for (i = 0; i < count; i++) {
-		retval = avr32_jtag_mwa_read(jtag_info, SLAVE_HSB_UNCACHED,
-				addr + i*4, &data);
+	addrs = calloc(count, sizeof(uint32_t));
+	if (!addrs)
+		return ERROR_FAIL;
 
-		if (retval != ERROR_OK)
-			return retval;
+	for (i = 0; i < count; i++)
+		addrs[i] = addr + i*4;
 
-		/* XXX: Assume AVR32 is BE */
-		buffer[i] = be_to_h_u32((uint8_t *)&data);
-	}
+	retval = avr32_jtag_mwa_read_words(jtag_info, SLAVE_HSB_UNCACHED,
+			addrs, count, buffer);
+	free(addrs);
+
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* XXX: Assume AVR32 is BE */
+	for (i = 0; i < count; i++)
+		buffer[i] = be_to_h_u32((uint8_t *)&buffer[i]);
 
 	return ERROR_OK;
 }
@@ -452,6 +452,73 @@ static int avr32_uc3_read_memory(struct target *target, target_addr_t address,
 	return ERROR_OK;
 }
 
+static int avr32_uc3_read_memory_multi(struct target *target,
+	unsigned int num, const struct target_memory_chunk *chunks)
+{
+	struct avr32_uc3_common *uc3 = target_to_uc3(target);
+	uint32_t *addrs, *values;
+	int words = 0;
+	int retval;
+
+	if (target->state != TARGET_HALTED) {
+		LOG_TARGET_ERROR(target, "not halted");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	for (unsigned int i = 0; i < num; i++) {
+		uint32_t size = chunks[i].size;
+		target_addr_t address = chunks[i].address;
+
+		/* sanitize arguments */
+		if (((size != 4) && (size != 2) && (size != 1)) || (chunks[i].count == 0) || !chunks[i].buffer)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		if (((size == 4) && (address & 0x3u)) || ((size == 2) && (address & 0x1u)))
+			return ERROR_TARGET_UNALIGNED_ACCESS;
+
+		target_addr_t end = address + size * chunks[i].count;
+		words += ((end + 3) & ~3u) / 4 - address / 4;
+	}
+
+	addrs = calloc(words, sizeof(uint32_t));
+	values = malloc(words * sizeof(uint32_t));
+	if (!addrs || !values) {
+		free(addrs);
+		free(values);
+		return ERROR_FAIL;
+	}
+
+	/* Read all words covering the chunks in one go */
+	int n = 0;
+	for (unsigned int i = 0; i < num; i++) {
+		target_addr_t end = chunks[i].address + chunks[i].size * chunks[i].count;
+		for (target_addr_t a = chunks[i].address & ~3u; a < end; a += 4)
+			addrs[n++] = a;
+	}
+
+	retval = avr32_jtag_mwa_read_words(&uc3->jtag, SLAVE_HSB_UNCACHED, addrs, words, values);
+
+	if (retval == ERROR_OK) {
+		n = 0;
+		for (unsigned int i = 0; i < num; i++) {
+			target_addr_t address = chunks[i].address;
+			uint32_t len = chunks[i].size * chunks[i].count;
+			uint8_t *buffer = chunks[i].buffer;
+
+			/* Pick the bytes out of the big-endian words */
+			for (uint32_t j = 0; j < len; j++) {
+				target_addr_t a = address + j;
+				buffer[j] = values[n + (a / 4 - address / 4)] >> (24 - 8 * (a & 3));
+			}
+			n += ((address + len + 3) & ~3u) / 4 - address / 4;
+		}
+	}
+
+	free(addrs);
+	free(values);
+	return retval;
+}
+
 static int avr32_uc3_write_memory(struct target *target, target_addr_t address,
 	uint32_t size, uint32_t count, const uint8_t *buffer)
 {
@@ -672,6 +739,7 @@ struct target_type avr32_uc3_target = {
 	.get_gdb_reg_list = avr32_uc3_get_gdb_reg_list,
 
 	.read_memory = avr32_uc3_read_memory,
+	.read_memory_multi = avr32_uc3_read_memory_multi,
 	.write_memory = avr32_uc3_write_memory,
 	/* .checksum_memory = avr32_uc3_checksum_memory, */
 	/* .blank_check_memory = avr32_uc3_blank_check_memory, */
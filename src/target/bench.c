@@ -0,0 +1,298 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/command.h>
+#include <helper/crc32.h>
+#include <helper/time_support.h>
+#include <jtag/jtag.h>
+#include <transport/transport.h>
+
+#include "bench.h"
+#include "mem_cache.h"
+#include "target.h"
+
+COMMAND_HANDLER(handle_bench_scan_command)
+{
+	unsigned int num_bits = 32;
+	unsigned int count = 1000;
+
+	if (CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC > 0)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], num_bits);
+	if (CMD_ARGC > 1)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], count);
+	if (!num_bits || num_bits > INT_MAX || !count)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	if (!transport_is_jtag()) {
+		command_print(CMD, "bench scan requires the JTAG transport");
+		return ERROR_FAIL;
+	}
+
+	uint8_t *out = malloc(DIV_ROUND_UP(num_bits, 8));
+	uint8_t *in = malloc(DIV_ROUND_UP(num_bits, 8));
+	if (!out || !in) {
+		free(out);
+		free(in);
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	memset(out, 0xa5, DIV_ROUND_UP(num_bits, 8));
+
+	/* The pattern goes through whatever instruction the TAPs hold, e.g. an
+	 * AP or DMI access register. Load IDCODE/BYPASS first, the TAP reset
+	 * also tells the target drivers that their cached state is gone. */
+	jtag_add_tlr();
+	int retval = jtag_execute_queue();
+	if (retval != ERROR_OK)
+		goto out;
+
+	unsigned int flushes = jtag_get_flush_queue_count();
+	struct duration bench;
+	duration_start(&bench);
+
+	/* The whole batch is flushed once, like a large drscan or an SVF file */
+	for (unsigned int i = 0; i < count; i++)
+		jtag_add_plain_dr_scan(num_bits, out, in, TAP_IDLE);
+	retval = jtag_execute_queue();
+
+	duration_measure(&bench);
+	flushes = jtag_get_flush_queue_count() - flushes;
+
+	jtag_add_tlr();
+	int retval_tlr = jtag_execute_queue();
+	if (retval == ERROR_OK)
+		retval = retval_tlr;
+
+	if (retval == ERROR_OK) {
+		uint64_t total_bits = (uint64_t)num_bits * count;
+
+		command_print(CMD, "bits %u count %u flushes %u seconds %f kbit_per_s %f",
+			num_bits, count, flushes, duration_elapsed(&bench),
+			total_bits / 1000.0 / duration_elapsed(&bench));
+	}
+
+out:
+	free(out);
+	free(in);
+	return retval;
+}
+
+COMMAND_HANDLER(handle_bench_flush_command)
+{
+	unsigned int count = 100;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC > 0)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], count);
+	if (!count)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	if (!transport_is_jtag()) {
+		command_print(CMD, "bench flush requires the JTAG transport");
+		return ERROR_FAIL;
+	}
+
+	/* See bench scan */
+	jtag_add_tlr();
+	int retval = jtag_execute_queue();
+	if (retval != ERROR_OK)
+		return retval;
+
+	int64_t min_us = INT64_MAX;
+	int64_t max_us = 0;
+	int64_t total_us = 0;
+
+	/* Each flush scans one bit and waits for TDO, a full round trip */
+	for (unsigned int i = 0; i < count; i++) {
+		uint8_t out = 0;
+		uint8_t in;
+
+		int64_t start = timeval_us();
+		jtag_add_plain_dr_scan(1, &out, &in, TAP_IDLE);
+		retval = jtag_execute_queue();
+		int64_t elapsed = timeval_us() - start;
+
+		if (retval != ERROR_OK)
+			break;
+
+		min_us = MIN(min_us, elapsed);
+		max_us = MAX(max_us, elapsed);
+		total_us += elapsed;
+	}
+
+	jtag_add_tlr();
+	int retval_tlr = jtag_execute_queue();
+	if (retval != ERROR_OK)
+		return retval;
+	if (retval_tlr != ERROR_OK)
+		return retval_tlr;
+
+	command_print(CMD, "count %u avg_us %" PRId64 " min_us %" PRId64 " max_us %" PRId64,
+		count, total_us / count, min_us, max_us);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_bench_mem_command)
+{
+	if (CMD_ARGC < 3 || CMD_ARGC > 4)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	bool is_write;
+	if (!strcmp(CMD_ARGV[0], "read"))
+		is_write = false;
+	else if (!strcmp(CMD_ARGV[0], "write"))
+		is_write = true;
+	else
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	target_addr_t address;
+	uint32_t size;
+	unsigned int count = 10;
+
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[1], address);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], size);
+	if (CMD_ARGC > 3)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[3], count);
+	if (!size || !count)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	struct target *target = get_current_target_or_null(CMD_CTX);
+	if (!target) {
+		command_print(CMD, "No current target");
+		return ERROR_FAIL;
+	}
+
+	uint8_t *buffer = malloc(size);
+	if (!buffer) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	int retval = ERROR_OK;
+	if (is_write) {
+		/* Keep the current contents, the benchmark only rewrites them */
+		retval = target_read_buffer(target, address, size, buffer);
+	}
+
+	struct duration bench;
+	duration_start(&bench);
+
+	for (unsigned int i = 0; i < count && retval == ERROR_OK; i++) {
+		if (is_write) {
+			retval = target_write_buffer(target, address, size, buffer);
+		} else {
+			/* Measure the target, not the memory read cache */
+			mem_cache_invalidate(target);
+			retval = target_read_buffer(target, address, size, buffer);
+		}
+	}
+
+	duration_measure(&bench);
+	free(buffer);
+
+	if (retval != ERROR_OK)
+		return retval;
+
+	command_print(CMD, "bytes %" PRIu32 " count %u seconds %f kib_per_s %f",
+		size, count, duration_elapsed(&bench),
+		duration_kbps(&bench, (size_t)size * count));
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_bench_crc32_command)
+{
+	unsigned int size_kib = 16 * 1024;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size_kib);
+	if (size_kib == 0)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	size_t size = (size_t)size_kib * 1024;
+	uint8_t *buffer = malloc(size);
+	if (!buffer) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	for (size_t i = 0; i < size; i++)
+		buffer[i] = i * 0x9e3779b1 >> 24;
+
+	struct duration bench_le, bench_be;
+	uint32_t crc_le, crc_be;
+
+	duration_start(&bench_le);
+	crc_le = crc32_le(CRC32_POLY_LE, 0xffffffff, buffer, size);
+	duration_measure(&bench_le);
+
+	duration_start(&bench_be);
+	crc_be = crc32_be(0xffffffff, buffer, size);
+	duration_measure(&bench_be);
+
+	free(buffer);
+
+	command_print(CMD, "bytes %zu engine %s crc_le 0x%08" PRIx32 " le_gb_per_s %f"
+		" crc_be 0x%08" PRIx32 " be_gb_per_s %f",
+		size, crc32_le_engine(),
+		crc_le, size / duration_elapsed(&bench_le) / 1e9,
+		crc_be, size / duration_elapsed(&bench_be) / 1e9);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration bench_subcommand_handlers[] = {
+	{
+		.name = "scan",
+		.handler = handle_bench_scan_command,
+		.mode = COMMAND_EXEC,
+		.help = "Measure the JTAG scan throughput for a field size",
+		.usage = "[num_bits [count]]",
+	},
+	{
+		.name = "flush",
+		.handler = handle_bench_flush_command,
+		.mode = COMMAND_EXEC,
+		.help = "Measure the round-trip latency of a JTAG queue flush",
+		.usage = "[count]",
+	},
+	{
+		.name = "mem",
+		.handler = handle_bench_mem_command,
+		.mode = COMMAND_EXEC,
+		.help = "Measure the memory throughput of the current target",
+		.usage = "('read'|'write') address size [count]",
+	},
+	{
+		.name = "crc32",
+		.handler = handle_bench_crc32_command,
+		.mode = COMMAND_ANY,
+		.help = "Measure the host CRC32 throughput used by image verification",
+		.usage = "[size_in_KiB]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration bench_command_handlers[] = {
+	{
+		.name = "bench",
+		.mode = COMMAND_ANY,
+		.help = "Adapter and target benchmarks",
+		.usage = "",
+		.chain = bench_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int bench_register_commands(struct command_context *cmd_ctx)
+{
+	return register_commands(cmd_ctx, NULL, bench_command_handlers);
+}
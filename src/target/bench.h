@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_BENCH_H
+#define OPENOCD_TARGET_BENCH_H
+
+struct command_context;
+
+/**
+ * @file
+ * The "bench" commands measure the throughput and latency of the adapter
+ * and target layers. The results are printed as a Tcl dict, so that scripts
+ * can compare them across builds, e.g. with the dummy or remote_bitbang
+ * adapter.
+ */
+
+int bench_register_commands(struct command_context *cmd_ctx);
+
+#endif /* OPENOCD_TARGET_BENCH_H */
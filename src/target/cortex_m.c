@@ -2252,6 +2252,24 @@ static int cortex_m_read_memory(struct target *target, target_addr_t address,
 	return mem_ap_read_buf(armv7m->debug_ap, buffer, size, count, address);
 }
 
+static int cortex_m_read_memory_multi(struct target *target,
+	unsigned int num, const struct target_memory_chunk *chunks)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+
+	if (armv7m->arm.arch == ARM_ARCH_V6M) {
+		/* armv6m does not handle unaligned memory access */
+		for (unsigned int i = 0; i < num; i++) {
+			uint32_t size = chunks[i].size;
+			target_addr_t address = chunks[i].address;
+			if (((size == 4) && (address & 0x3u)) || ((size == 2) && (address & 0x1u)))
+				return ERROR_TARGET_UNALIGNED_ACCESS;
+		}
+	}
+
+	return mem_ap_read_buf_multi(armv7m->debug_ap, num, chunks);
+}
+
 static int cortex_m_write_memory(struct target *target, target_addr_t address,
 	uint32_t size, uint32_t count, const uint8_t *buffer)
 {
@@ -2291,6 +2309,50 @@ void cortex_m_deinit_target(struct target *target)
 	free(cortex_m);
 }
 
+static int cortex_m_sample_pc(struct target *target, uint32_t *pc)
+{
+	struct cortex_m_common *cortex_m = target_to_cm(target);
+	struct armv7m_common *armv7m = &cortex_m->armv7m;
+	uint32_t dhcsr_halt, dhcsr;
+	int retval;
+
+	/* DCRDR is in use by the emulated dcc channel */
+	if (target->dbg_msg_enabled || !armv7m->debug_ap)
+		return ERROR_NOT_IMPLEMENTED;
+
+	uint32_t dhcsr_run = DBGKEY | C_DEBUGEN | (cortex_m->dcb_dhcsr & C_MASKINTS);
+
+	/* halt, check the core is in Debug state before selecting PC, read it
+	 * back together with DHCSR to check it was valid, clear the HALTED
+	 * reason and let the core run again */
+	retval = mem_ap_write_u32(armv7m->debug_ap, DCB_DHCSR, dhcsr_run | C_HALT);
+	if (retval == ERROR_OK)
+		retval = mem_ap_read_u32(armv7m->debug_ap, DCB_DHCSR, &dhcsr_halt);
+	if (retval == ERROR_OK)
+		retval = cortex_m_queue_reg_read(target, armv7m_map_id_to_regsel(ARMV7M_PC),
+				pc, &dhcsr);
+	if (retval == ERROR_OK)
+		retval = mem_ap_write_u32(armv7m->debug_ap, NVIC_DFSR, DFSR_HALTED);
+	if (retval == ERROR_OK)
+		retval = mem_ap_write_u32(armv7m->debug_ap, DCB_DHCSR, dhcsr_run);
+	if (retval == ERROR_OK)
+		retval = dap_run(armv7m->debug_ap->dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	cortex_m_cumulate_dhcsr_sticky(cortex_m, dhcsr_halt);
+	cortex_m_cumulate_dhcsr_sticky(cortex_m, dhcsr);
+
+	/* If the core was not halted yet when DCRSR was written, the write was
+	 * ignored and S_REGRDY may still be set from the previous sample */
+	if (!(dhcsr_halt & S_HALT))
+		return ERROR_TARGET_NOT_HALTED;
+	if ((dhcsr & (S_HALT | S_REGRDY)) != (S_HALT | S_REGRDY))
+		return ERROR_TARGET_NOT_HALTED;
+
+	return ERROR_OK;
+}
+
 int cortex_m_profiling(struct target *target, uint32_t *samples,
 			      uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
 {
@@ -3200,6 +3262,7 @@ struct target_type cortexm_target = {
 	.get_gdb_reg_list = armv7m_get_gdb_reg_list,
 
 	.read_memory = cortex_m_read_memory,
+	.read_memory_multi = cortex_m_read_memory_multi,
 	.write_memory = cortex_m_write_memory,
 	.checksum_memory = armv7m_checksum_memory,
 	.blank_check_memory = armv7m_blank_check_memory,
@@ -3222,4 +3285,5 @@ struct target_type cortexm_target = {
 	.deinit_target = cortex_m_deinit_target,
 
 	.profiling = cortex_m_profiling,
+	.sample_pc = cortex_m_sample_pc,
 };
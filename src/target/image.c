@@ -23,6 +23,7 @@
 
 #include "image.h"
 #include "target.h"
+#include <helper/crc32.h>
 #include <helper/log.h>
 #include <server/server.h>
 
@@ -119,239 +120,389 @@ static int identify_image_type(struct image *image, const char *type_string, con
 	return ERROR_OK;
 }
 
-static int image_ihex_buffer_complete_inner(struct image *image,
-	char *lpsz_line,
-	struct imagesection *section)
+/* One record of an IHEX or S19 file */
+struct image_record {
+	unsigned int type;
+	uint32_t address;
+	unsigned int count;	/* number of data bytes */
+	const char *data;	/* hex digits of the data bytes */
+	bool is_data;
+};
+
+/* Parse a record, with check also validating digits and checksum */
+typedef int (*image_record_parser)(const char *line, size_t len,
+		struct image_record *record, bool check);
+
+/* Value of the hex digits, -1 for other characters */
+static int8_t image_hex_values[256];
+
+static void image_hex_init(void)
 {
-	struct image_ihex *ihex = image->type_private;
-	struct fileio *fileio = ihex->fileio;
-	uint32_t full_address;
-	uint32_t cooked_bytes;
-	bool end_rec = false;
+	memset(image_hex_values, -1, sizeof(image_hex_values));
+	for (int i = 0; i < 10; i++)
+		image_hex_values['0' + i] = i;
+	for (int i = 0; i < 6; i++) {
+		image_hex_values['a' + i] = 10 + i;
+		image_hex_values['A' + i] = 10 + i;
+	}
+}
 
-	/* we can't determine the number of sections that we'll have to create ahead of time,
-	 * so we locally hold them until parsing is finished */
+/* Decode count bytes from hex digits and add them to *sum, data may be NULL */
+static bool image_hex_decode(const char *text, unsigned int count, uint8_t *data,
+		uint8_t *sum)
+{
+	const uint8_t *digits = (const uint8_t *)text;
+
+	for (unsigned int i = 0; i < count; i++) {
+		int hi = image_hex_values[digits[2 * i]];
+		int lo = image_hex_values[digits[2 * i + 1]];
+		if ((hi | lo) < 0)
+			return false;
+
+		uint8_t value = hi << 4 | lo;
+		*sum += value;
+		if (data)
+			data[i] = value;
+	}
 
-	size_t filesize;
-	int retval;
-	retval = fileio_size(fileio, &filesize);
-	if (retval != ERROR_OK)
-		return retval;
+	return true;
+}
 
-	ihex->buffer = malloc(filesize >> 1);
-	cooked_bytes = 0x0;
-	image->num_sections = 0;
+/* Next line of a text image, without line terminator and trailing blanks */
+static bool image_text_next_line(struct image_text *text, size_t *pos,
+		const char **line, size_t *len)
+{
+	if (*pos >= text->size)
+		return false;
 
-	while (!fileio_feof(fileio)) {
-		full_address = 0x0;
-		section[image->num_sections].private = &ihex->buffer[cooked_bytes];
-		section[image->num_sections].base_address = 0x0;
-		section[image->num_sections].size = 0x0;
-		section[image->num_sections].flags = 0;
-
-		while (fileio_fgets(fileio, 1023, lpsz_line) == ERROR_OK) {
-			uint32_t count;
-			uint32_t address;
-			uint32_t record_type;
-			uint32_t checksum;
-			uint8_t cal_checksum = 0;
-			size_t bytes_read = 0;
-
-			/* skip comments and blank lines */
-			if ((lpsz_line[0] == '#') || (strlen(lpsz_line + strspn(lpsz_line, "\n\t\r ")) == 0))
-				continue;
-
-			if (sscanf(&lpsz_line[bytes_read], ":%2" SCNx32 "%4" SCNx32 "%2" SCNx32, &count,
-				&address, &record_type) != 3)
-				return ERROR_IMAGE_FORMAT_ERROR;
-			bytes_read += 9;
-
-			cal_checksum += (uint8_t)count;
-			cal_checksum += (uint8_t)(address >> 8);
-			cal_checksum += (uint8_t)address;
-			cal_checksum += (uint8_t)record_type;
-
-			if (record_type == 0) {	/* Data Record */
-				if ((full_address & 0xffff) != address) {
-					/* we encountered a nonconsecutive location, create a new section,
-					 * unless the current section has zero size, in which case this specifies
-					 * the current section's base address
-					 */
-					if (section[image->num_sections].size != 0) {
-						image->num_sections++;
-						if (image->num_sections >= IMAGE_MAX_SECTIONS) {
-							/* too many sections */
-							LOG_ERROR("Too many sections found in IHEX file");
-							return ERROR_IMAGE_FORMAT_ERROR;
-						}
-						section[image->num_sections].size = 0x0;
-						section[image->num_sections].flags = 0;
-						section[image->num_sections].private =
-							&ihex->buffer[cooked_bytes];
-					}
-					section[image->num_sections].base_address =
-						(full_address & 0xffff0000) | address;
-					full_address = (full_address & 0xffff0000) | address;
-				}
+	const char *start = text->data + *pos;
+	const char *end = memchr(start, '\n', text->size - *pos);
+	size_t n = end ? (size_t)(end - start) : text->size - *pos;
 
-				while (count-- > 0) {
-					unsigned int value;
-					sscanf(&lpsz_line[bytes_read], "%2x", &value);
-					ihex->buffer[cooked_bytes] = (uint8_t)value;
-					cal_checksum += (uint8_t)ihex->buffer[cooked_bytes];
-					bytes_read += 2;
-					cooked_bytes += 1;
-					section[image->num_sections].size += 1;
-					full_address++;
-				}
-			} else if (record_type == 1) {	/* End of File Record */
-				/* finish the current section */
-				image->num_sections++;
-
-				/* copy section information */
-				image->sections = malloc(sizeof(struct imagesection) * image->num_sections);
-				for (unsigned int i = 0; i < image->num_sections; i++) {
-					image->sections[i].private = section[i].private;
-					image->sections[i].base_address = section[i].base_address;
-					image->sections[i].size = section[i].size;
-					image->sections[i].flags = section[i].flags;
-				}
+	*pos += end ? n + 1 : n;
+	while (n > 0 && isspace((unsigned char)start[n - 1]))
+		n--;
 
-				end_rec = true;
-				break;
-			} else if (record_type == 2) {	/* Linear Address Record */
-				uint16_t upper_address;
-
-				sscanf(&lpsz_line[bytes_read], "%4hx", &upper_address);
-				cal_checksum += (uint8_t)(upper_address >> 8);
-				cal_checksum += (uint8_t)upper_address;
-				bytes_read += 4;
-
-				if ((full_address >> 4) != upper_address) {
-					/* we encountered a nonconsecutive location, create a new section,
-					 * unless the current section has zero size, in which case this specifies
-					 * the current section's base address
-					 */
-					if (section[image->num_sections].size != 0) {
-						image->num_sections++;
-						if (image->num_sections >= IMAGE_MAX_SECTIONS) {
-							/* too many sections */
-							LOG_ERROR("Too many sections found in IHEX file");
-							return ERROR_IMAGE_FORMAT_ERROR;
-						}
-						section[image->num_sections].size = 0x0;
-						section[image->num_sections].flags = 0;
-						section[image->num_sections].private =
-							&ihex->buffer[cooked_bytes];
-					}
-					section[image->num_sections].base_address =
-						(full_address & 0xffff) | (upper_address << 4);
-					full_address = (full_address & 0xffff) | (upper_address << 4);
-				}
-			} else if (record_type == 3) {	/* Start Segment Address Record */
-				uint32_t dummy;
-
-				/* "Start Segment Address Record" will not be supported
-				 * but we must consume it, and do not create an error.  */
-				while (count-- > 0) {
-					sscanf(&lpsz_line[bytes_read], "%2" SCNx32, &dummy);
-					cal_checksum += (uint8_t)dummy;
-					bytes_read += 2;
-				}
-			} else if (record_type == 4) {	/* Extended Linear Address Record */
-				uint16_t upper_address;
-
-				sscanf(&lpsz_line[bytes_read], "%4hx", &upper_address);
-				cal_checksum += (uint8_t)(upper_address >> 8);
-				cal_checksum += (uint8_t)upper_address;
-				bytes_read += 4;
-
-				if ((full_address >> 16) != upper_address) {
-					/* we encountered a nonconsecutive location, create a new section,
-					 * unless the current section has zero size, in which case this specifies
-					 * the current section's base address
-					 */
-					if (section[image->num_sections].size != 0) {
-						image->num_sections++;
-						if (image->num_sections >= IMAGE_MAX_SECTIONS) {
-							/* too many sections */
-							LOG_ERROR("Too many sections found in IHEX file");
-							return ERROR_IMAGE_FORMAT_ERROR;
-						}
-						section[image->num_sections].size = 0x0;
-						section[image->num_sections].flags = 0;
-						section[image->num_sections].private =
-							&ihex->buffer[cooked_bytes];
-					}
-					section[image->num_sections].base_address =
-						(full_address & 0xffff) | (upper_address << 16);
-					full_address = (full_address & 0xffff) | (upper_address << 16);
-				}
-			} else if (record_type == 5) {	/* Start Linear Address Record */
-				uint32_t start_address;
-
-				sscanf(&lpsz_line[bytes_read], "%8" SCNx32, &start_address);
-				cal_checksum += (uint8_t)(start_address >> 24);
-				cal_checksum += (uint8_t)(start_address >> 16);
-				cal_checksum += (uint8_t)(start_address >> 8);
-				cal_checksum += (uint8_t)start_address;
-				bytes_read += 8;
-
-				image->start_address_set = true;
-				image->start_address = be_to_h_u32((uint8_t *)&start_address);
-			} else {
-				LOG_ERROR("unhandled IHEX record type: %i", (int)record_type);
-				return ERROR_IMAGE_FORMAT_ERROR;
-			}
+	*line = start;
+	*len = n;
 
-			sscanf(&lpsz_line[bytes_read], "%2" SCNx32, &checksum);
+	return true;
+}
 
-			if ((uint8_t)checksum != (uint8_t)(~cal_checksum + 1)) {
-				/* checksum failed */
-				LOG_ERROR("incorrect record checksum found in IHEX file");
-				return ERROR_IMAGE_CHECKSUM;
-			}
+/* skip comments and blank lines */
+static bool image_text_skip_line(const char *line, size_t len)
+{
+	return len == 0 || line[0] == '#';
+}
 
-			if (end_rec) {
-				end_rec = false;
-				LOG_WARNING("continuing after end-of-file record: %.40s", lpsz_line);
-			}
-		}
-	}
+/* Start a new section at base, or move the current one while it is empty */
+static int image_text_new_section(struct image *image, unsigned int *allocated,
+		target_addr_t base)
+{
+	struct imagesection *section;
 
-	if (end_rec)
+	if (image->num_sections && image->sections[image->num_sections - 1].size == 0) {
+		image->sections[image->num_sections - 1].base_address = base;
 		return ERROR_OK;
-	else {
-		LOG_ERROR("premature end of IHEX file, no matching end-of-file record found");
+	}
+
+	if (image->num_sections >= IMAGE_MAX_SECTIONS) {
+		LOG_ERROR("Too many sections found in image");
 		return ERROR_IMAGE_FORMAT_ERROR;
 	}
+
+	if (image->num_sections == *allocated) {
+		unsigned int num = *allocated ? 2 * *allocated : 16;
+		section = realloc(image->sections, num * sizeof(*section));
+		if (!section) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		image->sections = section;
+		*allocated = num;
+	}
+
+	section = &image->sections[image->num_sections++];
+	section->base_address = base;
+	section->size = 0;
+	section->flags = 0;
+	section->private = NULL;
+
+	return ERROR_OK;
 }
 
-/**
- * Allocate memory dynamically instead of on the stack. This
- * is important w/embedded hosts.
- */
-static int image_ihex_buffer_complete(struct image *image)
+/* Account a data record to the current section, which starts at its first record */
+static void image_text_add_data(struct image *image, const char *line, uint32_t count)
+{
+	struct imagesection *section = &image->sections[image->num_sections - 1];
+
+	if (section->size == 0)
+		section->private = (void *)line;
+	section->size += count;
+}
+
+static void image_text_drop_empty_sections(struct image *image)
+{
+	unsigned int num = 0;
+
+	for (unsigned int i = 0; i < image->num_sections; i++)
+		if (image->sections[i].size)
+			image->sections[num++] = image->sections[i];
+
+	image->num_sections = num;
+}
+
+/* Decode the data of a section into the buffer of the text image */
+static int image_text_decode_section(struct image *image, int section,
+		image_record_parser parse)
 {
-	char *lpsz_line = malloc(1023);
-	if (!lpsz_line) {
+	struct image_text *text = image->type_private;
+	struct imagesection *s = &image->sections[section];
+	struct image_record record;
+	const char *line;
+	size_t len;
+	size_t pos = (const char *)s->private - text->data;
+	uint32_t decoded = 0;
+	uint8_t sum = 0;
+
+	free(text->buffer);
+	text->buffer_section = -1;
+
+	text->buffer = malloc(s->size);
+	if (!text->buffer) {
 		LOG_ERROR("Out of memory");
 		return ERROR_FAIL;
 	}
-	struct imagesection *section = malloc(sizeof(struct imagesection) * IMAGE_MAX_SECTIONS);
-	if (!section) {
-		free(lpsz_line);
+
+	/* records have been checked by the index pass already */
+	while (decoded < s->size && image_text_next_line(text, &pos, &line, &len)) {
+		if (image_text_skip_line(line, len))
+			continue;
+
+		if (parse(line, len, &record, false) != ERROR_OK)
+			break;
+		if (!record.is_data)
+			continue;
+
+		uint32_t count = MIN(record.count, s->size - decoded);
+		image_hex_decode(record.data, count, text->buffer + decoded, &sum);
+		decoded += count;
+	}
+
+	if (decoded != s->size) {
+		LOG_ERROR("BUG: section %d of image changed after opening it", section);
+		free(text->buffer);
+		text->buffer = NULL;
+		return ERROR_FAIL;
+	}
+
+	text->buffer_section = section;
+
+	return ERROR_OK;
+}
+
+static int image_text_map_section(struct image *image, int section,
+		image_record_parser parse, const uint8_t **data)
+{
+	struct image_text *text = image->type_private;
+
+	if (text->buffer_section != section) {
+		int retval = image_text_decode_section(image, section, parse);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	*data = text->buffer;
+
+	return ERROR_OK;
+}
+
+/*
+ * Map a text image and index its sections. Only the record headers are
+ * kept, the data of a section is decoded when it is first read.
+ */
+static int image_text_open(struct image *image, const char *url,
+		int (*index)(struct image *image))
+{
+	struct image_text *text = calloc(1, sizeof(*text));
+	if (!text) {
 		LOG_ERROR("Out of memory");
 		return ERROR_FAIL;
 	}
+	text->buffer_section = -1;
+
+	image_hex_init();
+
+	int retval = fileio_open(&text->fileio, url, FILEIO_READ, FILEIO_TEXT);
+	if (retval != ERROR_OK) {
+		free(text);
+		return retval;
+	}
+
+	const void *data;
+	retval = fileio_map(text->fileio, &data, &text->size);
+	text->data = data;
+
+	image->type_private = text;
+	image->num_sections = 0;
+	image->sections = NULL;
+
+	if (retval == ERROR_OK)
+		retval = index(image);
+
+	if (retval != ERROR_OK) {
+		fileio_close(text->fileio);
+		free(text);
+		image->type_private = NULL;
+		free(image->sections);
+		image->sections = NULL;
+		image->num_sections = 0;
+		return retval;
+	}
+
+	image_text_drop_empty_sections(image);
+
+	return ERROR_OK;
+}
+
+static int image_ihex_parse_record(const char *line, size_t len,
+		struct image_record *record, bool check)
+{
+	uint8_t header[4];
+	uint8_t checksum;
+	uint8_t sum = 0;
+
+	if (len < 11 || line[0] != ':' || !image_hex_decode(line + 1, 4, header, &sum))
+		return ERROR_IMAGE_FORMAT_ERROR;
+
+	record->count = header[0];
+	record->address = header[1] << 8 | header[2];
+	record->type = header[3];
+	record->data = line + 9;
+	record->is_data = record->type == 0;
+
+	if (len < 11 + 2 * record->count)
+		return ERROR_IMAGE_FORMAT_ERROR;
+
+	if (!check)
+		return ERROR_OK;
+
+	if (!image_hex_decode(record->data, record->count, NULL, &sum) ||
+			!image_hex_decode(record->data + 2 * record->count, 1, &checksum, &sum))
+		return ERROR_IMAGE_FORMAT_ERROR;
+
+	if (sum != 0) {
+		/* checksum failed */
+		LOG_ERROR("incorrect record checksum found in IHEX file");
+		return ERROR_IMAGE_CHECKSUM;
+	}
+
+	return ERROR_OK;
+}
+
+static int image_ihex_index(struct image *image)
+{
+	struct image_text *ihex = image->type_private;
+	struct image_record record;
+	unsigned int allocated = 0;
+	uint32_t full_address = 0x0;
+	bool end_rec = false;
+	const char *line;
+	size_t len;
+	size_t pos = 0;
+	uint8_t bytes[4];
+	uint8_t sum = 0;
 	int retval;
 
-	retval = image_ihex_buffer_complete_inner(image, lpsz_line, section);
+	retval = image_text_new_section(image, &allocated, 0x0);
+	if (retval != ERROR_OK)
+		return retval;
+
+	while (image_text_next_line(ihex, &pos, &line, &len)) {
+		if (image_text_skip_line(line, len))
+			continue;
 
-	free(section);
-	free(lpsz_line);
+		retval = image_ihex_parse_record(line, len, &record, true);
+		if (retval != ERROR_OK)
+			return retval;
 
-	return retval;
+		if (end_rec) {
+			end_rec = false;
+			LOG_WARNING("continuing after end-of-file record: %.*s", (int)MIN(len, 40), line);
+		}
+
+		switch (record.type) {
+		case 0:	/* Data Record */
+			if ((full_address & 0xffff) != record.address) {
+				/* we encountered a nonconsecutive location, create a new section,
+				 * unless the current section has zero size, in which case this specifies
+				 * the current section's base address
+				 */
+				full_address = (full_address & 0xffff0000) | record.address;
+				retval = image_text_new_section(image, &allocated, full_address);
+				if (retval != ERROR_OK)
+					return retval;
+			}
+			image_text_add_data(image, line, record.count);
+			full_address += record.count;
+			break;
+
+		case 1:	/* End of File Record */
+			end_rec = true;
+			full_address = 0x0;
+			retval = image_text_new_section(image, &allocated, 0x0);
+			if (retval != ERROR_OK)
+				return retval;
+			break;
+
+		case 2:	/* Linear Address Record */
+		case 4:	/* Extended Linear Address Record */
+		{
+			if (record.count < 2)
+				return ERROR_IMAGE_FORMAT_ERROR;
+			image_hex_decode(record.data, 2, bytes, &sum);
+
+			unsigned int shift = (record.type == 2) ? 4 : 16;
+			uint32_t upper_address = be_to_h_u16(bytes);
+
+			if ((full_address >> shift) != upper_address) {
+				full_address = (full_address & 0xffff) | (upper_address << shift);
+				retval = image_text_new_section(image, &allocated, full_address);
+				if (retval != ERROR_OK)
+					return retval;
+			}
+			break;
+		}
+
+		case 3:	/* Start Segment Address Record */
+			/* "Start Segment Address Record" will not be supported
+			 * but we must consume it, and do not create an error.  */
+			break;
+
+		case 5:	/* Start Linear Address Record */
+		{
+			if (record.count < 4)
+				return ERROR_IMAGE_FORMAT_ERROR;
+			image_hex_decode(record.data, 4, bytes, &sum);
+
+			uint32_t start_address = be_to_h_u32(bytes);
+			image->start_address_set = true;
+			image->start_address = be_to_h_u32((uint8_t *)&start_address);
+			break;
+		}
+
+		default:
+			LOG_ERROR("unhandled IHEX record type: %i", (int)record.type);
+			return ERROR_IMAGE_FORMAT_ERROR;
+		}
+	}
+
+	if (!end_rec) {
+		LOG_ERROR("premature end of IHEX file, no matching end-of-file record found");
+		return ERROR_IMAGE_FORMAT_ERROR;
+	}
+
+	return ERROR_OK;
 }
 
 static int image_elf32_read_headers(struct image *image)
@@ -751,207 +902,115 @@ static int image_elf_read_section(struct image *image,
 		return image_elf32_read_section(image, section, offset, size, buffer, size_read);
 }
 
-static int image_mot_buffer_complete_inner(struct image *image,
-	char *lpsz_line,
-	struct imagesection *section)
+static int image_mot_parse_record(const char *line, size_t len,
+		struct image_record *record, bool check)
 {
-	struct image_mot *mot = image->type_private;
-	struct fileio *fileio = mot->fileio;
-	uint32_t full_address;
-	uint32_t cooked_bytes;
-	bool end_rec = false;
-
-	/* we can't determine the number of sections that we'll have to create ahead of time,
-	 * so we locally hold them until parsing is finished */
-
-	int retval;
-	size_t filesize;
-	retval = fileio_size(fileio, &filesize);
-	if (retval != ERROR_OK)
-		return retval;
+	/* bytes of address per record type, S4 is reserved */
+	static const unsigned int address_bytes[10] = { 2, 2, 3, 4, 0, 2, 3, 4, 3, 2 };
+	uint8_t bytes[4];
+	uint8_t count;
+	uint8_t sum = 0;
+
+	/* get record type and record length */
+	if (len < 4 || line[0] != 'S' || line[1] < '0' || line[1] > '9' ||
+			!image_hex_decode(line + 2, 1, &count, &sum))
+		return ERROR_IMAGE_FORMAT_ERROR;
 
-	mot->buffer = malloc(filesize >> 1);
-	cooked_bytes = 0x0;
-	image->num_sections = 0;
+	record->type = line[1] - '0';
+	unsigned int address_len = address_bytes[record->type];
+	if (address_len == 0) {
+		LOG_ERROR("unhandled S19 record type: %i", (int)record->type);
+		return ERROR_IMAGE_FORMAT_ERROR;
+	}
 
-	while (!fileio_feof(fileio)) {
-		full_address = 0x0;
-		section[image->num_sections].private = &mot->buffer[cooked_bytes];
-		section[image->num_sections].base_address = 0x0;
-		section[image->num_sections].size = 0x0;
-		section[image->num_sections].flags = 0;
-
-		while (fileio_fgets(fileio, 1023, lpsz_line) == ERROR_OK) {
-			uint32_t count;
-			uint32_t address;
-			uint32_t record_type;
-			uint32_t checksum;
-			uint8_t cal_checksum = 0;
-			uint32_t bytes_read = 0;
-
-			/* skip comments and blank lines */
-			if ((lpsz_line[0] == '#') || (strlen(lpsz_line + strspn(lpsz_line, "\n\t\r ")) == 0))
-				continue;
-
-			/* get record type and record length */
-			if (sscanf(&lpsz_line[bytes_read], "S%1" SCNx32 "%2" SCNx32, &record_type,
-				&count) != 2)
-				return ERROR_IMAGE_FORMAT_ERROR;
+	/* the count includes address and checksum */
+	if (count < address_len + 1 || len < 4 + 2 * (size_t)count ||
+			!image_hex_decode(line + 4, address_len, bytes, &sum))
+		return ERROR_IMAGE_FORMAT_ERROR;
 
-			bytes_read += 4;
-			cal_checksum += (uint8_t)count;
+	record->address = 0;
+	for (unsigned int i = 0; i < address_len; i++)
+		record->address = record->address << 8 | bytes[i];
+	record->count = count - address_len - 1;
+	record->data = line + 4 + 2 * address_len;
+	record->is_data = record->type >= 1 && record->type <= 3;
 
-			/* skip checksum byte */
-			count -= 1;
+	if (!check)
+		return ERROR_OK;
 
-			if (record_type == 0) {
-				/* S0 - starting record (optional) */
-				int value;
+	if (!image_hex_decode(record->data, record->count + 1, NULL, &sum))
+		return ERROR_IMAGE_FORMAT_ERROR;
 
-				while (count-- > 0) {
-					sscanf(&lpsz_line[bytes_read], "%2x", &value);
-					cal_checksum += (uint8_t)value;
-					bytes_read += 2;
-				}
-			} else if (record_type >= 1 && record_type <= 3) {
-				switch (record_type) {
-					case 1:
-						/* S1 - 16 bit address data record */
-						sscanf(&lpsz_line[bytes_read], "%4" SCNx32, &address);
-						cal_checksum += (uint8_t)(address >> 8);
-						cal_checksum += (uint8_t)address;
-						bytes_read += 4;
-						count -= 2;
-						break;
-
-					case 2:
-						/* S2 - 24 bit address data record */
-						sscanf(&lpsz_line[bytes_read], "%6" SCNx32, &address);
-						cal_checksum += (uint8_t)(address >> 16);
-						cal_checksum += (uint8_t)(address >> 8);
-						cal_checksum += (uint8_t)address;
-						bytes_read += 6;
-						count -= 3;
-						break;
-
-					case 3:
-						/* S3 - 32 bit address data record */
-						sscanf(&lpsz_line[bytes_read], "%8" SCNx32, &address);
-						cal_checksum += (uint8_t)(address >> 24);
-						cal_checksum += (uint8_t)(address >> 16);
-						cal_checksum += (uint8_t)(address >> 8);
-						cal_checksum += (uint8_t)address;
-						bytes_read += 8;
-						count -= 4;
-						break;
+	/* account for checksum, will always be 0xFF */
+	if (sum != 0xFF) {
+		/* checksum failed */
+		LOG_ERROR("incorrect record checksum found in S19 file");
+		return ERROR_IMAGE_CHECKSUM;
+	}
 
-				}
+	return ERROR_OK;
+}
 
-				if (full_address != address) {
-					/* we encountered a nonconsecutive location, create a new section,
-					 * unless the current section has zero size, in which case this specifies
-					 * the current section's base address
-					 */
-					if (section[image->num_sections].size != 0) {
-						image->num_sections++;
-						section[image->num_sections].size = 0x0;
-						section[image->num_sections].flags = 0;
-						section[image->num_sections].private =
-							&mot->buffer[cooked_bytes];
-					}
-					section[image->num_sections].base_address = address;
-					full_address = address;
-				}
+static int image_mot_index(struct image *image)
+{
+	struct image_text *mot = image->type_private;
+	struct image_record record;
+	unsigned int allocated = 0;
+	uint32_t full_address = 0x0;
+	bool end_rec = false;
+	const char *line;
+	size_t len;
+	size_t pos = 0;
+	int retval;
 
-				while (count-- > 0) {
-					unsigned int value;
-					sscanf(&lpsz_line[bytes_read], "%2x", &value);
-					mot->buffer[cooked_bytes] = (uint8_t)value;
-					cal_checksum += (uint8_t)mot->buffer[cooked_bytes];
-					bytes_read += 2;
-					cooked_bytes += 1;
-					section[image->num_sections].size += 1;
-					full_address++;
-				}
-			} else if (record_type == 5 || record_type == 6) {
-				/* S5 and S6 are the data count records, we ignore them */
-				uint32_t dummy;
-
-				while (count-- > 0) {
-					sscanf(&lpsz_line[bytes_read], "%2" SCNx32, &dummy);
-					cal_checksum += (uint8_t)dummy;
-					bytes_read += 2;
-				}
-			} else if (record_type >= 7 && record_type <= 9) {
-				/* S7, S8, S9 - ending records for 32, 24 and 16bit */
-				image->num_sections++;
-
-				/* copy section information */
-				image->sections = malloc(sizeof(struct imagesection) * image->num_sections);
-				for (unsigned int i = 0; i < image->num_sections; i++) {
-					image->sections[i].private = section[i].private;
-					image->sections[i].base_address = section[i].base_address;
-					image->sections[i].size = section[i].size;
-					image->sections[i].flags = section[i].flags;
-				}
+	retval = image_text_new_section(image, &allocated, 0x0);
+	if (retval != ERROR_OK)
+		return retval;
 
-				end_rec = true;
-				break;
-			} else {
-				LOG_ERROR("unhandled S19 record type: %i", (int)(record_type));
-				return ERROR_IMAGE_FORMAT_ERROR;
-			}
+	while (image_text_next_line(mot, &pos, &line, &len)) {
+		if (image_text_skip_line(line, len))
+			continue;
 
-			/* account for checksum, will always be 0xFF */
-			sscanf(&lpsz_line[bytes_read], "%2" SCNx32, &checksum);
-			cal_checksum += (uint8_t)checksum;
+		retval = image_mot_parse_record(line, len, &record, true);
+		if (retval != ERROR_OK)
+			return retval;
 
-			if (cal_checksum != 0xFF) {
-				/* checksum failed */
-				LOG_ERROR("incorrect record checksum found in S19 file");
-				return ERROR_IMAGE_CHECKSUM;
-			}
+		if (end_rec) {
+			end_rec = false;
+			LOG_WARNING("continuing after end-of-file record: %.*s", (int)MIN(len, 40), line);
+		}
 
-			if (end_rec) {
-				end_rec = false;
-				LOG_WARNING("continuing after end-of-file record: %.40s", lpsz_line);
+		if (record.is_data) {
+			/* S1, S2, S3 - 16, 24 and 32 bit address data records */
+			if (full_address != record.address) {
+				/* we encountered a nonconsecutive location, create a new section,
+				 * unless the current section has zero size, in which case this specifies
+				 * the current section's base address
+				 */
+				full_address = record.address;
+				retval = image_text_new_section(image, &allocated, full_address);
+				if (retval != ERROR_OK)
+					return retval;
 			}
+			image_text_add_data(image, line, record.count);
+			full_address += record.count;
+		} else if (record.type >= 7) {
+			/* S7, S8, S9 - ending records for 32, 24 and 16bit */
+			end_rec = true;
+			full_address = 0x0;
+			retval = image_text_new_section(image, &allocated, 0x0);
+			if (retval != ERROR_OK)
+				return retval;
 		}
+		/* S0 starting record and S5, S6 data count records are ignored */
 	}
 
-	if (end_rec)
-		return ERROR_OK;
-	else {
+	if (!end_rec) {
 		LOG_ERROR("premature end of S19 file, no matching end-of-file record found");
 		return ERROR_IMAGE_FORMAT_ERROR;
 	}
-}
 
-/**
- * Allocate memory dynamically instead of on the stack. This
- * is important w/embedded hosts.
- */
-static int image_mot_buffer_complete(struct image *image)
-{
-	char *lpsz_line = malloc(1023);
-	if (!lpsz_line) {
-		LOG_ERROR("Out of memory");
-		return ERROR_FAIL;
-	}
-	struct imagesection *section = malloc(sizeof(struct imagesection) * IMAGE_MAX_SECTIONS);
-	if (!section) {
-		free(lpsz_line);
-		LOG_ERROR("Out of memory");
-		return ERROR_FAIL;
-	}
-	int retval;
-
-	retval = image_mot_buffer_complete_inner(image, lpsz_line, section);
-
-	free(section);
-	free(lpsz_line);
-
-	return retval;
+	return ERROR_OK;
 }
 
 int image_open(struct image *image, const char *url, const char *type_string)
@@ -966,6 +1025,7 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		struct image_binary *image_binary;
 
 		image_binary = image->type_private = malloc(sizeof(struct image_binary));
+		image_binary->data = NULL;
 
 		retval = fileio_open(&image_binary->fileio, url, FILEIO_READ, FILEIO_BINARY);
 		if (retval != ERROR_OK)
@@ -984,25 +1044,17 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		image->sections[0].size = filesize;
 		image->sections[0].flags = 0;
 	} else if (image->type == IMAGE_IHEX) {
-		struct image_ihex *image_ihex;
-
-		image_ihex = image->type_private = malloc(sizeof(struct image_ihex));
-
-		retval = fileio_open(&image_ihex->fileio, url, FILEIO_READ, FILEIO_TEXT);
-		if (retval != ERROR_OK)
-			goto free_mem_on_error;
-
-		retval = image_ihex_buffer_complete(image);
+		retval = image_text_open(image, url, image_ihex_index);
 		if (retval != ERROR_OK) {
 			LOG_ERROR(
 				"failed buffering IHEX image, check server output for additional information");
-			fileio_close(image_ihex->fileio);
-			goto free_mem_on_error;
+			return retval;
 		}
 	} else if (image->type == IMAGE_ELF) {
 		struct image_elf *image_elf;
 
 		image_elf = image->type_private = malloc(sizeof(struct image_elf));
+		image_elf->data = NULL;
 
 		retval = fileio_open(&image_elf->fileio, url, FILEIO_READ, FILEIO_BINARY);
 		if (retval != ERROR_OK)
@@ -1035,20 +1087,11 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		image_memory->cache = NULL;
 		image_memory->cache_address = 0x0;
 	} else if (image->type == IMAGE_SRECORD) {
-		struct image_mot *image_mot;
-
-		image_mot = image->type_private = malloc(sizeof(struct image_mot));
-
-		retval = fileio_open(&image_mot->fileio, url, FILEIO_READ, FILEIO_TEXT);
-		if (retval != ERROR_OK)
-			goto free_mem_on_error;
-
-		retval = image_mot_buffer_complete(image);
+		retval = image_text_open(image, url, image_mot_index);
 		if (retval != ERROR_OK) {
 			LOG_ERROR(
 				"failed buffering S19 image, check server output for additional information");
-			fileio_close(image_mot->fileio);
-			goto free_mem_on_error;
+			return retval;
 		}
 	} else if (image->type == IMAGE_BUILDER) {
 		image->num_sections = 0;
@@ -1111,8 +1154,14 @@ int image_read_section(struct image *image,
 		retval = fileio_read(image_binary->fileio, size, buffer, size_read);
 		if (retval != ERROR_OK)
 			return retval;
-	} else if (image->type == IMAGE_IHEX) {
-		memcpy(buffer, (uint8_t *)image->sections[section].private + offset, size);
+	} else if (image->type == IMAGE_IHEX || image->type == IMAGE_SRECORD) {
+		const uint8_t *data;
+
+		retval = image_map_section(image, section, offset, size, &data);
+		if (retval != ERROR_OK)
+			return retval;
+
+		memcpy(buffer, data, size);
 		*size_read = size;
 
 		return ERROR_OK;
@@ -1156,11 +1205,6 @@ int image_read_section(struct image *image,
 			*size_read += (size_in_cache > size) ? size : size_in_cache;
 			address += (size_in_cache > size) ? size : size_in_cache;
 		}
-	} else if (image->type == IMAGE_SRECORD) {
-		memcpy(buffer, (uint8_t *)image->sections[section].private + offset, size);
-		*size_read = size;
-
-		return ERROR_OK;
 	} else if (image->type == IMAGE_BUILDER) {
 		memcpy(buffer, (uint8_t *)image->sections[section].private + offset, size);
 		*size_read = size;
@@ -1171,6 +1215,78 @@ int image_read_section(struct image *image,
 	return ERROR_OK;
 }
 
+/**
+ * Get a pointer to @a size bytes of a section instead of copying them, e.g.
+ * straight into the mapped file. The data is valid until the next read or
+ * map of the image, or until the image is closed. Fails for images that
+ * can't be mapped, use image_read_section() then.
+ */
+int image_map_section(struct image *image,
+	int section,
+	target_addr_t offset,
+	uint32_t size,
+	const uint8_t **data)
+{
+	const void *file_data;
+	size_t file_size;
+	int retval;
+
+	/* don't read past the end of a section */
+	if (offset + size > image->sections[section].size)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (image->type == IMAGE_BINARY) {
+		struct image_binary *image_binary = image->type_private;
+
+		if (!image_binary->data) {
+			retval = fileio_map(image_binary->fileio, &file_data, &file_size);
+			if (retval != ERROR_OK)
+				return retval;
+			image_binary->data = file_data;
+		}
+
+		*data = image_binary->data + offset;
+	} else if (image->type == IMAGE_IHEX) {
+		retval = image_text_map_section(image, section, image_ihex_parse_record, data);
+		if (retval != ERROR_OK)
+			return retval;
+		*data += offset;
+	} else if (image->type == IMAGE_SRECORD) {
+		retval = image_text_map_section(image, section, image_mot_parse_record, data);
+		if (retval != ERROR_OK)
+			return retval;
+		*data += offset;
+	} else if (image->type == IMAGE_ELF) {
+		struct image_elf *elf = image->type_private;
+		uint64_t file_offset;
+
+		if (!elf->data) {
+			retval = fileio_map(elf->fileio, &file_data, &elf->size);
+			if (retval != ERROR_OK)
+				return retval;
+			elf->data = file_data;
+		}
+
+		if (elf->is_64_bit)
+			file_offset = field64(elf, ((Elf64_Phdr *)image->sections[section].private)->p_offset);
+		else
+			file_offset = field32(elf, ((Elf32_Phdr *)image->sections[section].private)->p_offset);
+
+		if (file_offset + offset + size > elf->size) {
+			LOG_ERROR("invalid ELF file, segment content beyond end of file");
+			return ERROR_IMAGE_FORMAT_ERROR;
+		}
+
+		*data = elf->data + file_offset + offset;
+	} else if (image->type == IMAGE_BUILDER) {
+		*data = (const uint8_t *)image->sections[section].private + offset;
+	} else {
+		return ERROR_FILEIO_OPERATION_NOT_SUPPORTED;
+	}
+
+	return ERROR_OK;
+}
+
 int image_add_section(struct image *image, target_addr_t base, uint32_t size, uint64_t flags, uint8_t const *data)
 {
 	struct imagesection *section;
@@ -1214,13 +1330,13 @@ void image_close(struct image *image)
 		struct image_binary *image_binary = image->type_private;
 
 		fileio_close(image_binary->fileio);
-	} else if (image->type == IMAGE_IHEX) {
-		struct image_ihex *image_ihex = image->type_private;
+	} else if (image->type == IMAGE_IHEX || image->type == IMAGE_SRECORD) {
+		struct image_text *image_text = image->type_private;
 
-		fileio_close(image_ihex->fileio);
+		fileio_close(image_text->fileio);
 
-		free(image_ihex->buffer);
-		image_ihex->buffer = NULL;
+		free(image_text->buffer);
+		image_text->buffer = NULL;
 	} else if (image->type == IMAGE_ELF) {
 		struct image_elf *image_elf = image->type_private;
 
@@ -1244,13 +1360,6 @@ void image_close(struct image *image)
 
 		free(image_memory->cache);
 		image_memory->cache = NULL;
-	} else if (image->type == IMAGE_SRECORD) {
-		struct image_mot *image_mot = image->type_private;
-
-		fileio_close(image_mot->fileio);
-
-		free(image_mot->buffer);
-		image_mot->buffer = NULL;
 	} else if (image->type == IMAGE_BUILDER) {
 		for (unsigned int i = 0; i < image->num_sections; i++) {
 			free(image->sections[i].private);
@@ -1270,31 +1379,12 @@ int image_calculate_checksum(const uint8_t *buffer, uint32_t nbytes, uint32_t *c
 	uint32_t crc = 0xffffffff;
 	LOG_DEBUG("Calculating checksum");
 
-	static uint32_t crc32_table[256];
-
-	static bool first_init;
-	if (!first_init) {
-		/* Initialize the CRC table and the decoding table.  */
-		unsigned int i, j, c;
-		for (i = 0; i < 256; i++) {
-			/* as per gdb */
-			for (c = i << 24, j = 8; j > 0; --j)
-				c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
-			crc32_table[i] = c;
-		}
-
-		first_init = true;
-	}
-
 	while (nbytes > 0) {
-		int run = nbytes;
-		if (run > 32768)
-			run = 32768;
+		/* as per gdb */
+		uint32_t run = MIN(nbytes, 1024 * 1024);
+		crc = crc32_be(crc, buffer, run);
+		buffer += run;
 		nbytes -= run;
-		while (run--) {
-			/* as per gdb */
-			crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ *buffer++) & 255];
-		}
 		keep_alive();
 		if (openocd_is_shutdown_pending())
 			return ERROR_SERVER_INTERRUPTED;
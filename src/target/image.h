@@ -58,11 +58,16 @@ struct image {
 
 struct image_binary {
 	struct fileio *fileio;
+	const uint8_t *data;	/* mapped file contents */
 };
 
-struct image_ihex {
+/* IHEX and S19 images, decoded one section at a time on demand */
+struct image_text {
 	struct fileio *fileio;
-	uint8_t *buffer;
+	const char *data;	/* mapped file contents */
+	size_t size;
+	uint8_t *buffer;	/* decoded data of section buffer_section */
+	int buffer_section;
 };
 
 struct image_memory {
@@ -73,6 +78,8 @@ struct image_memory {
 
 struct image_elf {
 	struct fileio *fileio;
+	const uint8_t *data;	/* mapped file contents */
+	size_t size;
 	bool is_64_bit;
 	union {
 		Elf32_Ehdr *header32;
@@ -86,14 +93,11 @@ struct image_elf {
 	uint8_t endianness;
 };
 
-struct image_mot {
-	struct fileio *fileio;
-	uint8_t *buffer;
-};
-
 int image_open(struct image *image, const char *url, const char *type_string);
 int image_read_section(struct image *image, int section, target_addr_t offset,
 		uint32_t size, uint8_t *buffer, size_t *size_read);
+int image_map_section(struct image *image, int section, target_addr_t offset,
+		uint32_t size, const uint8_t **data);
 void image_close(struct image *image);
 
 int image_add_section(struct image *image, target_addr_t base, uint32_t size,
@@ -247,6 +247,16 @@ static int mem_ap_read_memory(struct target *target, target_addr_t address,
 	return mem_ap_read_buf(mem_ap->ap, buffer, size, count, address);
 }
 
+static int mem_ap_read_memory_multi(struct target *target,
+			       unsigned int num, const struct target_memory_chunk *chunks)
+{
+	struct mem_ap *mem_ap = target->arch_info;
+
+	LOG_TARGET_DEBUG(target, "Reading %u memory regions", num);
+
+	return mem_ap_read_buf_multi(mem_ap->ap, num, chunks);
+}
+
 static int mem_ap_write_memory(struct target *target, target_addr_t address,
 				uint32_t size, uint32_t count,
 				const uint8_t *buffer)
@@ -285,5 +295,6 @@ struct target_type mem_ap_target = {
 	.get_gdb_reg_list = mem_ap_get_gdb_reg_list,
 
 	.read_memory = mem_ap_read_memory,
+	.read_memory_multi = mem_ap_read_memory_multi,
 	.write_memory = mem_ap_write_memory,
 };
@@ -0,0 +1,408 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/align.h>
+#include <helper/log.h>
+
+#include "target.h"
+#include "target_type.h"
+#include "smp.h"
+#include "mem_cache.h"
+
+#define MEM_CACHE_LINE_SIZE			64
+#define MEM_CACHE_NUM_LINES			256
+/* larger reads (dump_image, verify, ...) bypass the cache instead of
+ * evicting everything GDB is currently looking at */
+#define MEM_CACHE_MAX_READ_LINES	16
+
+struct mem_cache_line {
+	target_addr_t address;	/* line aligned */
+	uint64_t generation;	/* line is valid if it matches mem_cache::generation */
+};
+
+struct mem_cache_region {
+	target_addr_t address;
+	target_addr_t size;
+};
+
+struct mem_cache {
+	bool enabled;
+	uint64_t generation;
+	struct mem_cache_line lines[MEM_CACHE_NUM_LINES];
+	uint8_t data[MEM_CACHE_NUM_LINES][MEM_CACHE_LINE_SIZE];
+
+	struct mem_cache_region *uncacheable;
+	unsigned int num_uncacheable;
+
+	uint64_t hits;			/* lines served from the cache */
+	uint64_t misses;		/* lines read from the target */
+	uint64_t bypassed;		/* reads passed straight to the target */
+	uint64_t invalidations;
+};
+
+static struct mem_cache *mem_cache_get(struct target *target)
+{
+	if (!target->mem_cache) {
+		target->mem_cache = calloc(1, sizeof(*target->mem_cache));
+		if (!target->mem_cache) {
+			LOG_ERROR("Out of memory");
+			return NULL;
+		}
+		/* all lines start with generation 0, i.e. invalid */
+		target->mem_cache->generation = 1;
+	}
+
+	return target->mem_cache;
+}
+
+static bool mem_cache_target_halted(struct target *target)
+{
+	if (target->state != TARGET_HALTED)
+		return false;
+
+	/* other cores of the cluster could modify shared memory */
+	if (target->smp) {
+		struct target_list *head;
+		foreach_smp_target(head, target->smp_targets) {
+			if (head->target->state != TARGET_HALTED)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static bool mem_cache_range_cacheable(const struct mem_cache *cache,
+		target_addr_t address, target_addr_t size)
+{
+	for (unsigned int i = 0; i < cache->num_uncacheable; i++) {
+		const struct mem_cache_region *r = &cache->uncacheable[i];
+		if (address < r->address + r->size && r->address < address + size)
+			return false;
+	}
+
+	return true;
+}
+
+static struct mem_cache_line *mem_cache_line(struct mem_cache *cache,
+		target_addr_t address, uint8_t **data)
+{
+	unsigned int index = (address / MEM_CACHE_LINE_SIZE) % MEM_CACHE_NUM_LINES;
+
+	*data = cache->data[index];
+	return &cache->lines[index];
+}
+
+static bool mem_cache_line_valid(const struct mem_cache *cache,
+		const struct mem_cache_line *line, target_addr_t address)
+{
+	return line->generation == cache->generation && line->address == address;
+}
+
+/* Read @a num_lines consecutive lines starting at @a address in one go */
+static int mem_cache_fill(struct target *target, struct mem_cache *cache,
+		target_addr_t address, unsigned int num_lines)
+{
+	uint8_t buf[MEM_CACHE_MAX_READ_LINES * MEM_CACHE_LINE_SIZE];
+
+	assert(num_lines <= MEM_CACHE_MAX_READ_LINES);
+
+	int retval = target->type->read_memory(target, address, 4,
+			num_lines * MEM_CACHE_LINE_SIZE / 4, buf);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (unsigned int i = 0; i < num_lines; i++) {
+		target_addr_t line_address = address + i * MEM_CACHE_LINE_SIZE;
+		uint8_t *data;
+		struct mem_cache_line *line = mem_cache_line(cache, line_address, &data);
+
+		memcpy(data, buf + i * MEM_CACHE_LINE_SIZE, MEM_CACHE_LINE_SIZE);
+		line->address = line_address;
+		line->generation = cache->generation;
+	}
+
+	cache->misses += num_lines;
+	return ERROR_OK;
+}
+
+bool mem_cache_enabled(struct target *target)
+{
+	return target->mem_cache && target->mem_cache->enabled;
+}
+
+int mem_cache_read(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, uint8_t *buffer)
+{
+	struct mem_cache *cache = target->mem_cache;
+	uint64_t len = (uint64_t)size * count;
+
+	if (!cache || !cache->enabled || len == 0 || !mem_cache_target_halted(target))
+		return target->type->read_memory(target, address, size, count, buffer);
+
+	target_addr_t first = ALIGN_DOWN(address, MEM_CACHE_LINE_SIZE);
+	target_addr_t last = ALIGN_DOWN(address + len - 1, MEM_CACHE_LINE_SIZE);
+	if (last < first || (last - first) / MEM_CACHE_LINE_SIZE >= MEM_CACHE_MAX_READ_LINES ||
+			!mem_cache_range_cacheable(cache, first, last - first + MEM_CACHE_LINE_SIZE)) {
+		cache->bypassed++;
+		return target->type->read_memory(target, address, size, count, buffer);
+	}
+
+	/* Fetch missing lines, consecutive ones in a single target access.
+	 * The lines of one read never map to the same slot, so nothing
+	 * fetched here is evicted before it is copied out below. */
+	target_addr_t line_address = first;
+	while (line_address <= last) {
+		uint8_t *data;
+		struct mem_cache_line *line = mem_cache_line(cache, line_address, &data);
+		if (mem_cache_line_valid(cache, line, line_address)) {
+			cache->hits++;
+			line_address += MEM_CACHE_LINE_SIZE;
+			continue;
+		}
+
+		unsigned int num_lines = 1;
+		while (line_address + num_lines * MEM_CACHE_LINE_SIZE <= last) {
+			target_addr_t next = line_address + num_lines * MEM_CACHE_LINE_SIZE;
+			line = mem_cache_line(cache, next, &data);
+			if (mem_cache_line_valid(cache, line, next))
+				break;
+			num_lines++;
+		}
+
+		if (mem_cache_fill(target, cache, line_address, num_lines) != ERROR_OK) {
+			/* e.g. part of a line is not mapped, try the exact access */
+			LOG_TARGET_DEBUG(target, "cache line fill at " TARGET_ADDR_FMT " failed",
+					line_address);
+			cache->bypassed++;
+			return target->type->read_memory(target, address, size, count, buffer);
+		}
+		line_address += num_lines * MEM_CACHE_LINE_SIZE;
+	}
+
+	for (line_address = first; line_address <= last; line_address += MEM_CACHE_LINE_SIZE) {
+		uint8_t *data;
+		mem_cache_line(cache, line_address, &data);
+
+		target_addr_t start = MAX(address, line_address);
+		target_addr_t end = MIN(address + len, line_address + MEM_CACHE_LINE_SIZE);
+		memcpy(buffer + (start - address), data + (start - line_address), end - start);
+	}
+
+	return ERROR_OK;
+}
+
+static void mem_cache_invalidate_one(struct target *target)
+{
+	struct mem_cache *cache = target->mem_cache;
+
+	if (!cache)
+		return;
+
+	cache->generation++;
+	cache->invalidations++;
+}
+
+void mem_cache_invalidate(struct target *target)
+{
+	mem_cache_invalidate_one(target);
+
+	/* the cores of an SMP group share their memory */
+	if (target->smp) {
+		struct target_list *head;
+		foreach_smp_target(head, target->smp_targets) {
+			if (head->target != target)
+				mem_cache_invalidate_one(head->target);
+		}
+	}
+}
+
+void mem_cache_free(struct target *target)
+{
+	if (!target->mem_cache)
+		return;
+
+	free(target->mem_cache->uncacheable);
+	free(target->mem_cache);
+	target->mem_cache = NULL;
+}
+
+COMMAND_HANDLER(handle_mem_cache_enable_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct mem_cache *cache = mem_cache_get(target);
+	if (!cache)
+		return ERROR_FAIL;
+
+	cache->enabled = !strcmp(CMD_NAME, "enable");
+	mem_cache_invalidate(target);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_invalidate_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	mem_cache_invalidate(get_current_target(CMD_CTX));
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_uncacheable_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC != 0 && CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct mem_cache *cache = mem_cache_get(target);
+	if (!cache)
+		return ERROR_FAIL;
+
+	if (CMD_ARGC == 0) {
+		for (unsigned int i = 0; i < cache->num_uncacheable; i++)
+			command_print(CMD, TARGET_ADDR_FMT " " TARGET_ADDR_FMT,
+					cache->uncacheable[i].address, cache->uncacheable[i].size);
+		return ERROR_OK;
+	}
+
+	target_addr_t address, size;
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], address);
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[1], size);
+	if (size == 0)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	struct mem_cache_region *regions = realloc(cache->uncacheable,
+			(cache->num_uncacheable + 1) * sizeof(*regions));
+	if (!regions) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	regions[cache->num_uncacheable].address = address;
+	regions[cache->num_uncacheable].size = size;
+	cache->uncacheable = regions;
+	cache->num_uncacheable++;
+
+	/* lines cached from the region before must not be hit any more */
+	mem_cache_invalidate(target);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_uncacheable_clear_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (target->mem_cache) {
+		free(target->mem_cache->uncacheable);
+		target->mem_cache->uncacheable = NULL;
+		target->mem_cache->num_uncacheable = 0;
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_stats_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct mem_cache *cache = target->mem_cache;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		if (cache) {
+			cache->hits = 0;
+			cache->misses = 0;
+			cache->bypassed = 0;
+			cache->invalidations = 0;
+		}
+		return ERROR_OK;
+	}
+
+	if (!cache || !cache->enabled) {
+		command_print(CMD, "memory cache disabled");
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "%u lines of %u bytes", MEM_CACHE_NUM_LINES, MEM_CACHE_LINE_SIZE);
+	command_print(CMD, "hits:          %" PRIu64, cache->hits);
+	command_print(CMD, "misses:        %" PRIu64, cache->misses);
+	command_print(CMD, "bypassed:      %" PRIu64, cache->bypassed);
+	command_print(CMD, "invalidations: %" PRIu64, cache->invalidations);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration mem_cache_subcommand_handlers[] = {
+	{
+		.name = "enable",
+		.handler = handle_mem_cache_enable_command,
+		.mode = COMMAND_ANY,
+		.help = "cache memory reads while the target is halted",
+		.usage = "",
+	},
+	{
+		.name = "disable",
+		.handler = handle_mem_cache_enable_command,
+		.mode = COMMAND_ANY,
+		.help = "read target memory uncached",
+		.usage = "",
+	},
+	{
+		.name = "invalidate",
+		.handler = handle_mem_cache_invalidate_command,
+		.mode = COMMAND_ANY,
+		.help = "drop all cached memory content",
+		.usage = "",
+	},
+	{
+		.name = "uncacheable",
+		.handler = handle_mem_cache_uncacheable_command,
+		.mode = COMMAND_ANY,
+		.help = "list or add address ranges that are never cached, "
+			"e.g. peripherals",
+		.usage = "[address size]",
+	},
+	{
+		.name = "uncacheable_clear",
+		.handler = handle_mem_cache_uncacheable_clear_command,
+		.mode = COMMAND_ANY,
+		.help = "remove all uncacheable address ranges",
+		.usage = "",
+	},
+	{
+		.name = "stats",
+		.handler = handle_mem_cache_stats_command,
+		.mode = COMMAND_ANY,
+		.help = "display or reset hit/miss counters",
+		.usage = "['reset']",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+const struct command_registration mem_cache_command_handlers[] = {
+	{
+		.name = "mem_cache",
+		.mode = COMMAND_ANY,
+		.help = "target memory read cache commands",
+		.usage = "",
+		.chain = mem_cache_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_MEM_CACHE_H
+#define OPENOCD_TARGET_MEM_CACHE_H
+
+#include <helper/command.h>
+#include <helper/types.h>
+
+struct target;
+
+/**
+ * @file
+ * Optional per-target cache for target_read_memory().
+ *
+ * While a target is halted GDB and the RTOS awareness re-read the same
+ * stacks, TCBs and variables many times per stop. With the cache enabled
+ * those reads are served from host memory in units of cache lines. The
+ * whole cache is dropped whenever the target may have changed its memory:
+ * on resume, step, halt, reset and on any memory write through the target
+ * layer. Peripheral registers must be excluded with uncacheable regions.
+ */
+
+/** @returns true if the memory read cache of @a target is enabled. */
+bool mem_cache_enabled(struct target *target);
+
+/** Read through the cache, or straight from the target when uncacheable. */
+int mem_cache_read(struct target *target, target_addr_t address,
+		uint32_t size, uint32_t count, uint8_t *buffer);
+
+/** Drop all cached data of @a target and of the other cores of its SMP
+ * group. Cheap, may be called often. */
+void mem_cache_invalidate(struct target *target);
+
+/** Release the cache of @a target, when the target is destroyed. */
+void mem_cache_free(struct target *target);
+
+extern const struct command_registration mem_cache_command_handlers[];
+
+#endif /* OPENOCD_TARGET_MEM_CACHE_H */
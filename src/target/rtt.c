@@ -18,6 +18,29 @@
 
 #include "target.h"
 
+/* Buffers reused by every poll of the up-channels, grown as needed */
+static struct {
+	uint8_t *desc;
+	size_t desc_size;
+	uint8_t *data;
+	size_t data_size;
+	struct rtt_channel *channels;
+	struct target_memory_chunk *chunks;
+	size_t max_channels;
+} rtt_poll;
+
+static void parse_rtt_channel(const uint8_t *buf, target_addr_t address,
+		struct rtt_channel *channel)
+{
+	channel->address = address;
+	channel->name_addr = buf_get_u32(buf + 0, 0, 32);
+	channel->buffer_addr = buf_get_u32(buf + 4, 0, 32);
+	channel->size = buf_get_u32(buf + 8, 0, 32);
+	channel->write_pos = buf_get_u32(buf + 12, 0, 32);
+	channel->read_pos = buf_get_u32(buf + 16, 0, 32);
+	channel->flags = buf_get_u32(buf + 20, 0, 32);
+}
+
 static int read_rtt_channel(struct target *target,
 		const struct rtt_control *ctrl, unsigned int channel_index,
 		enum rtt_channel_type type, struct rtt_channel *channel)
@@ -36,13 +59,25 @@ static int read_rtt_channel(struct target *target,
 	if (ret != ERROR_OK)
 		return ret;
 
-	channel->address = address;
-	channel->name_addr = buf_get_u32(buf + 0, 0, 32);
-	channel->buffer_addr = buf_get_u32(buf + 4, 0, 32);
-	channel->size = buf_get_u32(buf + 8, 0, 32);
-	channel->write_pos = buf_get_u32(buf + 12, 0, 32);
-	channel->read_pos = buf_get_u32(buf + 16, 0, 32);
-	channel->flags = buf_get_u32(buf + 20, 0, 32);
+	parse_rtt_channel(buf, address, channel);
+
+	return ERROR_OK;
+}
+
+static int grow_buffer(uint8_t **buffer, size_t *size, size_t needed)
+{
+	uint8_t *tmp;
+
+	if (needed <= *size)
+		return ERROR_OK;
+
+	tmp = realloc(*buffer, needed);
+
+	if (!tmp)
+		return ERROR_FAIL;
+
+	*buffer = tmp;
+	*size = needed;
 
 	return ERROR_OK;
 }
@@ -55,6 +90,12 @@ int target_rtt_start(struct target *target, const struct rtt_control *ctrl,
 
 int target_rtt_stop(struct target *target, void *user_data)
 {
+	free(rtt_poll.desc);
+	free(rtt_poll.data);
+	free(rtt_poll.channels);
+	free(rtt_poll.chunks);
+	memset(&rtt_poll, 0, sizeof(rtt_poll));
+
 	return ERROR_OK;
 }
 
@@ -238,47 +279,79 @@ int target_rtt_read_control_block(struct target *target,
 	return ERROR_OK;
 }
 
+/* Bytes read at once when searching for the control block */
+#define RTT_SEARCH_CHUNK_SIZE	(64 * 1024)
+
+static const uint8_t *find_id(const uint8_t *buf, size_t size, const char *id,
+		size_t id_length)
+{
+	const uint8_t *end = buf + size;
+
+	while ((size_t)(end - buf) >= id_length) {
+		buf = memchr(buf, id[0], end - buf - id_length + 1);
+
+		if (!buf)
+			return NULL;
+
+		if (!memcmp(buf, id, id_length))
+			return buf;
+
+		buf++;
+	}
+
+	return NULL;
+}
+
 int target_rtt_find_control_block(struct target *target,
 		target_addr_t *address, size_t size, const char *id, bool *found,
 		void *user_data)
 {
 	target_addr_t address_end = *address + size;
-	uint8_t buf[1024];
+	const size_t id_length = strlen(id);
+	/* Bytes at the start of buf kept from the previous chunk */
+	size_t kept = 0;
+	uint8_t *buf;
 
 	*found = false;
 
-	size_t id_matched_length = 0;
-	const size_t id_length = strlen(id);
+	buf = malloc(RTT_SEARCH_CHUNK_SIZE + id_length);
+
+	if (!buf)
+		return ERROR_FAIL;
 
 	LOG_INFO("rtt: Searching for control block '%s'", id);
 
-	for (target_addr_t addr = *address; addr < address_end; addr += sizeof(buf)) {
+	for (target_addr_t addr = *address; addr < address_end; ) {
 		int ret;
+		const uint8_t *match;
 
-		const size_t buf_size = MIN(sizeof(buf), address_end - addr);
-		ret = target_read_buffer(target, addr, buf_size, buf);
+		const size_t read_size = MIN(RTT_SEARCH_CHUNK_SIZE, address_end - addr);
+		ret = target_read_buffer(target, addr, read_size, buf + kept);
 
-		if (ret != ERROR_OK)
+		if (ret != ERROR_OK) {
+			free(buf);
 			return ret;
+		}
+
+		/* The ID may cross the border between two chunks */
+		const size_t buf_size = kept + read_size;
+		match = find_id(buf, buf_size, id, id_length);
 
-		for (size_t buf_off = 0; buf_off < buf_size; buf_off++) {
-			if (id_matched_length > 0 &&
-			    buf[buf_off] != id[id_matched_length]) {
-				/* Start from beginning */
-				id_matched_length = 0;
-			}
-
-			if (buf[buf_off] == id[id_matched_length])
-				id_matched_length++;
-
-			if (id_matched_length == id_length) {
-				*address = addr + buf_off + 1 - id_length;
-				*found = true;
-				return ERROR_OK;
-			}
+		if (match) {
+			*address = addr - kept + (match - buf);
+			*found = true;
+			break;
 		}
+
+		kept = MIN(id_length - 1, buf_size);
+		memmove(buf, buf + buf_size - kept, kept);
+		addr += read_size;
+
+		keep_alive();
 	}
 
+	free(buf);
+
 	return ERROR_OK;
 }
 
@@ -310,100 +383,202 @@ int target_rtt_read_channel_info(struct target *target,
 	return ERROR_OK;
 }
 
-static int read_from_channel(struct target *target,
-		const struct rtt_channel *channel, uint8_t *buffer,
-		size_t *length)
+/* Upper limit for the data read from one up-channel per poll */
+#define RTT_MAX_READ_LENGTH	(1024 * 1024)
+
+/* Number of bytes to read from a channel */
+static uint32_t channel_available(const struct rtt_channel *channel)
+{
+	uint32_t length;
+
+	if (channel->read_pos <= channel->write_pos)
+		length = channel->write_pos - channel->read_pos;
+	else
+		length = channel->size - channel->read_pos + channel->write_pos;
+
+	return MIN(length, RTT_MAX_READ_LENGTH);
+}
+
+/*
+ * Add chunks reading length bytes at address, with word accesses for the
+ * aligned part. Needs up to three chunks.
+ */
+static void add_read_chunks(struct target_memory_chunk *chunks,
+		unsigned int *num_chunks, target_addr_t address, uint32_t length,
+		uint8_t *buffer)
+{
+	uint32_t head = MIN(length, (4 - (address & 3)) & 3);
+	uint32_t words = (length - head) / 4;
+	uint32_t tail = length - head - 4 * words;
+
+	if (head) {
+		chunks[(*num_chunks)++] = (struct target_memory_chunk) {
+			.address = address, .size = 1, .count = head, .buffer = buffer,
+		};
+	}
+
+	if (words) {
+		chunks[(*num_chunks)++] = (struct target_memory_chunk) {
+			.address = address + head, .size = 4, .count = words,
+			.buffer = buffer + head,
+		};
+	}
+
+	if (tail) {
+		chunks[(*num_chunks)++] = (struct target_memory_chunk) {
+			.address = address + head + 4 * words, .size = 1, .count = tail,
+			.buffer = buffer + head + 4 * words,
+		};
+	}
+}
+
+int target_rtt_read_callback(struct target *target,
+		const struct rtt_control *ctrl, struct rtt_sink_list **sinks,
+		size_t num_channels, struct rtt_read_stats *stats, void *user_data)
 {
 	int ret;
-	uint32_t len;
+	size_t total = 0;
+	unsigned int num_chunks = 0;
 
-	if (!*length)
+	stats->bytes = 0;
+	stats->max_fill = 0;
+
+	num_channels = MIN(num_channels, ctrl->num_up_channels);
+
+	/* Only read the descriptors up to the last channel with a sink */
+	while (num_channels && !sinks[num_channels - 1])
+		num_channels--;
+
+	if (!num_channels)
 		return ERROR_OK;
 
-	if (channel->read_pos == channel->write_pos) {
-		len = 0;
-	} else if (channel->read_pos < channel->write_pos) {
-		len = MIN(*length, channel->write_pos - channel->read_pos);
+	if (num_channels > rtt_poll.max_channels) {
+		struct rtt_channel *channels;
+		struct target_memory_chunk *chunks;
 
-		ret = target_read_buffer(target,
-			channel->buffer_addr + channel->read_pos, len, buffer);
+		channels = realloc(rtt_poll.channels, num_channels * sizeof(*channels));
+		if (channels)
+			rtt_poll.channels = channels;
+		chunks = realloc(rtt_poll.chunks, 6 * num_channels * sizeof(*chunks));
+		if (chunks)
+			rtt_poll.chunks = chunks;
 
-		if (ret != ERROR_OK)
-			return ret;
-	} else {
-		uint32_t first_length;
+		if (!channels || !chunks)
+			return ERROR_FAIL;
 
-		len = MIN(*length,
-			channel->size - channel->read_pos + channel->write_pos);
-		first_length = MIN(len, channel->size - channel->read_pos);
+		rtt_poll.max_channels = num_channels;
+	}
 
-		ret = target_read_buffer(target,
-			channel->buffer_addr + channel->read_pos, first_length, buffer);
+	/* Descriptors of all up-channels at once */
+	ret = grow_buffer(&rtt_poll.desc, &rtt_poll.desc_size,
+		num_channels * RTT_CHANNEL_SIZE);
 
-		if (ret != ERROR_OK)
-			return ret;
+	if (ret != ERROR_OK)
+		return ret;
 
-		ret = target_read_buffer(target, channel->buffer_addr,
-			len - first_length, buffer + first_length);
+	ret = target_read_buffer(target, ctrl->address + RTT_CB_SIZE,
+		num_channels * RTT_CHANNEL_SIZE, rtt_poll.desc);
 
-		if (ret != ERROR_OK)
-			return ret;
+	if (ret != ERROR_OK) {
+		LOG_ERROR("rtt: Failed to read up-channel descriptions");
+		return ret;
 	}
 
-	if (len > 0) {
-		ret = target_write_u32(target, channel->address + 16,
-			(channel->read_pos + len) % channel->size);
+	for (size_t i = 0; i < num_channels; i++) {
+		struct rtt_channel *channel = &rtt_poll.channels[i];
 
-		if (ret != ERROR_OK)
-			return ret;
+		parse_rtt_channel(rtt_poll.desc + i * RTT_CHANNEL_SIZE,
+			ctrl->address + RTT_CB_SIZE + i * RTT_CHANNEL_SIZE, channel);
+
+		if (!sinks[i]) {
+			channel->size = 0;
+			continue;
+		}
+
+		if (!channel_is_active(channel)) {
+			LOG_WARNING("rtt: Up-channel %zu is not active", i);
+			continue;
+		}
+
+		if (channel->size < RTT_CHANNEL_BUFFER_MIN_SIZE) {
+			LOG_WARNING("rtt: Up-channel %zu is not large enough", i);
+			channel->size = 0;
+			continue;
+		}
+
+		if (channel->read_pos >= channel->size ||
+				channel->write_pos >= channel->size) {
+			LOG_DEBUG("rtt: Up-channel %zu has invalid positions", i);
+			channel->size = 0;
+			continue;
+		}
+
+		total += channel_available(channel);
 	}
 
-	*length = len;
+	/* The data of all channels in one batch, as much as there is */
+	ret = grow_buffer(&rtt_poll.data, &rtt_poll.data_size, total);
 
-	return ERROR_OK;
-}
+	if (ret != ERROR_OK)
+		return ret;
 
-int target_rtt_read_callback(struct target *target,
-		const struct rtt_control *ctrl, struct rtt_sink_list **sinks,
-		size_t num_channels, void *user_data)
-{
-	num_channels = MIN(num_channels, ctrl->num_up_channels);
+	total = 0;
 
 	for (size_t i = 0; i < num_channels; i++) {
-		int ret;
-		struct rtt_channel channel;
-		uint8_t buffer[1024];
-		size_t length;
+		const struct rtt_channel *channel = &rtt_poll.channels[i];
 
-		if (!sinks[i])
+		if (!channel->size)
 			continue;
 
-		ret = read_rtt_channel(target, ctrl, i, RTT_CHANNEL_TYPE_UP,
-			&channel);
+		uint32_t length = channel_available(channel);
+		uint32_t first_length = MIN(length, channel->size - channel->read_pos);
+
+		add_read_chunks(rtt_poll.chunks, &num_chunks,
+			channel->buffer_addr + channel->read_pos, first_length,
+			rtt_poll.data + total);
+		add_read_chunks(rtt_poll.chunks, &num_chunks, channel->buffer_addr,
+			length - first_length, rtt_poll.data + total + first_length);
+
+		total += length;
+	}
+
+	if (num_chunks) {
+		ret = target_read_memory_multi(target, num_chunks, rtt_poll.chunks);
 
 		if (ret != ERROR_OK) {
-			LOG_ERROR("rtt: Failed to read up-channel %zu description", i);
+			LOG_ERROR("rtt: Failed to read from up-channels");
 			return ret;
 		}
+	}
 
-		if (!channel_is_active(&channel)) {
-			LOG_WARNING("rtt: Up-channel %zu is not active", i);
+	total = 0;
+
+	for (size_t i = 0; i < num_channels; i++) {
+		const struct rtt_channel *channel = &rtt_poll.channels[i];
+		const uint8_t *buffer = rtt_poll.data + total;
+
+		if (!channel->size)
 			continue;
-		}
 
-		if (channel.size < RTT_CHANNEL_BUFFER_MIN_SIZE) {
-			LOG_WARNING("rtt: Up-channel %zu is not large enough", i);
+		uint32_t length = channel_available(channel);
+
+		if (!length)
 			continue;
-		}
 
-		length = sizeof(buffer);
-		ret = read_from_channel(target, &channel, buffer, &length);
+		ret = target_write_u32(target, channel->address + 16,
+			(channel->read_pos + length) % channel->size);
 
 		if (ret != ERROR_OK) {
 			LOG_ERROR("rtt: Failed to read from up-channel %zu", i);
 			return ret;
 		}
 
+		total += length;
+
+		stats->bytes += length;
+		stats->max_fill = MAX(stats->max_fill,
+			(unsigned int)((uint64_t)length * 100 / channel->size));
+
 		for (struct rtt_sink_list *sink = sinks[i]; sink; sink = sink->next)
 			sink->read(i, buffer, length, sink->user_data);
 	}
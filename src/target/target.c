@@ -48,6 +48,7 @@
 #include "arm_cti.h"
 #include "smp.h"
 #include "semihosting_common.h"
+#include "mem_cache.h"
 
 /* default halt wait timeout (ms) */
 #define DEFAULT_HALT_TIMEOUT 5000
@@ -61,6 +62,8 @@ static int target_get_gdb_fileio_info_default(struct target *target,
 		struct gdb_fileio_info *fileio_info);
 static int target_gdb_fileio_end_default(struct target *target, int retcode,
 		int fileio_errno, bool ctrl_c);
+static void target_drop_loader_areas(struct target *target, target_addr_t address,
+		uint32_t size);
 
 static struct target_type *target_types[] = {
 	&arm7tdmi_target,
@@ -107,8 +110,18 @@ static struct target_type *target_types[] = {
 
 struct target *all_targets;
 static struct target_event_callback *target_event_callbacks;
-static struct target_timer_callback *target_timer_callbacks;
-static int64_t target_timer_next_event_value;
+
+/* Timer callbacks are kept in a binary min-heap ordered by deadline, so
+ * registering, finding the next due callback and computing the next
+ * deadline no longer walk every registered timer. */
+static struct target_timer_callback **target_timer_heap;
+static unsigned int target_timer_heap_count;
+static unsigned int target_timer_heap_size;
+/* due callbacks taken off the heap while they are being called */
+static struct target_timer_callback **target_timer_due;
+static unsigned int target_timer_due_count;
+static unsigned int target_timer_due_size;
+static uint64_t target_timer_seq;
 static OOCD_LIST_HEAD(target_reset_callback_list);
 static OOCD_LIST_HEAD(target_trace_callback_list);
 static const int polling_interval = TARGET_DEFAULT_POLLING_INTERVAL;
@@ -579,6 +592,8 @@ int target_resume(struct target *target, bool current, target_addr_t address,
 	 * Disable polling during resume() to guarantee the execution of handlers
 	 * in the correct order.
 	 */
+	mem_cache_invalidate(target);
+
 	bool save_poll_mask = jtag_poll_mask();
 	retval = target->type->resume(target, current, address, handle_breakpoints,
 		debug_execution);
@@ -790,6 +805,7 @@ int target_run_algorithm(struct target *target,
 		goto done;
 	}
 
+	mem_cache_invalidate(target);
 	target->running_alg = true;
 	retval = target->type->run_algorithm(target,
 			num_mem_params, mem_params,
@@ -835,6 +851,7 @@ int target_start_algorithm(struct target *target,
 		goto done;
 	}
 
+	mem_cache_invalidate(target);
 	target->running_alg = true;
 	retval = target->type->start_algorithm(target,
 			num_mem_params, mem_params,
@@ -1247,9 +1264,33 @@ int target_read_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support read_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	if (mem_cache_enabled(target))
+		return mem_cache_read(target, address, size, count, buffer);
 	return target->type->read_memory(target, address, size, count, buffer);
 }
 
+int target_read_memory_multi(struct target *target,
+		unsigned int num, const struct target_memory_chunk *chunks)
+{
+	if (!target_was_examined(target)) {
+		LOG_ERROR("Target not examined yet");
+		return ERROR_FAIL;
+	}
+
+	/* the memory read cache, if enabled, is only behind read_memory */
+	if (target->type->read_memory_multi && !mem_cache_enabled(target))
+		return target->type->read_memory_multi(target, num, chunks);
+
+	for (unsigned int i = 0; i < num; i++) {
+		int retval = target_read_memory(target, chunks[i].address,
+				chunks[i].size, chunks[i].count, chunks[i].buffer);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return ERROR_OK;
+}
+
 int target_read_phys_memory(struct target *target,
 		target_addr_t address, uint32_t size, uint32_t count, uint8_t *buffer)
 {
@@ -1275,6 +1316,8 @@ int target_write_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	mem_cache_invalidate(target);
+	target_drop_loader_areas(target, address, size * count);
 	return target->type->write_memory(target, address, size, count, buffer);
 }
 
@@ -1289,6 +1332,9 @@ int target_write_phys_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_phys_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	mem_cache_invalidate(target);
+	/* reserved loaders may be at virtual addresses, drop them all */
+	target_drop_loader_areas(target, 0, 0);
 	return target->type->write_phys_memory(target, address, size, count, buffer);
 }
 
@@ -1416,6 +1462,8 @@ int target_step(struct target *target,
 
 	target_call_event_callbacks(target, TARGET_EVENT_STEP_START);
 
+	mem_cache_invalidate(target);
+	target_drop_loader_areas(target, 0, 0);
 	retval = target->type->step(target, current, address, handle_breakpoints);
 	if (retval != ERROR_OK)
 		return retval;
@@ -1657,33 +1705,132 @@ int target_register_trace_callback(int (*callback)(struct target *target,
 	return ERROR_OK;
 }
 
+static bool target_timer_before(const struct target_timer_callback *a,
+		const struct target_timer_callback *b)
+{
+	if (a->when != b->when)
+		return a->when < b->when;
+	return a->seq < b->seq;
+}
+
+static void target_timer_heap_sift_up(unsigned int i)
+{
+	struct target_timer_callback *cb = target_timer_heap[i];
+
+	while (i > 0) {
+		unsigned int parent = (i - 1) / 2;
+		if (!target_timer_before(cb, target_timer_heap[parent]))
+			break;
+		target_timer_heap[i] = target_timer_heap[parent];
+		i = parent;
+	}
+	target_timer_heap[i] = cb;
+}
+
+static void target_timer_heap_sift_down(unsigned int i)
+{
+	struct target_timer_callback *cb = target_timer_heap[i];
+
+	for (;;) {
+		unsigned int child = 2 * i + 1;
+		if (child >= target_timer_heap_count)
+			break;
+		if (child + 1 < target_timer_heap_count &&
+				target_timer_before(target_timer_heap[child + 1], target_timer_heap[child]))
+			child++;
+		if (!target_timer_before(target_timer_heap[child], cb))
+			break;
+		target_timer_heap[i] = target_timer_heap[child];
+		i = child;
+	}
+	target_timer_heap[i] = cb;
+}
+
+static int target_timer_heap_push(struct target_timer_callback *cb)
+{
+	if (target_timer_heap_count == target_timer_heap_size) {
+		unsigned int size = target_timer_heap_size ? 2 * target_timer_heap_size : 16;
+		struct target_timer_callback **heap = realloc(target_timer_heap, size * sizeof(*heap));
+		if (!heap) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		target_timer_heap = heap;
+		target_timer_heap_size = size;
+	}
+
+	target_timer_heap[target_timer_heap_count++] = cb;
+	target_timer_heap_sift_up(target_timer_heap_count - 1);
+	return ERROR_OK;
+}
+
+static struct target_timer_callback *target_timer_heap_pop(void)
+{
+	struct target_timer_callback *top = target_timer_heap[0];
+
+	if (--target_timer_heap_count > 0) {
+		target_timer_heap[0] = target_timer_heap[target_timer_heap_count];
+		target_timer_heap_sift_down(0);
+	}
+	return top;
+}
+
+static void target_timer_heap_rebuild(void)
+{
+	for (unsigned int i = target_timer_heap_count / 2; i-- > 0; )
+		target_timer_heap_sift_down(i);
+}
+
+/* Drop unregistered callbacks from the top of the heap so that it
+ * reflects the real next deadline. */
+static void target_timer_heap_prune(void)
+{
+	while (target_timer_heap_count && target_timer_heap[0]->removed)
+		free(target_timer_heap_pop());
+}
+
+static int target_timer_due_push(struct target_timer_callback *cb)
+{
+	if (target_timer_due_count == target_timer_due_size) {
+		unsigned int size = target_timer_due_size ? 2 * target_timer_due_size : 16;
+		struct target_timer_callback **due = realloc(target_timer_due, size * sizeof(*due));
+		if (!due) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		target_timer_due = due;
+		target_timer_due_size = size;
+	}
+
+	target_timer_due[target_timer_due_count++] = cb;
+	return ERROR_OK;
+}
+
 int target_register_timer_callback(int (*callback)(void *priv),
 		unsigned int time_ms, enum target_timer_type type, void *priv)
 {
-	struct target_timer_callback **callbacks_p = &target_timer_callbacks;
-
 	if (!callback)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	if (*callbacks_p) {
-		while ((*callbacks_p)->next)
-			callbacks_p = &((*callbacks_p)->next);
-		callbacks_p = &((*callbacks_p)->next);
+	struct target_timer_callback *cb = calloc(1, sizeof(*cb));
+	if (!cb) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
 	}
 
-	(*callbacks_p) = malloc(sizeof(struct target_timer_callback));
-	(*callbacks_p)->callback = callback;
-	(*callbacks_p)->type = type;
-	(*callbacks_p)->time_ms = time_ms;
-	(*callbacks_p)->removed = false;
-
-	(*callbacks_p)->when = timeval_ms() + time_ms;
-	target_timer_next_event_value = MIN(target_timer_next_event_value, (*callbacks_p)->when);
+	cb->callback = callback;
+	cb->type = type;
+	cb->time_ms = time_ms;
+	cb->removed = false;
+	cb->when = timeval_ms() + time_ms;
+	cb->priv = priv;
+	cb->seq = target_timer_seq++;
 
-	(*callbacks_p)->priv = priv;
-	(*callbacks_p)->next = NULL;
+	int retval = target_timer_heap_push(cb);
+	if (retval != ERROR_OK)
+		free(cb);
 
-	return ERROR_OK;
+	return retval;
 }
 
 int target_unregister_event_callback(int (*callback)(struct target *target,
@@ -1752,9 +1899,19 @@ int target_unregister_timer_callback(int (*callback)(void *priv), void *priv)
 	if (!callback)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	for (struct target_timer_callback *c = target_timer_callbacks;
-	     c; c = c->next) {
-		if ((c->callback == callback) && (c->priv == priv)) {
+	/* Entries are only flagged here and freed once they reach the top of
+	 * the heap, as callbacks may unregister timers while being called. */
+	for (unsigned int i = 0; i < target_timer_due_count; i++) {
+		struct target_timer_callback *c = target_timer_due[i];
+		if (!c->removed && c->callback == callback && c->priv == priv) {
+			c->removed = true;
+			return ERROR_OK;
+		}
+	}
+
+	for (unsigned int i = 0; i < target_timer_heap_count; i++) {
+		struct target_timer_callback *c = target_timer_heap[i];
+		if (!c->removed && c->callback == callback && c->priv == priv) {
 			c->removed = true;
 			return ERROR_OK;
 		}
@@ -1777,6 +1934,23 @@ int target_call_event_callbacks(struct target *target, enum target_event event)
 			target_event_name(event),
 			target_name(target));
 
+	switch (event) {
+	case TARGET_EVENT_RESUMED:
+	case TARGET_EVENT_RESET_ASSERT:
+	case TARGET_EVENT_RESET_END:
+		/* application code may overwrite reserved loaders */
+		target_drop_loader_areas(target, 0, 0);
+		/* fallthrough */
+	case TARGET_EVENT_HALTED:
+	case TARGET_EVENT_DEBUG_HALTED:
+	case TARGET_EVENT_DEBUG_RESUMED:
+		/* the target may have run on its own, e.g. with SMP or semihosting */
+		mem_cache_invalidate(target);
+		break;
+	default:
+		break;
+	}
+
 	target_handle_event(target, event);
 
 	while (callback) {
@@ -1811,22 +1985,39 @@ int target_call_trace_callbacks(struct target *target, size_t len, uint8_t *data
 	return ERROR_OK;
 }
 
-static int target_timer_callback_periodic_restart(
-		struct target_timer_callback *cb, int64_t *now)
+static void target_call_timer_callback(struct target_timer_callback *cb,
+		int64_t now)
 {
-	cb->when = *now + cb->time_ms;
-	return ERROR_OK;
-}
+	struct duration run;
+	int64_t late = now - cb->when;
 
-static int target_call_timer_callback(struct target_timer_callback *cb,
-		int64_t *now)
-{
+	if (late < 0)
+		late = 0;	/* invoked early by target_call_timer_callbacks_now() */
+
+	if (cb->calls)
+		cb->jitter_total_ms += llabs(late - cb->late_last_ms);
+	cb->late_last_ms = late;
+	cb->late_total_ms += late;
+	if (late > cb->late_max_ms)
+		cb->late_max_ms = late;
+	cb->calls++;
+
+	duration_start(&run);
 	cb->callback(cb->priv);
+	duration_measure(&run);
 
-	if (cb->type == TARGET_TIMER_TYPE_PERIODIC)
-		return target_timer_callback_periodic_restart(cb, now);
+	int64_t run_us = (int64_t)run.elapsed.tv_sec * 1000000 + run.elapsed.tv_usec;
+	cb->run_total_us += run_us;
+	if (run_us > cb->run_max_us)
+		cb->run_max_us = run_us;
+}
 
-	return target_unregister_timer_callback(cb->callback, cb->priv);
+static int target_timer_due_compare(const void *a, const void *b)
+{
+	const struct target_timer_callback *cb_a = *(struct target_timer_callback * const *)a;
+	const struct target_timer_callback *cb_b = *(struct target_timer_callback * const *)b;
+
+	return target_timer_before(cb_a, cb_b) ? -1 : 1;
 }
 
 static int target_call_timer_callbacks_check_time(int checktime)
@@ -1843,35 +2034,51 @@ static int target_call_timer_callbacks_check_time(int checktime)
 
 	int64_t now = timeval_ms();
 
-	/* Initialize to a default value that's a ways into the future.
-	 * The loop below will make it closer to now if there are
-	 * callbacks that want to be called sooner. */
-	target_timer_next_event_value = now + 1000;
-
-	/* Store an address of the place containing a pointer to the
-	 * next item; initially, that's a standalone "root of the
-	 * list" variable. */
-	struct target_timer_callback **callback = &target_timer_callbacks;
-	while (callback && *callback) {
-		if ((*callback)->removed) {
-			struct target_timer_callback *p = *callback;
-			*callback = (*callback)->next;
-			free(p);
-			continue;
+	/* Move all callbacks to be called now from the heap to the due list.
+	 * Callbacks registered while these are being called go straight to the
+	 * heap and are not called before the next round. */
+	assert(target_timer_due_count == 0);
+	if (checktime) {
+		while (target_timer_heap_count &&
+				(target_timer_heap[0]->removed || target_timer_heap[0]->when <= now)) {
+			if (target_timer_due_push(target_timer_heap[0]) != ERROR_OK)
+				break;
+			target_timer_heap_pop();
 		}
+	} else {
+		/* all periodic callbacks run, others only if they have expired */
+		unsigned int kept = 0;
+		for (unsigned int i = 0; i < target_timer_heap_count; i++) {
+			struct target_timer_callback *c = target_timer_heap[i];
+			if ((c->removed || c->type == TARGET_TIMER_TYPE_PERIODIC || c->when <= now) &&
+					target_timer_due_push(c) == ERROR_OK)
+				continue;
+			target_timer_heap[kept++] = c;
+		}
+		target_timer_heap_count = kept;
+		target_timer_heap_rebuild();
+		qsort(target_timer_due, target_timer_due_count, sizeof(*target_timer_due),
+				target_timer_due_compare);
+	}
 
-		bool call_it = (*callback)->callback &&
-			((!checktime && (*callback)->type == TARGET_TIMER_TYPE_PERIODIC) ||
-			 now >= (*callback)->when);
-
-		if (call_it)
-			target_call_timer_callback(*callback, &now);
+	for (unsigned int i = 0; i < target_timer_due_count; i++) {
+		struct target_timer_callback *c = target_timer_due[i];
+		if (!c->removed)
+			target_call_timer_callback(c, now);
+	}
 
-		if (!(*callback)->removed && (*callback)->when < target_timer_next_event_value)
-			target_timer_next_event_value = (*callback)->when;
+	for (unsigned int i = 0; i < target_timer_due_count; i++) {
+		struct target_timer_callback *c = target_timer_due[i];
+		if (c->removed || c->type != TARGET_TIMER_TYPE_PERIODIC) {
+			free(c);
+			continue;
+		}
 
-		callback = &(*callback)->next;
+		c->when = now + c->time_ms;
+		if (target_timer_heap_push(c) != ERROR_OK)
+			free(c);
 	}
+	target_timer_due_count = 0;
 
 	callback_processing = false;
 	return ERROR_OK;
@@ -1890,7 +2097,13 @@ int target_call_timer_callbacks_now(void)
 
 int64_t target_timer_next_event(void)
 {
-	return target_timer_next_event_value;
+	target_timer_heap_prune();
+
+	/* Without timers, check back a ways into the future */
+	if (!target_timer_heap_count)
+		return timeval_ms() + 1000;
+
+	return target_timer_heap[0]->when;
 }
 
 /* Prints the working area layout for debug purposes */
@@ -1900,7 +2113,7 @@ static void print_wa_layout(struct target *target)
 
 	while (c) {
 		LOG_DEBUG("%c%c " TARGET_ADDR_FMT "-" TARGET_ADDR_FMT " (%" PRIu32 " bytes)",
-			c->backup ? 'b' : ' ', c->free ? ' ' : '*',
+			c->backup ? 'b' : ' ', c->free ? ' ' : (c->user ? '*' : 'l'),
 			c->address, c->address + c->size - 1, c->size);
 		c = c->next;
 	}
@@ -1924,6 +2137,7 @@ static void target_split_working_area(struct working_area *area, uint32_t size)
 		new_wa->address = area->address + size;
 		new_wa->backup = NULL;
 		new_wa->user = NULL;
+		new_wa->loader = NULL;
 		new_wa->free = true;
 
 		area->next = new_wa;
@@ -1965,6 +2179,51 @@ static void target_merge_working_areas(struct target *target)
 	}
 }
 
+/* A loader area which was freed by its user but kept in target memory */
+static bool target_working_area_is_reserved(struct working_area *area)
+{
+	return !area->free && !area->user && area->loader;
+}
+
+/* Release reserved loader areas overlapping the given range, all if size is 0 */
+static void target_drop_loader_areas(struct target *target, target_addr_t address, uint32_t size)
+{
+	bool dropped = false;
+
+	for (struct working_area *c = target->working_areas; c; c = c->next) {
+		if (!c->loader)
+			continue;
+		if (size && (address >= c->address + c->size || address + size <= c->address))
+			continue;
+
+		if (target_working_area_is_reserved(c)) {
+			c->free = true;
+			dropped = true;
+		}
+		/* the content of areas in use is no longer known */
+		c->loader = NULL;
+	}
+
+	if (dropped) {
+		LOG_DEBUG("dropped reserved loader areas");
+		target_merge_working_areas(target);
+	}
+}
+
+static struct working_area *target_find_free_working_area(struct target *target, uint32_t size)
+{
+	struct working_area *c = target->working_areas;
+
+	/* Find the first large enough working area */
+	while (c) {
+		if (c->free && c->size >= size)
+			break;
+		c = c->next;
+	}
+
+	return c;
+}
+
 int target_alloc_working_area_try(struct target *target, uint32_t size, struct working_area **area)
 {
 	/* Reevaluate working area address based on MMU state*/
@@ -2008,6 +2267,7 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 			new_wa->address = target->working_area;
 			new_wa->backup = NULL;
 			new_wa->user = NULL;
+			new_wa->loader = NULL;
 			new_wa->free = true;
 		}
 
@@ -2017,13 +2277,12 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 	/* only allocate multiples of 4 byte */
 	size = ALIGN_UP(size, 4);
 
-	struct working_area *c = target->working_areas;
+	struct working_area *c = target_find_free_working_area(target, size);
 
-	/* Find the first large enough working area */
-	while (c) {
-		if (c->free && c->size >= size)
-			break;
-		c = c->next;
+	/* Reserved loaders give way to any new allocation */
+	if (!c) {
+		target_drop_loader_areas(target, 0, 0);
+		c = target_find_free_working_area(target, size);
 	}
 
 	if (!c)
@@ -2070,6 +2329,47 @@ int target_alloc_working_area(struct target *target, uint32_t size, struct worki
 
 }
 
+int target_alloc_working_area_largest(struct target *target,
+		uint32_t min_size, uint32_t max_size, struct working_area **area)
+{
+	uint32_t size = MIN(target_get_working_area_avail(target), ALIGN_DOWN(max_size, 4));
+
+	if (size < min_size)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	return target_alloc_working_area_try(target, size, area);
+}
+
+int target_alloc_working_area_loader(struct target *target,
+		const uint8_t *code, uint32_t size, struct working_area **area)
+{
+	for (struct working_area *c = target->working_areas; c; c = c->next) {
+		if (c->loader == code && c->size == ALIGN_UP(size, 4)
+				&& target_working_area_is_reserved(c)) {
+			LOG_DEBUG("reusing loader at address " TARGET_ADDR_FMT, c->address);
+			c->user = area;
+			*area = c;
+			return ERROR_OK;
+		}
+	}
+
+	int retval = target_alloc_working_area(target, size, area);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = target_write_buffer(target, (*area)->address, size, code);
+	if (retval != ERROR_OK) {
+		target_free_working_area(target, *area);
+		return retval;
+	}
+
+	/* With backup the area must be restored on free, it can't be kept */
+	if (!target->backup_working_area)
+		(*area)->loader = code;
+
+	return ERROR_OK;
+}
+
 static int target_restore_working_area(struct target *target, struct working_area *area)
 {
 	int retval = ERROR_OK;
@@ -2098,11 +2398,6 @@ static int target_free_working_area_restore(struct target *target, struct workin
 			return retval;
 	}
 
-	area->free = true;
-
-	LOG_DEBUG("freed %" PRIu32 " bytes of working area at address " TARGET_ADDR_FMT,
-			area->size, area->address);
-
 	/* mark user pointer invalid */
 	/* TODO: Is this really safe? It points to some previous caller's memory.
 	 * How could we know that the area pointer is still in that place and not
@@ -2110,6 +2405,19 @@ static int target_free_working_area_restore(struct target *target, struct workin
 	*area->user = NULL;
 	area->user = NULL;
 
+	/* Keep loaders in place for the next flash operation */
+	if (area->loader) {
+		LOG_DEBUG("reserved %" PRIu32 " bytes of loader at address " TARGET_ADDR_FMT,
+				area->size, area->address);
+		print_wa_layout(target);
+		return retval;
+	}
+
+	area->free = true;
+
+	LOG_DEBUG("freed %" PRIu32 " bytes of working area at address " TARGET_ADDR_FMT,
+			area->size, area->address);
+
 	target_merge_working_areas(target);
 
 	print_wa_layout(target);
@@ -2137,8 +2445,10 @@ static void target_free_all_working_areas_restore(struct target *target, int res
 			if (restore)
 				target_restore_working_area(target, c);
 			c->free = true;
-			*c->user = NULL; /* Same as above */
+			if (c->user)
+				*c->user = NULL; /* Same as above */
 			c->user = NULL;
+			c->loader = NULL;
 		}
 		c = c->next;
 	}
@@ -2167,13 +2477,20 @@ uint32_t target_get_working_area_avail(struct target *target)
 {
 	struct working_area *c = target->working_areas;
 	uint32_t max_size = 0;
+	uint32_t run = 0;
 
 	if (!c)
 		return ALIGN_DOWN(target->working_area_size, 4);
 
+	/* Reserved loaders are released on demand, count them as free */
 	while (c) {
-		if (c->free && max_size < c->size)
-			max_size = c->size;
+		if (c->free || target_working_area_is_reserved(c))
+			run += c->size;
+		else
+			run = 0;
+
+		if (max_size < run)
+			max_size = run;
 
 		c = c->next;
 	}
@@ -2204,6 +2521,7 @@ static void target_destroy(struct target *target)
 	}
 
 	target_free_all_working_areas(target);
+	mem_cache_free(target);
 
 	/* release the targets SMP list */
 	if (target->smp) {
@@ -2239,13 +2557,15 @@ void target_quit(void)
 	}
 	target_event_callbacks = NULL;
 
-	struct target_timer_callback *pt = target_timer_callbacks;
-	while (pt) {
-		struct target_timer_callback *t = pt->next;
-		free(pt);
-		pt = t;
-	}
-	target_timer_callbacks = NULL;
+	for (unsigned int i = 0; i < target_timer_heap_count; i++)
+		free(target_timer_heap[i]);
+	free(target_timer_heap);
+	target_timer_heap = NULL;
+	target_timer_heap_count = 0;
+	target_timer_heap_size = 0;
+	free(target_timer_due);
+	target_timer_due = NULL;
+	target_timer_due_size = 0;
 
 	for (struct target *target = all_targets; target;) {
 		struct target *tmp;
@@ -2289,38 +2609,71 @@ static int target_gdb_fileio_end_default(struct target *target,
 	return ERROR_OK;
 }
 
+/* PC samples per second taken by target_profiling_default(), 0 = unthrottled */
+static uint32_t profiling_sample_rate;
+
 int target_profiling_default(struct target *target, uint32_t *samples,
 		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
 {
-	struct timeval timeout, now;
+	struct timeval timeout, now, next_sample;
 
 	gettimeofday(&timeout, NULL);
 	timeval_add_time(&timeout, seconds, 0);
+	gettimeofday(&next_sample, NULL);
+
+	long period_us = 0;
+	if (profiling_sample_rate)
+		period_us = 1000000 / profiling_sample_rate;
 
-	LOG_INFO("Starting profiling. Halting and resuming the"
-			" target as often as we can...");
+	bool batched = target->type->sample_pc;
+	if (period_us)
+		LOG_INFO("Starting profiling at %" PRIu32 " samples/s. Halting and resuming"
+				" the target%s...", profiling_sample_rate,
+				batched ? " in one transaction per sample" : "");
+	else
+		LOG_INFO("Starting profiling. Halting and resuming the"
+				" target%s as often as we can...",
+				batched ? " in one transaction per sample" : "");
 
 	uint32_t sample_count = 0;
+	uint32_t dropped = 0;
 	/* hopefully it is safe to cache! We want to stop/restart as quickly as possible. */
 	struct reg *reg = register_get_by_name(target->reg_cache, "pc", true);
 
 	int retval = ERROR_OK;
 	for (;;) {
-		target_poll(target);
-		if (target->state == TARGET_HALTED) {
-			uint32_t t = buf_get_u32(reg->value, 0, 32);
-			samples[sample_count++] = t;
-			/* current pc, addr = 0, do not handle breakpoints, not debugging */
-			retval = target_resume(target, true, 0, false, false);
-			target_poll(target);
-			alive_sleep(10); /* sleep 10ms, i.e. <100 samples/second. */
-		} else if (target->state == TARGET_RUNNING) {
-			/* We want to quickly sample the PC. */
-			retval = target_halt(target);
+		uint32_t prev_count = sample_count;
+
+		if (batched && target->state == TARGET_RUNNING) {
+			/* Halt, read PC and resume in a single queue flush. The target
+			 * state and register cache are left untouched. */
+			retval = target->type->sample_pc(target, &samples[sample_count]);
+			if (retval == ERROR_OK) {
+				sample_count++;
+			} else if (retval == ERROR_TARGET_NOT_HALTED) {
+				/* core did not stop in time, just try again */
+				dropped++;
+				retval = ERROR_OK;
+			} else if (retval == ERROR_NOT_IMPLEMENTED) {
+				LOG_DEBUG("batched PC sampling unavailable, using halt/resume");
+				batched = false;
+				retval = ERROR_OK;
+			}
 		} else {
-			LOG_INFO("Target not halted or running");
-			retval = ERROR_OK;
-			break;
+			target_poll(target);
+			if (target->state == TARGET_HALTED) {
+				uint32_t t = buf_get_u32(reg->value, 0, 32);
+				samples[sample_count++] = t;
+				/* current pc, addr = 0, do not handle breakpoints, not debugging */
+				retval = target_resume(target, true, 0, false, false);
+			} else if (target->state == TARGET_RUNNING) {
+				/* We want to quickly sample the PC. */
+				retval = target_halt(target);
+			} else {
+				LOG_INFO("Target not halted or running");
+				retval = ERROR_OK;
+				break;
+			}
 		}
 
 		if (retval != ERROR_OK)
@@ -2329,8 +2682,22 @@ int target_profiling_default(struct target *target, uint32_t *samples,
 		gettimeofday(&now, NULL);
 		if ((sample_count >= max_num_samples) || timeval_compare(&now, &timeout) >= 0) {
 			LOG_INFO("Profiling completed. %" PRIu32 " samples.", sample_count);
+			if (dropped)
+				LOG_DEBUG("%" PRIu32 " samples dropped", dropped);
 			break;
 		}
+
+		/* Only pace complete samples; a halt request is followed by
+		 * its poll and resume as fast as possible. */
+		if (period_us && sample_count != prev_count) {
+			timeval_add_time(&next_sample, 0, period_us);
+			struct timeval delta;
+			if (timeval_subtract(&delta, &next_sample, &now) == 0)
+				jtag_sleep(delta.tv_sec * 1000000 + delta.tv_usec);
+			else
+				next_sample = now;	/* running late, don't try to catch up */
+		}
+		keep_alive();
 	}
 
 	*num_samples = sample_count;
@@ -2362,6 +2729,8 @@ int target_write_buffer(struct target *target, target_addr_t address, uint32_t s
 		return ERROR_FAIL;
 	}
 
+	mem_cache_invalidate(target);
+	target_drop_loader_areas(target, address, size);
 	return target->type->write_buffer(target, address, size, buffer);
 }
 
@@ -3610,9 +3979,43 @@ static COMMAND_HELPER(parse_load_image_command, struct image *image,
 	return ERROR_OK;
 }
 
+/*
+ * Get the data of a whole image section, straight from the mapped image file
+ * where possible. Otherwise it is read into *buffer, which must be freed.
+ */
+static int target_image_section_data(struct image *image, unsigned int section,
+		uint8_t **buffer, const uint8_t **data, size_t *size)
+{
+	int retval;
+
+	*buffer = NULL;
+	*size = image->sections[section].size;
+
+	if (image_map_section(image, section, 0x0, *size, data) == ERROR_OK)
+		return ERROR_OK;
+
+	*buffer = malloc(*size);
+	if (!*buffer) {
+		LOG_ERROR("error allocating buffer for section (%zu bytes)", *size);
+		return ERROR_FAIL;
+	}
+
+	retval = image_read_section(image, section, 0x0, *size, *buffer, size);
+	if (retval != ERROR_OK) {
+		free(*buffer);
+		*buffer = NULL;
+		return retval;
+	}
+
+	*data = *buffer;
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_load_image_command)
 {
 	uint8_t *buffer;
+	const uint8_t *data;
 	size_t buf_cnt;
 	uint32_t image_size;
 	target_addr_t min_address = 0;
@@ -3635,20 +4038,9 @@ COMMAND_HANDLER(handle_load_image_command)
 	image_size = 0x0;
 	retval = ERROR_OK;
 	for (unsigned int i = 0; i < image.num_sections; i++) {
-		buffer = malloc(image.sections[i].size);
-		if (!buffer) {
-			command_print(CMD,
-						  "error allocating buffer for section (%d bytes)",
-						  (int)(image.sections[i].size));
-			retval = ERROR_FAIL;
-			break;
-		}
-
-		retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
-		if (retval != ERROR_OK) {
-			free(buffer);
+		retval = target_image_section_data(&image, i, &buffer, &data, &buf_cnt);
+		if (retval != ERROR_OK)
 			break;
-		}
 
 		uint32_t offset = 0;
 		uint32_t length = buf_cnt;
@@ -3668,7 +4060,7 @@ COMMAND_HANDLER(handle_load_image_command)
 				length -= (image.sections[i].base_address + buf_cnt)-max_address;
 
 			retval = target_write_buffer(target,
-					image.sections[i].base_address + offset, length, buffer + offset);
+					image.sections[i].base_address + offset, length, data + offset);
 			if (retval != ERROR_OK) {
 				free(buffer);
 				break;
@@ -3765,6 +4157,7 @@ enum verify_mode {
 static COMMAND_HELPER(handle_verify_image_command_internal, enum verify_mode verify)
 {
 	uint8_t *buffer;
+	const uint8_t *data;
 	size_t buf_cnt;
 	uint32_t image_size;
 	int retval;
@@ -3806,22 +4199,13 @@ static COMMAND_HELPER(handle_verify_image_command_internal, enum verify_mode ver
 	int diffs = 0;
 	retval = ERROR_OK;
 	for (unsigned int i = 0; i < image.num_sections; i++) {
-		buffer = malloc(image.sections[i].size);
-		if (!buffer) {
-			command_print(CMD,
-					"error allocating buffer for section (%" PRIu32 " bytes)",
-					image.sections[i].size);
-			break;
-		}
-		retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
-		if (retval != ERROR_OK) {
-			free(buffer);
+		retval = target_image_section_data(&image, i, &buffer, &data, &buf_cnt);
+		if (retval != ERROR_OK)
 			break;
-		}
 
 		if (verify >= IMAGE_VERIFY) {
 			/* calculate checksum of image */
-			retval = image_calculate_checksum(buffer, buf_cnt, &checksum);
+			retval = image_calculate_checksum(data, buf_cnt, &checksum);
 			if (retval != ERROR_OK) {
 				free(buffer);
 				break;
@@ -3840,27 +4224,27 @@ static COMMAND_HELPER(handle_verify_image_command_internal, enum verify_mode ver
 			}
 			if (checksum != mem_checksum) {
 				/* failed crc checksum, fall back to a binary compare */
-				uint8_t *data;
+				uint8_t *target_data;
 
 				if (diffs == 0)
 					LOG_ERROR("checksum mismatch - attempting binary compare");
 
-				data = malloc(buf_cnt);
+				target_data = malloc(buf_cnt);
 
-				retval = target_read_buffer(target, image.sections[i].base_address, buf_cnt, data);
+				retval = target_read_buffer(target, image.sections[i].base_address, buf_cnt, target_data);
 				if (retval == ERROR_OK) {
 					uint32_t t;
 					for (t = 0; t < buf_cnt; t++) {
-						if (data[t] != buffer[t]) {
+						if (target_data[t] != data[t]) {
 							command_print(CMD,
 								"diff %d address " TARGET_ADDR_FMT ". Was 0x%02" PRIx8 " instead of 0x%02" PRIx8,
 								diffs,
 								t + image.sections[i].base_address,
-								data[t],
-								buffer[t]);
+								target_data[t],
+								data[t]);
 							if (diffs++ >= 127) {
 								command_print(CMD, "More than 128 errors, the rest are not printed.");
-								free(data);
+								free(target_data);
 								free(buffer);
 								goto done;
 							}
@@ -3868,13 +4252,13 @@ static COMMAND_HELPER(handle_verify_image_command_internal, enum verify_mode ver
 						keep_alive();
 						if (openocd_is_shutdown_pending()) {
 							retval = ERROR_SERVER_INTERRUPTED;
-							free(data);
+							free(target_data);
 							free(buffer);
 							goto done;
 						}
 					}
 				}
-				free(data);
+				free(target_data);
 			}
 		} else {
 			command_print(CMD, "address " TARGET_ADDR_FMT " length 0x%08zx",
@@ -4402,6 +4786,22 @@ COMMAND_HANDLER(handle_profile_command)
 	return retval;
 }
 
+COMMAND_HANDLER(handle_profile_rate_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], profiling_sample_rate);
+
+	if (profiling_sample_rate)
+		command_print(CMD, "%" PRIu32 " samples/s", profiling_sample_rate);
+	else
+		command_print(CMD, "unthrottled");
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_target_read_memory)
 {
 	/*
@@ -5701,6 +6101,9 @@ static const struct command_registration target_instance_command_handlers[] = {
 		.help = "invoke handler for specified event",
 		.usage = "event_name",
 	},
+	{
+		.chain = mem_cache_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -6305,6 +6708,68 @@ COMMAND_HANDLER(handle_target_reset_nag)
 			"performance");
 }
 
+static void target_timer_stats_print(struct command_invocation *cmd,
+		const struct target_timer_callback *c, int64_t now)
+{
+	uint64_t calls = c->calls ? c->calls : 1;
+
+	command_print(cmd, "%p(%p) %-8s %5u %8" PRId64 " %8" PRIu64
+			" %8" PRId64 " %8" PRId64 " %8" PRId64 " %8" PRId64 " %8" PRId64,
+			c->callback, c->priv,
+			c->type == TARGET_TIMER_TYPE_PERIODIC ? "periodic" : "oneshot",
+			c->time_ms, c->when - now, c->calls,
+			c->late_total_ms / (int64_t)calls, c->late_max_ms,
+			c->calls > 1 ? c->jitter_total_ms / (int64_t)(c->calls - 1) : 0,
+			c->run_total_us / (int64_t)calls, c->run_max_us);
+}
+
+COMMAND_HANDLER(handle_timer_stats_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		for (unsigned int i = 0; i < target_timer_heap_count; i++) {
+			struct target_timer_callback *c = target_timer_heap[i];
+			c->calls = 0;
+			c->late_total_ms = 0;
+			c->late_max_ms = 0;
+			c->late_last_ms = 0;
+			c->jitter_total_ms = 0;
+			c->run_total_us = 0;
+			c->run_max_us = 0;
+		}
+		return ERROR_OK;
+	}
+
+	int64_t now = timeval_ms();
+
+	command_print(CMD, "callback(priv) type      period  next_ms    calls late_avg late_max jitter"
+			" run_avg_us run_max_us");
+	/* in deadline order, heap array order is not */
+	struct target_timer_callback **sorted = malloc(target_timer_heap_count * sizeof(*sorted));
+	if (!sorted && target_timer_heap_count) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < target_timer_heap_count; i++)
+		if (!target_timer_heap[i]->removed)
+			sorted[count++] = target_timer_heap[i];
+	if (count)
+		qsort(sorted, count, sizeof(*sorted), target_timer_due_compare);
+
+	for (unsigned int i = 0; i < count; i++)
+		target_timer_stats_print(CMD, sorted[i], now);
+
+	free(sorted);
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_ps_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -6541,6 +7006,14 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.usage = "seconds filename [start end]",
 		.help = "profiling samples the CPU PC",
 	},
+	{
+		.name = "profile_rate",
+		.handler = handle_profile_rate_command,
+		.mode = COMMAND_ANY,
+		.usage = "[samples_per_second]",
+		.help = "display or set the PC sample rate used by halt/resume "
+			"profiling, 0 means as fast as possible",
+	},
 	/** @todo don't register virt2phys() unless target supports it */
 	{
 		.name = "virt2phys",
@@ -6767,6 +7240,14 @@ static const struct command_registration target_exec_command_handlers[] = {
 				"enabled to improve performance.",
 		.usage = "['enable'|'disable']",
 	},
+	{
+		.name = "timer_stats",
+		.handler = handle_timer_stats_command,
+		.mode = COMMAND_ANY,
+		.help = "display or reset latency and jitter statistics of the "
+			"timer callbacks (target polling, RTT, ...)",
+		.usage = "['reset']",
+	},
 	{
 		.name = "ps",
 		.handler = handle_ps_command,
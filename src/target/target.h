@@ -36,6 +36,7 @@ struct mem_param;
 struct reg_param;
 struct target_list;
 struct gdb_fileio_info;
+struct mem_cache;
 
 /*
  * TARGET_UNKNOWN = 0: we don't know anything about the target yet
@@ -88,6 +89,8 @@ struct working_area {
 	bool free;
 	uint8_t *backup;
 	struct working_area **user;
+	/* loader code kept in this area, see target_alloc_working_area_loader() */
+	const uint8_t *loader;
 	struct working_area *next;
 };
 
@@ -207,6 +210,9 @@ struct target {
 
 	/* The semihosting information, extracted from the target. */
 	struct semihosting *semihosting;
+
+	/* optional cache for memory reads while halted, see mem_cache.h */
+	struct mem_cache *mem_cache;
 };
 
 struct target_list {
@@ -334,7 +340,16 @@ struct target_timer_callback {
 	bool removed;
 	int64_t when;	/* output of timeval_ms() */
 	void *priv;
-	struct target_timer_callback *next;
+	uint64_t seq;	/* registration order, breaks ties between equal 'when' */
+
+	/* statistics, see "timer_stats" command */
+	uint64_t calls;
+	int64_t late_total_ms;	/* sum of (call time - when) */
+	int64_t late_max_ms;
+	int64_t late_last_ms;
+	int64_t jitter_total_ms;	/* sum of |late - previous late| */
+	int64_t run_total_us;	/* time spent in the callback */
+	int64_t run_max_us;
 };
 
 struct target_memory_check_block {
@@ -343,6 +358,14 @@ struct target_memory_check_block {
 	uint32_t result;
 };
 
+/** One region of a scatter/gather read, see target_read_memory_multi() */
+struct target_memory_chunk {
+	target_addr_t address;
+	uint32_t size;		/* access size in bytes */
+	uint32_t count;		/* number of items of size */
+	uint8_t *buffer;
+};
+
 int target_register_commands(struct command_context *cmd_ctx);
 int target_examine(void);
 
@@ -604,6 +627,16 @@ int target_read_memory(struct target *target,
 		target_addr_t address, uint32_t size, uint32_t count, uint8_t *buffer);
 int target_read_phys_memory(struct target *target,
 		target_addr_t address, uint32_t size, uint32_t count, uint8_t *buffer);
+/**
+ * Read several independent memory regions of @a target, as if by calling
+ * target_read_memory() for each of the @a num @a chunks in turn.
+ *
+ * Targets implementing target->type->read_memory_multi queue all regions
+ * into a single adapter transaction, saving a round trip per region for
+ * callers like RTOS thread list updates that read many small items.
+ */
+int target_read_memory_multi(struct target *target,
+		unsigned int num, const struct target_memory_chunk *chunks);
 /**
  * Write @a count items of @a size bytes to the memory of @a target at
  * the @a address given. @a address must be aligned to @a size
@@ -724,6 +757,29 @@ int target_alloc_working_area(struct target *target,
  */
 int target_alloc_working_area_try(struct target *target,
 		uint32_t size, struct working_area **area);
+/**
+ * Allocate the largest working area available, but not more than
+ * @a max_size bytes. Fails without logging an error if less than
+ * @a min_size bytes are available.
+ *
+ * This replaces the loops in flash drivers that halve their buffer size
+ * until an allocation succeeds.
+ */
+int target_alloc_working_area_largest(struct target *target,
+		uint32_t min_size, uint32_t max_size, struct working_area **area);
+/**
+ * Allocate a working area and upload the loader @a code into it.
+ *
+ * When the area is freed, it stays reserved with its content in target
+ * memory as long as the target is not resumed or reset and area backup
+ * is not configured. A following call with the same @a code then
+ * returns the same area without uploading the code again. Reserved
+ * loaders are dropped whenever another allocation runs short of space.
+ *
+ * @a code must be static: its address identifies the loader.
+ */
+int target_alloc_working_area_loader(struct target *target,
+		const uint8_t *code, uint32_t size, struct working_area **area);
 /**
  * Free a working area.
  * Restore target data if area backup is configured.
@@ -117,6 +117,14 @@ struct target_type {
 	 */
 	int (*read_memory)(struct target *target, target_addr_t address,
 			uint32_t size, uint32_t count, uint8_t *buffer);
+	/**
+	 * Optional scatter/gather memory read callback, reading all @a chunks
+	 * in one adapter transaction where possible. Semantics as if
+	 * read_memory was called for each chunk. Do @b not call this function
+	 * directly, use target_read_memory_multi() instead.
+	 */
+	int (*read_memory_multi)(struct target *target,
+			unsigned int num, const struct target_memory_chunk *chunks);
 	/**
 	 * Target memory write callback.  Do @b not call this function
 	 * directly, use target_write_memory() instead.
@@ -300,6 +308,14 @@ struct target_type {
 	int (*profiling)(struct target *target, uint32_t *samples,
 			uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
 
+	/* Halt the running target, read its PC and resume it again, queued as
+	 * a single transaction. Neither target->state nor the register cache
+	 * are updated. Optional; used by target_profiling_default() to take
+	 * samples much faster than a full halt/poll/resume cycle.
+	 * Returns ERROR_TARGET_NOT_HALTED if the core did not stop in time,
+	 * the sample should then be dropped. */
+	int (*sample_pc)(struct target *target, uint32_t *pc);
+
 	/* Return the number of address bits this target supports. This will
 	 * typically be 32 for 32-bit targets, and 64 for 64-bit targets. If not
 	 * implemented, it's assumed to be 32. */